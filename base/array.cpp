@@ -25,5 +25,9 @@ namespace grace {
 		void array_index_out_of_bounds(size_t idx, size_t max) {
 			raise<IndexOutOfBoundsException>("Requested index {0} from Array of size {1}.", idx, max);
 		}
+		
+		void array_too_large(size_t size) {
+			raise<OutOfMemoryError>("Array can't hold {0} elements, its limit is {1}. Use BigArray instead.", size, (size_t)UINT32_MAX);
+		}
 	}
 }
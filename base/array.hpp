@@ -12,6 +12,7 @@ namespace grace {
 
 	namespace detail {
 		void array_index_out_of_bounds(size_t idx, size_t max);
+		void array_too_large(size_t size);
 	}
 
 template <typename T>
@@ -94,6 +95,10 @@ private:
 	void check_index_valid(size_t idx) const;
 };
 
+template <typename T> struct IsTriviallyRelocatable<Array<T>> {
+	static const bool Value = true;
+};
+
 class String;
 struct StringRef;
 struct IAttribute;
@@ -243,6 +248,9 @@ T Array<T>::pop_back() {
 
 template <typename T>
 void Array<T>::reserve(size_t new_size) {
+	if (new_size > UINT32_MAX) {
+		detail::array_too_large(new_size);
+	}
 	size_t alloc_size = alloc_size_;
 	data_ = grace::resize_allocation<T>(allocator_, data_, &alloc_size, size_, new_size, 3, 2);
 	alloc_size_ = (uint32)alloc_size;
@@ -275,6 +283,26 @@ typename Array<T>::iterator Array<T>::insert(InputIterator b, InputIterator e, i
 	reserve(size_ + add_len);
 	// reserve invalidates iterators, so recalculate it:
 	before = begin() + before_idx;
+	if (IsTriviallyRelocatable<T>::Value) {
+		// Open a gap of uninitialized elements, and construct the new ones in it.
+		::memmove((void*)(before.get() + add_len), (void*)before.get(), num_move * sizeof(T));
+		size_t i = 0;
+		try {
+			for (auto it = b; it != e; ++it, ++i) {
+				new((before + i).get()) T(*it);
+			}
+		}
+		catch (...) {
+			// Destroy what was built and close the gap again, so the array is as it was.
+			for (size_t j = 0; j < i; ++j) {
+				(before + j)->~T();
+			}
+			::memmove((void*)before.get(), (void*)(before.get() + add_len), num_move * sizeof(T));
+			throw;
+		}
+		size_ += add_len;
+		return before;
+	}
 	iterator move_end = end();
 	iterator move_begin = before;
 	iterator move_target_end = end() + add_len;
@@ -313,6 +341,26 @@ typename Array<T>::iterator Array<T>::insert_move(InputIterator b, InputIterator
 	reserve(size_ + add_len);
 	// reserve invalidates iterators, so recalculate it:
 	before = begin() + before_idx;
+	if (IsTriviallyRelocatable<T>::Value) {
+		// Open a gap of uninitialized elements, and construct the new ones in it.
+		::memmove((void*)(before.get() + add_len), (void*)before.get(), num_move * sizeof(T));
+		size_t i = 0;
+		try {
+			for (auto it = b; it != e; ++it, ++i) {
+				new((before + i).get()) T(move(*it));
+			}
+		}
+		catch (...) {
+			// Destroy what was built and close the gap again, so the array is as it was.
+			for (size_t j = 0; j < i; ++j) {
+				(before + j)->~T();
+			}
+			::memmove((void*)before.get(), (void*)(before.get() + add_len), num_move * sizeof(T));
+			throw;
+		}
+		size_ += add_len;
+		return before;
+	}
 	iterator move_end = end();
 	iterator move_begin = before;
 	iterator move_target_end = end() + add_len;
@@ -379,7 +427,11 @@ void Array<T>::check_index_valid(size_t idx) const {
 template <typename T>
 size_t Array<T>::erase(size_t idx) {
 	check_index_valid(idx);
-	if (idx == size_-1) {
+	if (IsTriviallyRelocatable<T>::Value) {
+		data_[idx].~T();
+		::memmove((void*)(data_ + idx), (void*)(data_ + idx + 1), (size_ - idx - 1) * sizeof(T));
+		--size_;
+	} else if (idx == size_-1) {
 		data_[idx].~T();
 		--size_;
 	} else {
@@ -31,7 +31,7 @@ namespace grace {
 			}
 			ASSERT(req_size >= new_size);
 			T* new_data;
-			if (IsTriviallyCopyable<T>::Value) {
+			if (IsTriviallyRelocatable<T>::Value) {
 				new_data = (T*)allocator.reallocate(data, sizeof(T) * (*inout_alloc_size), sizeof(T) * req_size, alignof(T));
 			} else {
 				new_data = (T*)allocator.allocate(sizeof(T)*req_size, alignof(T));
@@ -97,10 +97,18 @@ return MEMBER.METHOD_NAME(std::forward<ForwardArgs_>(args)...); \
 #define ALWAYS_INLINE inline
 #endif
 
+#if __has_attribute(noinline)
+#define NEVER_INLINE __attribute__((noinline))
+#else
+#define NEVER_INLINE
+#endif
+
 #define UNSAFE_OFFSET_OF(T, MEMBER) (size_t)(&((T*)nullptr)->MEMBER)
 
 #if defined(__GNUC__)
 #define ALIGNED(N) __attribute__((aligned(N)))
+// Only usable with POD types. For anything that needs a destructor, pair it with a pthread key.
+#define THREAD_LOCAL __thread
 #else
 #error Compiler unsupported.
 #endif
@@ -315,6 +323,14 @@ auto linear_search(Container& container, const ComparableValue& value)
 		}
 	};
 	
+	/// Greater-than comparison struct. Equivalent to std::greater.
+	struct Greater {
+		template <typename A, typename B>
+		bool operator()(const A& a, const B& b) const {
+			return b < a;
+		}
+	};
+	
 #define ENUM_IS_FLAGS(T) \
 	inline typename std::underlying_type<T>::type \
 	operator|(T a, T b) { return static_cast<typename std::underlying_type<T>::type>(+a | +b); } \
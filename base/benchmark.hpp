@@ -68,7 +68,14 @@ namespace grace {
 		void enter_scope(StringRef name);
 		void leave_scope(ProcessTimeDelta elapsed);
 	private:
-		BenchmarkManager() : frame_alloc(sizeof(BenchmarkScopeResults) * 256) {}
+		BenchmarkManager() : frame_alloc(sizeof(BenchmarkScopeResults) * 256, frame_alloc_options()) {}
+		static LinearAllocatorOptions frame_alloc_options() {
+			// Deep frames spill into extra segments, which are reused on the next frame.
+			LinearAllocatorOptions options;
+			options.growable = true;
+			options.retain_segments = true;
+			return options;
+		}
 		BenchmarkScopeResults* current = nullptr;
 		BareLinkList<BenchmarkScopeResults> frame;
 		Dictionary<BenchmarkResults> accum;
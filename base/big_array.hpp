@@ -0,0 +1,307 @@
+//
+//  big_array.hpp
+//  grace
+//
+
+#ifndef grace_big_array_hpp
+#define grace_big_array_hpp
+
+#include "base/basic.hpp"
+#include "base/array_ref.hpp"
+#include "base/array_utils.hpp"
+#include "base/iterators.hpp"
+#include "base/type_traits.hpp"
+#include "memory/allocator.hpp"
+
+namespace grace {
+	namespace detail {
+		void array_index_out_of_bounds(size_t idx, size_t max);
+	}
+
+	/*
+		BigArray is an Array with 64-bit sizes, for buffers that may exceed Array's 4G element limit, such as
+		whole files read with read_all.
+
+		Below LARGE_ALLOCATION_THRESHOLD bytes it grows like Array. Past that its memory comes straight from
+		allocate_large, and it grows with reallocate_large, which for trivially relocatable elements lets
+		SystemAllocator move the pages to a larger mapping rather than copy them.
+	*/
+	template <typename T>
+	class BigArray {
+	public:
+		typedef T value_type;
+		using iterator = LinearMemoryIterator<T, false>;
+		using const_iterator = LinearMemoryIterator<T, true>;
+		static const size_t LARGE_ALLOCATION_THRESHOLD = 0x100000; // 1 MiB
+
+		BigArray() : allocator_(default_allocator()) {}
+		explicit BigArray(IAllocator& alloc) : allocator_(alloc) {}
+		BigArray(std::initializer_list<T> list, IAllocator& alloc = default_allocator());
+		BigArray(const BigArray<T>& other, IAllocator& alloc);
+		BigArray(const BigArray<T>& other);
+		BigArray(BigArray<T>&& other);
+		explicit BigArray(ArrayRef<T> array, IAllocator& alloc = default_allocator());
+		~BigArray();
+		BigArray<T>& operator=(const BigArray<T>& other);
+		BigArray<T>& operator=(BigArray<T>&& other);
+
+		IAllocator& allocator() const { return allocator_; }
+
+		ArrayRef<T> ref() const {
+			return ArrayRef<T>(data_, data_ + size_);
+		}
+
+		operator ArrayRef<T>() const {
+			return ref();
+		}
+
+		T& operator[](size_t idx);
+		const T& operator[](size_t idx) const;
+
+		size_t size() const { return size_; }
+		size_t capacity() const { return alloc_size_; }
+		void push_back(T element);
+		T pop_back();
+		T& back();
+		const T& back() const;
+		T& front();
+		const T& front() const;
+		void reserve(size_t);
+		void resize(size_t, T fill = T());
+		void clear(bool deallocate = true);
+
+		template <typename InputIterator>
+		iterator insert(InputIterator begin, InputIterator end);
+		template <typename InputIterator>
+		iterator insert_move(InputIterator begin, InputIterator end);
+
+		template <typename... Args>
+		void emplace_back(Args&&... args);
+
+		iterator begin() { return data_; }
+		iterator end() { return data_ + size_; }
+		const_iterator begin() const { return data_; }
+		const_iterator end() const { return data_ + size_; }
+		T* data() { return data_; }
+		const T* data() const { return data_; }
+	private:
+		IAllocator& allocator_;
+		T* data_ = nullptr;
+		size_t size_ = 0;
+		size_t alloc_size_ = 0;
+		size_t large_size_ = 0; // Bytes obtained from allocate_large, or 0 while data_ is a regular allocation.
+
+		void release();
+		void check_index_valid(size_t idx) const;
+	};
+
+	template <typename T>
+	BigArray<T>::BigArray(std::initializer_list<T> list, IAllocator& alloc) : allocator_(alloc) {
+		insert(list.begin(), list.end());
+	}
+
+	template <typename T>
+	BigArray<T>::BigArray(const BigArray<T>& other) : allocator_(default_allocator()) {
+		insert(other.begin(), other.end());
+	}
+
+	template <typename T>
+	BigArray<T>::BigArray(const BigArray<T>& other, IAllocator& alloc) : allocator_(alloc) {
+		insert(other.begin(), other.end());
+	}
+
+	template <typename T>
+	BigArray<T>::BigArray(ArrayRef<T> other, IAllocator& alloc) : allocator_(alloc) {
+		insert(other.begin(), other.end());
+	}
+
+	template <typename T>
+	BigArray<T>::BigArray(BigArray<T>&& other) : allocator_(other.allocator_), data_(other.data_), size_(other.size_), alloc_size_(other.alloc_size_), large_size_(other.large_size_) {
+		other.data_ = nullptr;
+		other.size_ = 0;
+		other.alloc_size_ = 0;
+		other.large_size_ = 0;
+	}
+
+	template <typename T>
+	BigArray<T>::~BigArray() {
+		clear(true);
+	}
+
+	template <typename T>
+	BigArray<T>& BigArray<T>::operator=(const BigArray<T>& other) {
+		if (this == &other) return *this;
+		clear(false);
+		insert(other.begin(), other.end());
+		return *this;
+	}
+
+	template <typename T>
+	BigArray<T>& BigArray<T>::operator=(BigArray<T>&& other) {
+		if (this == &other) return *this;
+		clear(true);
+		if (&allocator_ == &other.allocator_) {
+			data_ = other.data_;
+			size_ = other.size_;
+			alloc_size_ = other.alloc_size_;
+			large_size_ = other.large_size_;
+			other.data_ = nullptr;
+			other.size_ = 0;
+			other.alloc_size_ = 0;
+			other.large_size_ = 0;
+		} else {
+			insert_move(other.begin(), other.end());
+			other.clear(true);
+		}
+		return *this;
+	}
+
+	template <typename T>
+	T& BigArray<T>::operator[](size_t idx) {
+		check_index_valid(idx);
+		return data_[idx];
+	}
+
+	template <typename T>
+	const T& BigArray<T>::operator[](size_t idx) const {
+		check_index_valid(idx);
+		return data_[idx];
+	}
+
+	template <typename T>
+	T& BigArray<T>::back() {
+		check_index_valid(size_-1);
+		return data_[size_-1];
+	}
+
+	template <typename T>
+	const T& BigArray<T>::back() const {
+		check_index_valid(size_-1);
+		return data_[size_-1];
+	}
+
+	template <typename T>
+	T& BigArray<T>::front() {
+		check_index_valid(0);
+		return data_[0];
+	}
+
+	template <typename T>
+	const T& BigArray<T>::front() const {
+		check_index_valid(0);
+		return data_[0];
+	}
+
+	template <typename T>
+	void BigArray<T>::push_back(T element) {
+		reserve(size_+1);
+		new(data_ + size_) T(std::move(element));
+		size_++;
+	}
+
+	template <typename T>
+	template <typename... Args>
+	void BigArray<T>::emplace_back(Args&&... args) {
+		reserve(size_+1);
+		new(data_ + size_) T(std::forward<Args>(args)...);
+		size_++;
+	}
+
+	template <typename T>
+	T BigArray<T>::pop_back() {
+		check_index_valid(size_-1);
+		T element = std::move(data_[size_-1]);
+		data_[--size_].~T();
+		return element;
+	}
+
+	template <typename T>
+	void BigArray<T>::reserve(size_t new_size) {
+		if (new_size <= alloc_size_) return;
+		if (large_size_ == 0 && new_size * sizeof(T) < LARGE_ALLOCATION_THRESHOLD) {
+			data_ = grace::resize_allocation<T>(allocator_, data_, &alloc_size_, size_, new_size, 3, 2);
+			return;
+		}
+		// Overallocate large buffers too, so that a run of appends doesn't remap every time.
+		size_t grown = alloc_size_ + alloc_size_ / 2;
+		size_t nbytes = (grown > new_size ? grown : new_size) * sizeof(T);
+		size_t actual;
+		T* new_data;
+		if (large_size_ != 0 && IsTriviallyRelocatable<T>::Value) {
+			new_data = (T*)allocator_.reallocate_large(data_, large_size_, nbytes, alignof(T), actual);
+		} else {
+			new_data = (T*)allocator_.allocate_large(nbytes, alignof(T), actual);
+			for (size_t i = 0; i < size_; ++i) {
+				new(new_data + i) T(std::move(data_[i]));
+				data_[i].~T();
+			}
+			release();
+		}
+		data_ = new_data;
+		large_size_ = actual;
+		alloc_size_ = actual / sizeof(T);
+	}
+
+	template <typename T>
+	void BigArray<T>::resize(size_t new_size, T x) {
+		reserve(new_size);
+		while (size_ < new_size) push_back(x);
+		while (size_ > new_size) data_[--size_].~T();
+	}
+
+	template <typename T>
+	void BigArray<T>::release() {
+		if (large_size_ != 0) {
+			allocator_.free_large(data_, large_size_);
+		} else {
+			allocator_.free(data_, sizeof(T) * alloc_size_);
+		}
+	}
+
+	template <typename T>
+	void BigArray<T>::clear(bool deallocate) {
+		for (size_t i = 0; i < size_; ++i) {
+			data_[i].~T();
+		}
+		size_ = 0;
+		if (deallocate) {
+			release();
+			data_ = nullptr;
+			alloc_size_ = 0;
+			large_size_ = 0;
+		}
+	}
+
+	template <typename T>
+	template <typename InputIterator>
+	typename BigArray<T>::iterator BigArray<T>::insert(InputIterator b, InputIterator e) {
+		size_t old_size = size_;
+		reserve(size_ + (e - b));
+		for (auto it = b; it != e; ++it) {
+			new(data_ + size_) T(*it);
+			++size_;
+		}
+		return begin() + old_size;
+	}
+
+	template <typename T>
+	template <typename InputIterator>
+	typename BigArray<T>::iterator BigArray<T>::insert_move(InputIterator b, InputIterator e) {
+		size_t old_size = size_;
+		reserve(size_ + (e - b));
+		for (auto it = b; it != e; ++it) {
+			new(data_ + size_) T(std::move(*it));
+			++size_;
+		}
+		return begin() + old_size;
+	}
+
+	template <typename T>
+	void BigArray<T>::check_index_valid(size_t idx) const {
+		if (idx >= size_) {
+			detail::array_index_out_of_bounds(idx, size_);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,371 @@
+//
+//  concurrent_queue.hpp
+//  grace
+//
+
+#ifndef grace_concurrent_queue_hpp
+#define grace_concurrent_queue_hpp
+
+#include "base/basic.hpp"
+#include "memory/allocator.hpp"
+
+#include <atomic>
+#include <type_traits>
+
+namespace grace {
+	static const size_t CACHE_LINE_SIZE = 64;
+
+	namespace detail {
+		inline size_t queue_capacity_for(size_t n) {
+			size_t capacity = 2;
+			while (capacity < n) capacity <<= 1;
+			return capacity;
+		}
+	}
+
+	/*
+		SPSCQueue is a bounded, lock-free FIFO for exactly one producer thread and one consumer thread.
+
+		The producer and consumer counters live on separate cache lines, and each side keeps a cached copy
+		of the other's counter, so that a push or pop usually touches no line written by the other thread.
+		Capacity is rounded up to a power of two. Elements are moved in and out, so move-only types such as
+		Function<void()> and UniquePtr<T> work.
+	*/
+	template <typename T>
+	class SPSCQueue {
+	public:
+		explicit SPSCQueue(size_t capacity, IAllocator& alloc = default_allocator());
+		~SPSCQueue();
+		SPSCQueue(const SPSCQueue<T>&) = delete;
+		SPSCQueue<T>& operator=(const SPSCQueue<T>&) = delete;
+
+		// Producer side. These return false and leave the argument untouched when the queue is full.
+		bool try_push(T&& element) { return try_emplace(std::move(element)); }
+		bool try_push(const T& element) { return try_emplace(element); }
+		template <typename... Args>
+		bool try_emplace(Args&&... args);
+
+		// Consumer side.
+		bool try_pop(T& out_element);
+
+		size_t capacity() const { return mask_ + 1; }
+		size_t size_approx() const { return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed); }
+		IAllocator& allocator() const { return allocator_; }
+	private:
+		using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+		IAllocator& allocator_;
+		Slot* slots_;
+		size_t mask_;
+
+		ALIGNED(CACHE_LINE_SIZE) std::atomic<size_t> head_; // written by the consumer
+		size_t cached_tail_ = 0;
+
+		ALIGNED(CACHE_LINE_SIZE) std::atomic<size_t> tail_; // written by the producer
+		size_t cached_head_ = 0;
+
+		T* slot(size_t idx) { return reinterpret_cast<T*>(slots_ + (idx & mask_)); }
+	};
+
+	/*
+		MPMCQueue is a bounded, lock-free FIFO for any number of producers and consumers, after Dmitry
+		Vyukov's bounded MPMC queue. Each cell carries a sequence number that tells a producer whether the
+		cell is free and a consumer whether it holds a value, so both sides claim cells with a single CAS
+		on their own counter.
+	*/
+	template <typename T>
+	class MPMCQueue {
+	public:
+		explicit MPMCQueue(size_t capacity, IAllocator& alloc = default_allocator());
+		~MPMCQueue();
+		MPMCQueue(const MPMCQueue<T>&) = delete;
+		MPMCQueue<T>& operator=(const MPMCQueue<T>&) = delete;
+
+		bool try_push(T&& element) { return try_emplace(std::move(element)); }
+		bool try_push(const T& element) { return try_emplace(element); }
+		template <typename... Args>
+		bool try_emplace(Args&&... args);
+		bool try_pop(T& out_element);
+
+		size_t capacity() const { return mask_ + 1; }
+		size_t size_approx() const;
+		IAllocator& allocator() const { return allocator_; }
+	private:
+		struct Cell {
+			std::atomic<size_t> sequence;
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		};
+
+		IAllocator& allocator_;
+		Cell* cells_;
+		size_t mask_;
+
+		ALIGNED(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos_;
+		ALIGNED(CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos_;
+	};
+
+	/*
+		WorkStealingDeque is a Chase-Lev deque, as formulated for C11 atomics by Lê, Pop, Cohen and Zappa
+		Nardelli. The owning thread pushes and pops at the bottom like a stack, and only synchronizes with
+		other threads when it takes the last element. Any other thread may steal from the top.
+
+		A thief may read a slot while the owner overwrites it and only learns from its failed CAS that the
+		value is stale, so T must be trivially copyable; in practice it holds pointers to tasks. The ring
+		grows when full, and replaced rings stay allocated until the deque is destroyed, since a thief may
+		still be reading one.
+	*/
+	template <typename T>
+	class WorkStealingDeque {
+	public:
+		explicit WorkStealingDeque(size_t capacity = 64, IAllocator& alloc = default_allocator());
+		~WorkStealingDeque();
+		WorkStealingDeque(const WorkStealingDeque<T>&) = delete;
+		WorkStealingDeque<T>& operator=(const WorkStealingDeque<T>&) = delete;
+
+		// Owner side.
+		void push(T element);
+		bool pop(T& out_element);
+
+		// Any thread. Also returns false when it loses a race for the last element.
+		bool steal(T& out_element);
+
+		size_t size_approx() const;
+		IAllocator& allocator() const { return allocator_; }
+	private:
+		static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque elements must be trivially copyable.");
+
+		struct Ring {
+			int64 mask;
+			Ring* replaced;
+			std::atomic<T>* slots() { return reinterpret_cast<std::atomic<T>*>(this + 1); }
+			std::atomic<T>& operator[](int64 idx) { return slots()[idx & mask]; }
+		};
+
+		IAllocator& allocator_;
+		ALIGNED(CACHE_LINE_SIZE) std::atomic<int64> top_;
+		ALIGNED(CACHE_LINE_SIZE) std::atomic<int64> bottom_;
+		std::atomic<Ring*> ring_;
+
+		Ring* allocate_ring(size_t capacity, Ring* replaced);
+		Ring* grow(Ring* ring, int64 top, int64 bottom);
+	};
+
+	template <typename T>
+	SPSCQueue<T>::SPSCQueue(size_t capacity, IAllocator& alloc) : allocator_(alloc) {
+		capacity = detail::queue_capacity_for(capacity);
+		slots_ = (Slot*)allocator_.allocate(sizeof(Slot) * capacity, alignof(Slot));
+		mask_ = capacity - 1;
+		std::atomic_init<size_t>(&head_, 0);
+		std::atomic_init<size_t>(&tail_, 0);
+	}
+
+	template <typename T>
+	SPSCQueue<T>::~SPSCQueue() {
+		size_t tail = tail_.load(std::memory_order_acquire);
+		for (size_t i = head_.load(std::memory_order_relaxed); i != tail; ++i) {
+			slot(i)->~T();
+		}
+		allocator_.free(slots_, sizeof(Slot) * capacity());
+	}
+
+	template <typename T>
+	template <typename... Args>
+	bool SPSCQueue<T>::try_emplace(Args&&... args) {
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - cached_head_ == capacity()) {
+			cached_head_ = head_.load(std::memory_order_acquire);
+			if (tail - cached_head_ == capacity()) {
+				return false;
+			}
+		}
+		new(slot(tail)) T(std::forward<Args>(args)...);
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename T>
+	bool SPSCQueue<T>::try_pop(T& out_element) {
+		size_t head = head_.load(std::memory_order_relaxed);
+		if (head == cached_tail_) {
+			cached_tail_ = tail_.load(std::memory_order_acquire);
+			if (head == cached_tail_) {
+				return false;
+			}
+		}
+		T* element = slot(head);
+		out_element = std::move(*element);
+		element->~T();
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename T>
+	MPMCQueue<T>::MPMCQueue(size_t capacity, IAllocator& alloc) : allocator_(alloc) {
+		capacity = detail::queue_capacity_for(capacity);
+		cells_ = (Cell*)allocator_.allocate(sizeof(Cell) * capacity, alignof(Cell));
+		mask_ = capacity - 1;
+		for (size_t i = 0; i < capacity; ++i) {
+			std::atomic_init<size_t>(&cells_[i].sequence, i);
+		}
+		std::atomic_init<size_t>(&enqueue_pos_, 0);
+		std::atomic_init<size_t>(&dequeue_pos_, 0);
+	}
+
+	template <typename T>
+	MPMCQueue<T>::~MPMCQueue() {
+		size_t end = enqueue_pos_.load(std::memory_order_acquire);
+		for (size_t i = dequeue_pos_.load(std::memory_order_relaxed); i != end; ++i) {
+			reinterpret_cast<T*>(&cells_[i & mask_].storage)->~T();
+		}
+		allocator_.free(cells_, sizeof(Cell) * capacity());
+	}
+
+	template <typename T>
+	template <typename... Args>
+	bool MPMCQueue<T>::try_emplace(Args&&... args) {
+		Cell* cell;
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		while (true) {
+			cell = &cells_[pos & mask_];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t difference = (intptr_t)sequence - (intptr_t)pos;
+			if (difference == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (difference < 0) {
+				return false; // full
+			} else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		new(&cell->storage) T(std::forward<Args>(args)...);
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename T>
+	bool MPMCQueue<T>::try_pop(T& out_element) {
+		Cell* cell;
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		while (true) {
+			cell = &cells_[pos & mask_];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t difference = (intptr_t)sequence - (intptr_t)(pos + 1);
+			if (difference == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (difference < 0) {
+				return false; // empty
+			} else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		T* element = reinterpret_cast<T*>(&cell->storage);
+		out_element = std::move(*element);
+		element->~T();
+		cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename T>
+	size_t MPMCQueue<T>::size_approx() const {
+		size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+		size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+
+	template <typename T>
+	WorkStealingDeque<T>::WorkStealingDeque(size_t capacity, IAllocator& alloc) : allocator_(alloc) {
+		std::atomic_init<int64>(&top_, 0);
+		std::atomic_init<int64>(&bottom_, 0);
+		std::atomic_init<Ring*>(&ring_, allocate_ring(detail::queue_capacity_for(capacity), nullptr));
+	}
+
+	template <typename T>
+	WorkStealingDeque<T>::~WorkStealingDeque() {
+		Ring* ring = ring_.load(std::memory_order_relaxed);
+		while (ring) {
+			Ring* replaced = ring->replaced;
+			allocator_.free(ring, sizeof(Ring) + sizeof(std::atomic<T>) * (ring->mask + 1));
+			ring = replaced;
+		}
+	}
+
+	template <typename T>
+	typename WorkStealingDeque<T>::Ring* WorkStealingDeque<T>::allocate_ring(size_t capacity, Ring* replaced) {
+		static_assert(alignof(Ring) >= alignof(std::atomic<T>), "Ring slots would be misaligned.");
+		Ring* ring = (Ring*)allocator_.allocate(sizeof(Ring) + sizeof(std::atomic<T>) * capacity, alignof(Ring));
+		ring->mask = (int64)capacity - 1;
+		ring->replaced = replaced;
+		return ring;
+	}
+
+	template <typename T>
+	typename WorkStealingDeque<T>::Ring* WorkStealingDeque<T>::grow(Ring* ring, int64 top, int64 bottom) {
+		Ring* bigger = allocate_ring((size_t)(ring->mask + 1) * 2, ring);
+		for (int64 i = top; i < bottom; ++i) {
+			(*bigger)[i].store((*ring)[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		ring_.store(bigger, std::memory_order_release);
+		return bigger;
+	}
+
+	template <typename T>
+	void WorkStealingDeque<T>::push(T element) {
+		int64 bottom = bottom_.load(std::memory_order_relaxed);
+		int64 top = top_.load(std::memory_order_acquire);
+		Ring* ring = ring_.load(std::memory_order_relaxed);
+		if (bottom - top > ring->mask) {
+			ring = grow(ring, top, bottom);
+		}
+		(*ring)[bottom].store(element, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom_.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	template <typename T>
+	bool WorkStealingDeque<T>::pop(T& out_element) {
+		int64 bottom = bottom_.load(std::memory_order_relaxed) - 1;
+		Ring* ring = ring_.load(std::memory_order_relaxed);
+		bottom_.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 top = top_.load(std::memory_order_relaxed);
+		if (top > bottom) {
+			bottom_.store(bottom + 1, std::memory_order_relaxed); // was empty
+			return false;
+		}
+		T element = (*ring)[bottom].load(std::memory_order_relaxed);
+		if (top == bottom) {
+			// The last element, which a thief may be after as well.
+			bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom_.store(bottom + 1, std::memory_order_relaxed);
+			if (!won) return false;
+		}
+		out_element = element;
+		return true;
+	}
+
+	template <typename T>
+	bool WorkStealingDeque<T>::steal(T& out_element) {
+		int64 top = top_.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 bottom = bottom_.load(std::memory_order_acquire);
+		if (top >= bottom) {
+			return false;
+		}
+		Ring* ring = ring_.load(std::memory_order_acquire);
+		T element = (*ring)[top].load(std::memory_order_relaxed);
+		if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return false;
+		}
+		out_element = element;
+		return true;
+	}
+
+	template <typename T>
+	size_t WorkStealingDeque<T>::size_approx() const {
+		int64 bottom = bottom_.load(std::memory_order_relaxed);
+		int64 top = top_.load(std::memory_order_relaxed);
+		return bottom > top ? (size_t)(bottom - top) : 0;
+	}
+}
+
+#endif
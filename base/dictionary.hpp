@@ -10,8 +10,14 @@
 #define grace_dictionary_hpp
 
 #include "base/map.hpp"
+#include "base/symbol.hpp"
 
 namespace grace {
+	/*
+	 Dictionary is a Map from strings to values. Keys are interned as Symbols, so a key
+	 that appears in many dictionaries (such as an attribute name in a document) is only
+	 stored once, and nothing is allocated for a key that has been seen before.
+	*/
 	template <typename Value, typename Cmp = Less>
 	class Dictionary {
 	public:
@@ -69,6 +75,15 @@ namespace grace {
 		template <typename ComparableAndConvertibleKey = StringRef>
 		iterator set(const ComparableAndConvertibleKey& key, Value value);
 		
+		// See Map. Keys are interned up front, and the batch is sorted and merged in one pass.
+		template <typename InputIterator>
+		void insert_unsorted_bulk(InputIterator a, InputIterator b);
+		// Replaces the contents with a...b, which must already be sorted by key without duplicates.
+		template <typename InputIterator>
+		void build_from_sorted(InputIterator a, InputIterator b);
+		void merge(const Self& other) { map_.merge(other.map_); }
+		void merge(Self&& other) { map_.merge(move(other.map_)); }
+		
 		template <typename ComparableKey = StringRef>
 		iterator find(const ComparableKey& key) { return map_.find(key); }
 		template <typename ComparableKey = StringRef>
@@ -118,9 +133,6 @@ namespace grace {
 	
 	template <typename V, typename C>
 	void Dictionary<V,C>::clear(bool free_memory) {
-		for (auto& k: keys()) {
-			allocator().free((void*)k.data(), k.size());
-		}
 		map_.clear(free_memory);
 	}
 	
@@ -131,7 +143,6 @@ namespace grace {
 	
 	template <typename V, typename C>
 	typename Dictionary<V,C>::iterator Dictionary<V,C>::erase(iterator it) {
-		allocator().free(it->first.data(), it->first.size());
 		return map_.erase(it);
 	}
 	
@@ -176,14 +187,42 @@ namespace grace {
 		return insert_one(key, move(value));
 	}
 	
+	template <typename V, typename C>
+	template <typename InputIterator>
+	void Dictionary<V,C>::insert_unsorted_bulk(InputIterator a, InputIterator b) {
+		size_t n = b - a;
+		if (n == 0) return;
+		using PairType = Pair<StringRef, V>;
+		IAllocator& alloc = allocator();
+		PairType* tmp = (PairType*)alloc.allocate(sizeof(PairType) * n, alignof(PairType));
+		size_t i = 0;
+		for (auto it = a; it != b; ++it, ++i) {
+			new(tmp + i) PairType{Symbol(it->first).str(), it->second};
+		}
+		map_.insert_unsorted_bulk_move(tmp, tmp + n);
+		destruct_range(tmp, tmp + n);
+		alloc.free(tmp, sizeof(PairType) * n);
+	}
+	
+	template <typename V, typename C>
+	template <typename InputIterator>
+	void Dictionary<V,C>::build_from_sorted(InputIterator a, InputIterator b) {
+		map_.clear(false);
+		auto n = iterator_distance_if_supported(a, b);
+		if (n != SIZE_MAX) {
+			reserve(n);
+		}
+		for (auto it = a; it != b; ++it) {
+			// Each key sorts last, so this appends without shifting anything.
+			insert_one(it->first, it->second);
+		}
+	}
+	
 	template <typename V, typename C>
 	template <typename ComparableAndConvertibleKey>
 	typename Dictionary<V,C>::iterator Dictionary<V,C>::insert_one(const ComparableAndConvertibleKey& key, V v) {
-		StringRef k0 = key;
-		char* str = (char*)allocator().allocate(k0.size(), 1);
-		std::copy(k0.begin(), k0.end(), str);
-		StringRef k1(str, k0.size());
-		return map_.set(k1, move(v));
+		Symbol k(key);
+		return map_.set(k.str(), move(v));
 	}
 	
 	template <typename V, typename C>
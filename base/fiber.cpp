@@ -7,86 +7,157 @@
 //
 
 #include "base/fiber.hpp"
+#include "base/fiber_stack_pool.hpp"
 #include "base/log.hpp"
 #include "base/raise.hpp"
+#include "event/event_loop.hpp"
 
-#include <setjmp.h>
 #include <cxxabi.h>
+#include <exception>
+#include <poll.h>
+#include <string.h>
 #include <stdio.h>
 
-#if defined(__arm__)
-// Since Xcode compiles everything in Thumb mode by default (and we want that),
-// but the stack pointer is not accessible in Thumb mode, we need a separate
-// symbol, compiled in regular ARM mode, to do the jump to the fiber stack.
-extern "C" void grace_launch_fiber(void* self, void* stack_top, void* launchpad);
+#if defined(__x86_64__)
+// Switches stacks: pushes the callee-saved registers, stores the stack pointer in *save_sp, loads
+// load_sp and pops the registers saved there. Only what the ABI says a call preserves is saved,
+// so a switch is a couple of dozen instructions.
+extern "C" void grace_switch_fiber_context(void** save_sp, void* load_sp);
+// First "return address" on a new fiber stack. Calls r13(r12) and never returns.
+extern "C" void grace_fiber_trampoline();
+
+#if defined(__APPLE__)
+#define GRACE_ASM_SYMBOL(name) "_" #name
+#else
+#define GRACE_ASM_SYMBOL(name) #name
+#endif
+
+__asm__(
+	".text\n"
+	".globl " GRACE_ASM_SYMBOL(grace_switch_fiber_context) "\n"
+	".p2align 4\n"
+	GRACE_ASM_SYMBOL(grace_switch_fiber_context) ":\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".globl " GRACE_ASM_SYMBOL(grace_fiber_trampoline) "\n"
+	".p2align 4\n"
+	GRACE_ASM_SYMBOL(grace_fiber_trampoline) ":\n"
+	"	.cfi_startproc\n"
+	"	.cfi_undefined rip\n" // the bottom of the fiber stack, as far as unwinders are concerned
+	"	movq %r12, %rdi\n"
+	"	callq *%r13\n"
+	"	ud2\n"
+	"	.cfi_endproc\n"
+);
+#else
+#include <ucontext.h>
 #endif
 
 namespace grace {
-	IFiberManager* IFiberManager::current_manager_ = nullptr; // TODO: Thread-local
-	
-	FiberManager::FiberManager() : current_(nullptr) {}
+	THREAD_LOCAL IFiberManager* IFiberManager::current_manager_ = nullptr;
 	
-	void FiberManager::update(GameTime current_time_sync) {
-		set_current_manager(this);
-		now_ = current_time_sync;
-		
-		// Don't use iterators, because fibers may spawn new fibers,
-		// which would invalidate the iterators.
-		for (size_t i = 0; i < fibers_.size();) {
-			if (fibers_[i].wake_up_at <= now_) {
-				current_ = fibers_[i].fiber.get();
-				fibers_[i].fiber->resume();
-				current_ = nullptr;
-				if (fibers_[i].fiber->state() == FiberState::Unstarted) {
-					// Fiber has terminated, remove it.
-					fibers_.erase(i);
-				} else {
-					++i;
-				}
-			} else {
-				++i;
-			}
-		}
+	NEVER_INLINE IFiberManager* IFiberManager::current() {
+		return current_manager_;
 	}
 	
-	void FiberManager::set_alarm_clock(Fiber *fiber, GameTime at) {
-		ASSERT(fiber->owner() == this);
-		for (auto& info: fibers_) {
-			if (info.fiber.get() == fiber) {
-				info.wake_up_at = at;
-				return;
-			}
-		}
-		ASSERT(false); // Fiber had this manager as owner, but wasn't in the list of fibers.
-	}
-	
-	void FiberManager::launch(Function<void ()> function) {
-		defer(std::move(function), now_);
-	}
-	
-	void FiberManager::defer(Function<void ()> function, GameTime until) {
-		auto f = make_unique<Fiber>(default_allocator(), *this, std::move(function), until);
-		FiberInfo info;
-		info.fiber = move(f);
-		info.wake_up_at = until;
-		fibers_.emplace_back(std::move(info));
+	NEVER_INLINE void IFiberManager::set_current_manager(IFiberManager* manager) {
+		current_manager_ = manager;
 	}
 	
-	FiberManager::~FiberManager() {
-		set_current_manager(this);
-		fibers_.clear(); // calls terminate on each fiber.
-		set_current_manager(nullptr);
+	namespace {
+		struct FiberError : ErrorBase<FiberError> {};
+		struct FiberTerminated {};
+		
+#if defined(__x86_64__)
+		struct FiberContext {
+			void* sp = nullptr;
+		};
+		
+		void make_context(FiberContext& context, byte* stack, size_t stack_size, void(*entry)(Fiber*), Fiber* fiber) {
+			// Lay out the frame that grace_switch_fiber_context pops, returning into the trampoline with
+			// a 16-byte aligned stack, so that the call it makes sees the alignment the ABI expects.
+			uintptr_t top = ((uintptr_t)(stack + stack_size)) & ~(uintptr_t)15;
+			void** frame = (void**)top;
+			*--frame = (void*)grace_fiber_trampoline;
+			*--frame = nullptr;      // rbp
+			*--frame = nullptr;      // rbx
+			*--frame = (void*)fiber; // r12
+			*--frame = (void*)entry; // r13
+			*--frame = nullptr;      // r14
+			*--frame = nullptr;      // r15
+			--frame;
+			uint32 control[2] = {0x1f80, 0x037f}; // default MXCSR and x87 control word
+			memcpy(frame, control, sizeof(control));
+			context.sp = frame;
+		}
+		
+		inline void switch_context(FiberContext& from, FiberContext& to) {
+			grace_switch_fiber_context(&from.sp, to.sp);
+		}
+#else
+		struct FiberContext {
+			ucontext_t context;
+		};
+		
+		void ucontext_entry(uint32 entry_hi, uint32 entry_lo, uint32 fiber_hi, uint32 fiber_lo) {
+			auto entry = (void(*)(Fiber*))(((uintptr_t)entry_hi << 16 << 16) | entry_lo);
+			auto fiber = (Fiber*)(((uintptr_t)fiber_hi << 16 << 16) | fiber_lo);
+			entry(fiber);
+		}
+		
+		void make_context(FiberContext& context, byte* stack, size_t stack_size, void(*entry)(Fiber*), Fiber* fiber) {
+			getcontext(&context.context);
+			context.context.uc_stack.ss_sp = stack;
+			context.context.uc_stack.ss_size = stack_size;
+			context.context.uc_link = nullptr;
+			// makecontext only passes ints.
+			uint64 e = (uintptr_t)entry;
+			uint64 f = (uintptr_t)fiber;
+			makecontext(&context.context, (void(*)())ucontext_entry, 4, (uint32)(e >> 32), (uint32)e, (uint32)(f >> 32), (uint32)f);
+		}
+		
+		inline void switch_context(FiberContext& from, FiberContext& to) {
+			swapcontext(&from.context, &to.context);
+		}
+#endif
 	}
 	
 	struct Fiber::Impl {
 		IFiberManager& owner;
 		Function<void()> function;
 		FiberState state;
-		Array<byte> saved_stack;
-		byte* stack_top;
-		jmp_buf portal;
+		FiberStack stack; // held only while the fiber is started
+		size_t stack_high_water_mark = 0; // as of the last time the stack was given back
+		FiberContext fiber_context; // where the fiber continues
+		FiberContext host_context;  // where resume() continues
+		std::exception_ptr unhandled_exception;
+		
+		Impl(IFiberManager& manager, Function<void()> function) : owner(manager), function(std::move(function)) {}
 		
-		Impl(IFiberManager& manager, Function<void()> function) : owner(manager), function(std::move(function)), stack_top(nullptr) {}
+		void release_stack() {
+			if (stack.bottom == nullptr) return;
+			stack_high_water_mark = FiberStackPool::default_pool().release(stack);
+			stack = FiberStack();
+		}
 	};
 	
 	Fiber::Fiber(IFiberManager& manager, Function<void()> function, GameTime start_at) {
@@ -96,6 +167,7 @@ namespace grace {
 	
 	Fiber::~Fiber() {
 		this->terminate(nullptr);
+		impl().release_stack();
 		delete impl_;
 	}
 	
@@ -119,33 +191,32 @@ namespace grace {
 		return impl().state;
 	}
 	
-	namespace {
-		struct FiberError : ErrorBase<FiberError> {};
-		struct FiberTerminated {};
-		
-		__attribute__((noinline)) byte* get_sp() {
-			void* sp;
-			sp = (void*)&sp;
-			return (byte*)sp;
+	size_t Fiber::stack_high_water_mark() const {
+		if (impl().stack.bottom) {
+			return FiberStackPool::high_water_mark(impl().stack);
 		}
-		
-		__attribute__((noinline)) void fiber_launchpad(Fiber* fiber) {
+		return impl().stack_high_water_mark;
+	}
+	
+	namespace {
+		void fiber_launchpad(Fiber* fiber) {
+			Fiber::Impl& impl = fiber->impl();
 			try {
-				fiber->impl().function();
+				impl.function();
+				impl.state = FiberState::Unstarted;
+			}
+			catch (FiberTerminated) {
+				impl.state = FiberState::Unstarted;
 			}
-			catch (FiberTerminated) {}
 			catch (...) {
-				// TODO: Use std::current_exception() interface.
 				const std::type_info* ex_type = __cxxabiv1::__cxa_current_exception_type();
-				const char* ex_name = ex_type->name();
-				Debug() << "Unhandled exception in fiber: " << ex_name;
-				fiber->impl().saved_stack.clear();
-				fiber->impl().state = FiberState::UnhandledException;
-				longjmp(fiber->impl().portal, 1);
+				Debug() << "Unhandled exception in fiber: " << ex_type->name();
+				impl.unhandled_exception = std::current_exception();
+				impl.state = FiberState::UnhandledException;
 			}
-			fiber->impl().saved_stack.clear();
-			fiber->impl().state = FiberState::Unstarted;
-			longjmp(fiber->impl().portal, 1);
+			// The stack is unwound, so this frame is never resumed. A later start begins a fresh one.
+			switch_context(impl.fiber_context, impl.host_context);
+			ASSERT(false); // unreachable
 		}
 	}
 	
@@ -175,29 +246,14 @@ namespace grace {
 		if (state() != FiberState::Running) {
 			raise<FiberError>();
 		}
-		jmp_buf away_from_fiber;
-		memcpy(away_from_fiber, impl().portal, sizeof(away_from_fiber));
-		if (setjmp(impl().portal) == 0) {
-			// first, save the stack:
-			byte* stack_bottom = get_sp();
-			size_t stack_size = impl().stack_top - stack_bottom;
-			impl().saved_stack.resize(stack_size);
-			std::copy(stack_bottom, impl().stack_top, impl().saved_stack.begin());
-			
-			// change state
-			impl().state = FiberState::Sleeping;
-			
-			// jump away!
-			longjmp(away_from_fiber, 1);
-		} else {
-			// resuming
-			if (state() == FiberState::Terminating) {
-				this->terminate(nullptr); // which throws and thus unwinds the stack
-			}
-			if (state() != FiberState::Running) {
-				raise<FiberError>(); // Wrong state!
-			}
-			return;
+		impl().state = FiberState::Sleeping;
+		switch_context(impl().fiber_context, impl().host_context);
+		// resumed
+		if (state() == FiberState::Terminating) {
+			this->terminate(nullptr); // which throws and thus unwinds the stack
+		}
+		if (state() != FiberState::Running) {
+			raise<FiberError>(); // Wrong state!
 		}
 	}
 
@@ -206,95 +262,39 @@ namespace grace {
 			raise<FiberError>();
 		}
 		
-		uintptr_t sp = (uintptr_t)get_sp();
-		uintptr_t fiber_stack_top_int = sp & (~0xfffULL); // align on page boundary
-		byte* fiber_stack_top = (byte*)fiber_stack_top_int;
-		
 		switch (state()) {
 			case FiberState::Unstarted: {
 				if (new_state == FiberState::Terminating)
 					return;
-				if (setjmp(impl().portal) == 0) {
-					// launch!
-					impl().state = FiberState::Running;
-					impl().stack_top = fiber_stack_top;
-#if defined(__x86_64__)
-					__asm__ __volatile__
-					(
-					 "movq %%rsp, %%rbx\n"
-					 "movq %0, %%rsp\n"
-					 "movq %1, %%rdi\n"
-					 "callq *%2\n"
-					 "movq %%rbx, %%rsp\n"
-					 : // output registers
-					 : "r"(fiber_stack_top), "r"(this), "r"(fiber_launchpad) // input registers
-					 : "rsp", "rbx" // clobbered
-					 );
-#elif defined(__i386__)
-					__asm__ __volatile__
-					(
-					 "movl %%esp, %%ebx\n"
-					 "movl %0, %%esp\n"
-					 "movl %1, %%edi\n"
-					 "call *%2\n"
-					 "movl %%ebx, %%esp\n"
-					 : // output registers
-					 : "r"(fiber_stack_top), "r"(this), "r"(fiber_launchpad) // input registers
-					 : "esp", "ebx" // clobbered
-					);
-#elif defined(__arm__)
-					grace_launch_fiber(this, fiber_stack_top, (void*)fiber_launchpad);
-#else
-#error Fibers are not supported on this platform.
-#endif
-				} else {
-					// coming back!
-					if (impl().state == FiberState::UnhandledException) {
-						// If the fiber threw an unhandled exception, rethrow it:
-						// TODO: Use C++11 exception encapsulation features.
-						__cxxabiv1::__cxa_rethrow();
-					}
-					if (impl().state != FiberState::Sleeping && impl().state != FiberState::Unstarted) {
-						raise<FiberError>();
-					}
-					return;
-				}
-			}
-			case FiberState::Sleeping: {
-				jmp_buf into_fiber;
-				memcpy(into_fiber, impl().portal, sizeof(into_fiber));
-				if (setjmp(impl().portal) == 0) {
-					impl().state = new_state;
-					
-					// Restore stack
-					if (fiber_stack_top != impl().stack_top) {
-						Warning() << "Resuming fiber from different callsite!";
-						impl().stack_top = fiber_stack_top;
-					}
-					size_t bytes_to_restore = impl().saved_stack.size();
-					byte* copy_to = fiber_stack_top - bytes_to_restore;
-					std::copy(impl().saved_stack.begin(), impl().saved_stack.end(), copy_to);
-					
-					// jump back in!
-					longjmp(into_fiber, 1);
-				} else {
-					// coming back!
-					if (impl().state == FiberState::UnhandledException) {
-						// If the fiber threw an exception, rethrow it:
-						// TODO: Use C++11 exception encapsulation features.
-						__cxxabiv1::__cxa_rethrow();
-					}
-					if (impl().state != FiberState::Sleeping && impl().state != FiberState::Unstarted) {
-						raise<FiberError>();
-					}
-					return;
+				if (impl().stack.bottom == nullptr) {
+					impl().stack = FiberStackPool::default_pool().acquire();
 				}
+				make_context(impl().fiber_context, impl().stack.bottom, impl().stack.size, fiber_launchpad, this);
+				break;
 			}
+			case FiberState::Sleeping:
+				break;
 			default: {
 				Error() << "Cannot resume running or terminating fiber!";
 				raise<FiberError>();
 			}
 		}
+		
+		impl().state = new_state;
+		switch_context(impl().host_context, impl().fiber_context);
+		// coming back!
+		if (impl().state == FiberState::Unstarted || impl().state == FiberState::UnhandledException) {
+			// Finished, so let another fiber have the stack while this one waits to be started again.
+			impl().release_stack();
+		}
+		if (impl().state == FiberState::UnhandledException) {
+			std::exception_ptr ex = impl().unhandled_exception;
+			impl().unhandled_exception = nullptr;
+			std::rethrow_exception(ex);
+		}
+		if (impl().state != FiberState::Sleeping && impl().state != FiberState::Unstarted) {
+			raise<FiberError>();
+		}
 	}
 	
 	void Fiber::sleep(GameTimeDelta delta) {
@@ -314,4 +314,166 @@ namespace grace {
 		impl().owner.set_alarm_clock(this, until);
 		yield(nullptr);
 	}
+	
+	bool Fiber::await_readable(FileDescriptor fd, SystemTimeDelta timeout) {
+		return current()->await(fd, DescriptorEvent::Readable, timeout, nullptr);
+	}
+	
+	bool Fiber::await_writable(FileDescriptor fd, SystemTimeDelta timeout) {
+		return current()->await(fd, DescriptorEvent::Writable, timeout, nullptr);
+	}
+	
+	namespace {
+		bool descriptor_is_ready(FileDescriptor fd, DescriptorEvent event) {
+			struct pollfd p;
+			p.fd = fd;
+			p.events = event == DescriptorEvent::Readable ? POLLIN : POLLOUT;
+			p.revents = 0;
+			return ::poll(&p, 1, 0) > 0; // errors and hangups count too, so that the caller finds out
+		}
+	}
+	
+	bool Fiber::await(FileDescriptor fd, DescriptorEvent event, SystemTimeDelta timeout, void* dummy) {
+		IFiberManager& owner = impl().owner;
+		IEventLoop* loop = owner.event_loop();
+		if (loop == nullptr) {
+			SystemTime start = system_now();
+			while (!descriptor_is_ready(fd, event)) {
+				if (timeout != SystemTimeDelta::forever() && system_now() - start >= timeout) {
+					return false;
+				}
+				yield(nullptr);
+			}
+			return true;
+		}
+		
+		// Sleep until the loop sets the alarm clock to now. If the fiber is terminated meanwhile, the
+		// handle goes away with the stack and cancels the wait.
+		bool woken = false;
+		DescriptorEvent result = DescriptorEvent::Timeout;
+		auto handle = loop->when_ready(fd, event, [&](DescriptorEvent e) {
+			result = e;
+			woken = true;
+			owner.set_alarm_clock(this, owner.now());
+		}, timeout);
+		while (!woken) {
+			sleep_until(GameTime::forever(), nullptr);
+		}
+		return result != DescriptorEvent::Timeout;
+	}
+	
+	FiberManager::FiberManager() : current_(nullptr) {}
+	
+	void FiberManager::update(GameTime current_time_sync) {
+		set_current_manager(this);
+		now_ = current_time_sync;
+		
+		// ready_ holds the fibers that yielded in the last update, followed by the alarms that have gone off,
+		// earliest first. Fibers launched from here are appended and run in this update too, while fibers
+		// that yield wait in next_ready_, so that each fiber is resumed at most once per update.
+		while (alarms_.size() && alarms_.top().at <= now_) {
+			Fiber* fiber = alarms_.pop().fiber;
+			fiber->owner_alarm = AlarmQueue::Handle().slot;
+			ready_.push_back(fiber);
+		}
+		
+		// Don't use iterators, because fibers may spawn new fibers,
+		// which would invalidate the iterators.
+		for (size_t i = 0; i < ready_.size(); ++i) {
+			Fiber* fiber = ready_[i];
+			if (fiber == nullptr) continue; // set an alarm while it was waiting
+			current_ = fiber;
+			try {
+				fiber->resume();
+			}
+			catch (...) {
+				// The fiber is gone, and the rest wait for the next update.
+				current_ = nullptr;
+				remove_fiber(fiber);
+				finish_update(i + 1);
+				throw;
+			}
+			current_ = nullptr;
+			if (fiber->state() == FiberState::Unstarted) {
+				// Fiber has terminated, remove it.
+				remove_fiber(fiber);
+			} else if (!alarm_of(fiber).is_valid()) {
+				next_ready_.push_back(fiber);
+			}
+		}
+		finish_update(ready_.size());
+	}
+	
+	void FiberManager::finish_update(size_t first_not_run) {
+		for (size_t i = first_not_run; i < ready_.size(); ++i) {
+			if (ready_[i] != nullptr) next_ready_.push_back(ready_[i]);
+		}
+		ready_.clear(false);
+		std::swap(ready_, next_ready_);
+	}
+	
+	void FiberManager::set_alarm_clock(Fiber *fiber, GameTime at) {
+		ASSERT(fiber->owner() == this);
+		Alarm alarm = {at, next_alarm_sequence_++, fiber};
+		AlarmQueue::Handle handle = alarm_of(fiber);
+		if (handle.is_valid()) {
+			alarms_.update(handle, alarm);
+			return;
+		}
+		if (fiber != current_) {
+			// The fiber is waiting to be resumed in a ready queue, so take it out of there. Fiber::sleep
+			// only ever sets the alarm of the current fiber, so this doesn't happen on the common path.
+			for (Fiber*& f: ready_) if (f == fiber) f = nullptr;
+			for (Fiber*& f: next_ready_) if (f == fiber) f = nullptr;
+		}
+		fiber->owner_alarm = alarms_.insert(alarm).slot;
+	}
+	
+	void FiberManager::launch(Function<void ()> function) {
+		defer(std::move(function), now_);
+	}
+	
+	void FiberManager::defer(Function<void ()> function, GameTime until) {
+		auto f = make_unique<Fiber>(default_allocator(), *this, std::move(function), until);
+		Fiber* fiber = f.get();
+		ASSERT(fibers_.size() < UINT32_MAX);
+		fiber->owner_index = (uint32)fibers_.size();
+		fibers_.push_back(std::move(f));
+		if (until <= now_) {
+			ready_.push_back(fiber);
+		} else {
+			Alarm alarm = {until, next_alarm_sequence_++, fiber};
+			fiber->owner_alarm = alarms_.insert(alarm).slot;
+		}
+	}
+	
+	FiberManager::AlarmQueue::Handle FiberManager::alarm_of(Fiber* fiber) const {
+		AlarmQueue::Handle handle;
+		handle.slot = fiber->owner_alarm;
+		return handle;
+	}
+	
+	void FiberManager::remove_fiber(Fiber* fiber) {
+		AlarmQueue::Handle handle = alarm_of(fiber);
+		if (handle.is_valid()) {
+			alarms_.erase(handle);
+		}
+		// Fill the gap with the last fiber instead of shifting the rest down.
+		uint32 idx = fiber->owner_index;
+		ASSERT(fibers_[idx].get() == fiber);
+		if (idx != fibers_.size() - 1) {
+			fibers_[idx].swap(fibers_.back());
+			fibers_[idx]->owner_index = idx;
+		}
+		fibers_.pop_back();
+	}
+	
+	FiberManager::~FiberManager() {
+		set_current_manager(this);
+		ready_.clear();
+		next_ready_.clear();
+		alarms_.clear();
+		fibers_.clear(); // calls terminate on each fiber.
+		set_current_manager(nullptr);
+	}
 }
@@ -11,8 +11,10 @@
 
 #include "base/function.hpp"
 #include "base/array.hpp"
+#include "base/indexed_priority_queue.hpp"
 #include "base/time.hpp"
 #include "memory/unique_ptr.hpp"
+#include "io/fd.hpp"
 
 namespace grace {
 	enum FiberState : byte {
@@ -24,25 +26,47 @@ namespace grace {
 	};
 	
 	class IFiberManager;
+	struct IEventLoop;
+	enum class DescriptorEvent;
 	
+	/*
+		A Fiber runs a function on a stack of its own, and can yield back to whoever resumed it. Yielding
+		and resuming swap a handful of registers and the stack pointer, so the cost is the same no matter
+		how deep the fiber's stack is.
+		
+		Stacks come from FiberStackPool::default_pool() when a fiber starts and go back to it when it
+		finishes, so short-lived fibers reuse warm mappings instead of mapping fresh ones.
+	*/
 	class Fiber {
 	public:
+		static const size_t STACK_SIZE = 0x40000; // 256 KiB, committed as it's touched
+		
 		static Fiber* current();
 		static void yield();
 		static void sleep(GameTimeDelta delta);
 		static void sleep_until(GameTime time);
 		static void terminate();
 		
+		// Parks the current fiber until fd can be read or written without blocking, and returns false if
+		// the timeout runs out first. The owner's event loop wakes the fiber up, or without one, the fiber
+		// polls the descriptor each time it is resumed.
+		static bool await_readable(FileDescriptor fd, SystemTimeDelta timeout = SystemTimeDelta::forever());
+		static bool await_writable(FileDescriptor fd, SystemTimeDelta timeout = SystemTimeDelta::forever());
+		
 		~Fiber();
 		
 		IFiberManager* owner() const;
 		FiberState state() const;
+		size_t stack_high_water_mark() const; // deepest stack use in bytes, of this or the last run
 		void start();
 		void resume();
 		void terminate(void* dummy);
 		
 		struct Impl;
 		Impl* impl_;
+		// For the owner's bookkeeping: where it keeps the fiber, and the handle of its alarm, if any.
+		uint32 owner_index = UINT32_MAX;
+		uint32 owner_alarm = UINT32_MAX;
 		Impl& impl() { return *impl_; }
 		const Impl& impl() const { return *impl_; }
 		explicit Fiber(IFiberManager& m, Function<void()> f, GameTime start_at);
@@ -51,6 +75,7 @@ namespace grace {
 		void resume_into_state(FiberState new_state);
 		void sleep_until(GameTime time, void* dummy);
 		void sleep(GameTimeDelta, void* dummy);
+		bool await(FileDescriptor fd, DescriptorEvent event, SystemTimeDelta timeout, void* dummy);
 	};
 	
 	class IFiberManager {
@@ -61,14 +86,39 @@ namespace grace {
 		virtual void launch(Function<void()> f) = 0;
 		virtual void defer(Function<void()> f, GameTime until) = 0;
 		virtual Fiber* current_fiber() const = 0;
+		virtual IEventLoop* event_loop() const { return nullptr; } // for Fiber::await_readable/await_writable
 		
-		static IFiberManager* current() { return current_manager_; }
+		// The current manager is per thread. Fibers may move between threads while they sleep, so these are
+		// out of line to keep a thread's value from being cached across a yield.
+		static IFiberManager* current();
 		// Call this in update():
-		static void set_current_manager(IFiberManager* manager) { current_manager_ = manager; }
+		static void set_current_manager(IFiberManager* manager);
 	private:
-		static IFiberManager* current_manager_;
+		static THREAD_LOCAL IFiberManager* current_manager_;
 	};
 	
+	namespace detail {
+		struct FiberAlarm {
+			GameTime at;
+			uint64 sequence; // breaks ties in the order the alarms were set
+			Fiber* fiber;
+		};
+		
+		struct FiberAlarmIsLater {
+			bool operator()(const FiberAlarm& a, const FiberAlarm& b) const {
+				return a.at > b.at || (a.at == b.at && a.sequence > b.sequence);
+			}
+		};
+		
+		using FiberAlarmQueue = IndexedPriorityQueue<FiberAlarm, FiberAlarmIsLater>;
+	}
+	
+	/*
+		FiberManager runs its fibers on the thread that calls update(). Sleeping fibers wait in a heap ordered
+		by wake-up time, and fibers that just yield wait in a ready queue, so an update only touches the
+		fibers it resumes, no matter how many are asleep. Fibers due at the same time resume in the order
+		they went to sleep.
+	*/
 	class FiberManager : public IFiberManager {
 	public:
 		FiberManager();
@@ -79,14 +129,26 @@ namespace grace {
 		void launch(Function<void()> f) override;
 		void defer(Function<void()> f, GameTime until) override;
 		Fiber* current_fiber() const override { return current_; }
+		IEventLoop* event_loop() const override { return event_loop_; }
+		// Fibers waiting for descriptors are woken from this loop's callbacks, so it should run on the
+		// thread that calls update().
+		void set_event_loop(IEventLoop* loop) { event_loop_ = loop; }
 	private:
+		using Alarm = detail::FiberAlarm;
+		using AlarmQueue = detail::FiberAlarmQueue;
+		
 		Fiber* current_;
 		GameTime now_;
-		struct FiberInfo {
-			UniquePtr<Fiber> fiber;
-			GameTime wake_up_at;
-		};
-		Array<FiberInfo> fibers_;
+		IEventLoop* event_loop_ = nullptr;
+		Array<UniquePtr<Fiber>> fibers_; // unordered; each fiber knows its index
+		AlarmQueue alarms_;
+		Array<Fiber*> ready_;      // resumed in the next update
+		Array<Fiber*> next_ready_; // yielded during this update
+		uint64 next_alarm_sequence_ = 0;
+		
+		AlarmQueue::Handle alarm_of(Fiber* fiber) const;
+		void remove_fiber(Fiber* fiber);
+		void finish_update(size_t first_not_run);
 	};
 }
 
@@ -0,0 +1,359 @@
+//
+//  fiber_scheduler.cpp
+//  grace
+//
+
+#include "base/fiber_scheduler.hpp"
+#include "base/concurrent_queue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace grace {
+	struct FiberScheduler::Worker {
+		FiberScheduler::Impl& owner;
+		size_t index;
+		WorkStealingDeque<Fiber*> runnable;
+		Fiber* current = nullptr;
+		size_t last_victim;
+		
+		Worker(FiberScheduler::Impl& owner, size_t index) : owner(owner), index(index), last_victim(index) {}
+	};
+	
+	namespace {
+		// The worker the calling thread is acting as, if any.
+		THREAD_LOCAL FiberScheduler::Worker* t_worker = nullptr;
+		
+		struct ParallelTask {
+			Function<void(size_t)> function;
+			std::atomic<size_t> refs;
+			
+			explicit ParallelTask(Function<void(size_t)> function) : function(std::move(function)) {
+				std::atomic_init<size_t>(&refs, 0);
+			}
+		};
+		
+		// Shared by the fibers of a parallel_launch. The task goes away with the last of them, whether they
+		// ran or were terminated first.
+		struct ParallelTaskRef {
+			ParallelTask* task;
+			explicit ParallelTaskRef(ParallelTask* task) : task(task) { task->refs.fetch_add(1, std::memory_order_relaxed); }
+			ParallelTaskRef(const ParallelTaskRef& other) : ParallelTaskRef(other.task) {}
+			ParallelTaskRef& operator=(const ParallelTaskRef&) = delete;
+			~ParallelTaskRef() {
+				if (task->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					destroy(task, default_allocator());
+				}
+			}
+		};
+	}
+	
+	struct FiberScheduler::Impl {
+		FiberScheduler& scheduler;
+		Array<UniquePtr<Worker>> workers; // workers[0] is whoever calls update()
+		Array<std::thread> threads;
+		std::atomic<size_t> pending; // fibers queued in this round and not yet done with
+		std::atomic<uint64> work_epoch; // bumped whenever there may be new work, or the round is over
+		std::atomic<size_t> num_parked;
+		
+		std::mutex mutex; // guards the rest
+		std::condition_variable round_started;
+		std::condition_variable work_available;
+		uint64 round = 0;
+		bool shutting_down = false;
+		Array<UniquePtr<Fiber>> fibers; // unordered; each fiber knows its index
+		detail::FiberAlarmQueue alarms;
+		Array<Fiber*> next_ready; // launched outside of a round, or yielded during one
+		uint64 next_alarm_sequence = 0;
+		std::exception_ptr unhandled_exception;
+		
+		Impl(FiberScheduler& scheduler, size_t num_workers);
+		void worker_main(Worker& worker);
+		void run_round(Worker& worker);
+		bool steal(Worker& thief, Fiber*& out_fiber);
+		bool park(Worker& worker, Fiber*& out_fiber);
+		void notify_work();
+		void run(Worker& worker, Fiber* fiber);
+		Fiber* add_fiber(Function<void()> function, GameTime start_at);
+		void remove_fiber(Fiber* fiber);
+		void enqueue(Fiber* fiber);
+	};
+	
+	FiberScheduler::Impl::Impl(FiberScheduler& scheduler, size_t num_workers) : scheduler(scheduler) {
+		std::atomic_init<size_t>(&pending, 0);
+		std::atomic_init<uint64>(&work_epoch, 0);
+		std::atomic_init<size_t>(&num_parked, 0);
+		for (size_t i = 0; i < num_workers; ++i) {
+			workers.push_back(make_unique<Worker>(default_allocator(), *this, i));
+		}
+		for (size_t i = 1; i < num_workers; ++i) {
+			Worker* worker = workers[i].get();
+			threads.push_back(std::thread([this, worker]() { worker_main(*worker); }));
+		}
+	}
+	
+	void FiberScheduler::Impl::worker_main(Worker& worker) {
+		t_worker = &worker;
+		IFiberManager::set_current_manager(&scheduler);
+		uint64 last_round = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				round_started.wait(lock, [&]() { return shutting_down || round != last_round; });
+				if (shutting_down) break;
+				last_round = round;
+			}
+			run_round(worker);
+		}
+		IFiberManager::set_current_manager(nullptr);
+		t_worker = nullptr;
+	}
+	
+	void FiberScheduler::Impl::run_round(Worker& worker) {
+		// A fiber counts as pending from before it is queued until after it has been dealt with, and
+		// fibers are only launched into a round by other pending fibers, so zero means the round is over.
+		// An idle worker keeps looking for a while, since the fibers still running are likely to launch
+		// more, and then parks until someone does.
+		static const size_t MAX_IDLE_SPINS = 64;
+		size_t idle_spins = 0;
+		while (pending.load(std::memory_order_acquire) != 0) {
+			Fiber* fiber;
+			if (worker.runnable.pop(fiber) || steal(worker, fiber)) {
+				idle_spins = 0;
+				run(worker, fiber);
+			} else if (idle_spins < MAX_IDLE_SPINS) {
+				++idle_spins;
+				std::this_thread::yield();
+			} else if (park(worker, fiber)) {
+				idle_spins = 0;
+				run(worker, fiber);
+			}
+		}
+	}
+	
+	bool FiberScheduler::Impl::park(Worker& worker, Fiber*& out_fiber) {
+		// Count ourselves as parked before the last look for work. Whoever makes work available after that
+		// look either changes the epoch before we wait on it, or sees us and wakes us up.
+		num_parked.fetch_add(1);
+		uint64 seen = work_epoch.load();
+		bool found = steal(worker, out_fiber);
+		if (!found) {
+			std::unique_lock<std::mutex> lock(mutex);
+			work_available.wait(lock, [&]() { return work_epoch.load() != seen || pending.load() == 0; });
+		}
+		num_parked.fetch_sub(1);
+		return found;
+	}
+	
+	void FiberScheduler::Impl::notify_work() {
+		work_epoch.fetch_add(1);
+		if (num_parked.load() != 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			work_available.notify_all();
+		}
+	}
+	
+	bool FiberScheduler::Impl::steal(Worker& thief, Fiber*& out_fiber) {
+		// Start with the worker we last stole from, which likely still has more.
+		size_t n = workers.size();
+		for (size_t i = 0; i < n; ++i) {
+			size_t victim = (thief.last_victim + i) % n;
+			if (victim == thief.index) continue;
+			if (workers[victim]->runnable.steal(out_fiber)) {
+				thief.last_victim = victim;
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	void FiberScheduler::Impl::run(Worker& worker, Fiber* fiber) {
+		worker.current = fiber;
+		bool failed = false;
+		try {
+			fiber->resume();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!unhandled_exception) {
+				unhandled_exception = std::current_exception();
+			}
+			failed = true;
+		}
+		worker.current = nullptr;
+		if (failed || fiber->state() == FiberState::Unstarted) {
+			remove_fiber(fiber);
+		} else if (fiber->owner_alarm == UINT32_MAX) {
+			std::lock_guard<std::mutex> lock(mutex);
+			next_ready.push_back(fiber);
+		}
+		if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			notify_work(); // the round is over
+		}
+	}
+	
+	Fiber* FiberScheduler::Impl::add_fiber(Function<void()> function, GameTime start_at) {
+		auto f = make_unique<Fiber>(default_allocator(), scheduler, std::move(function), start_at);
+		Fiber* fiber = f.get();
+		std::lock_guard<std::mutex> lock(mutex);
+		ASSERT(fibers.size() < UINT32_MAX);
+		fiber->owner_index = (uint32)fibers.size();
+		fibers.push_back(std::move(f));
+		return fiber;
+	}
+	
+	void FiberScheduler::Impl::remove_fiber(Fiber* fiber) {
+		UniquePtr<Fiber> removed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (fiber->owner_alarm != UINT32_MAX) {
+				detail::FiberAlarmQueue::Handle handle;
+				handle.slot = fiber->owner_alarm;
+				alarms.erase(handle);
+			}
+			// Fill the gap with the last fiber instead of shifting the rest down.
+			uint32 idx = fiber->owner_index;
+			ASSERT(fibers[idx].get() == fiber);
+			if (idx != fibers.size() - 1) {
+				fibers[idx].swap(fibers.back());
+				fibers[idx]->owner_index = idx;
+			}
+			removed = fibers.pop_back();
+		}
+		// Destroyed outside the lock, since the fiber's function may launch fibers from its destructors.
+	}
+	
+	void FiberScheduler::Impl::enqueue(Fiber* fiber) {
+		if (t_worker && &t_worker->owner == this) {
+			// Launched by a fiber in this round, whose own pending count keeps the round going until this
+			// one is counted too.
+			pending.fetch_add(1, std::memory_order_relaxed);
+			t_worker->runnable.push(fiber);
+			notify_work();
+		} else {
+			std::lock_guard<std::mutex> lock(mutex);
+			next_ready.push_back(fiber);
+		}
+	}
+	
+	FiberScheduler::FiberScheduler(size_t num_workers) {
+		if (num_workers == 0) {
+			num_workers = std::thread::hardware_concurrency();
+			if (num_workers == 0) num_workers = 1;
+		}
+		impl_ = new Impl(*this, num_workers);
+	}
+	
+	FiberScheduler::~FiberScheduler() {
+		{
+			std::lock_guard<std::mutex> lock(impl_->mutex);
+			impl_->shutting_down = true;
+		}
+		impl_->round_started.notify_all();
+		for (auto& thread: impl_->threads) {
+			thread.join();
+		}
+		
+		// Unwind the fibers that are still asleep on this thread.
+		set_current_manager(this);
+		impl_->alarms.clear();
+		impl_->next_ready.clear();
+		Array<UniquePtr<Fiber>> fibers = std::move(impl_->fibers);
+		fibers.clear(); // calls terminate on each fiber.
+		set_current_manager(nullptr);
+		delete impl_;
+	}
+	
+	void FiberScheduler::update(GameTime current_time_sync) {
+		Impl& impl = *impl_;
+		Worker& worker = *impl.workers[0];
+		set_current_manager(this);
+		
+		// The fibers that yielded in the last update go first, then the alarms that have gone off.
+		size_t num_runnable = 0;
+		{
+			std::lock_guard<std::mutex> lock(impl.mutex);
+			now_ = current_time_sync;
+			Array<Fiber*> ready = std::move(impl.next_ready);
+			while (impl.alarms.size() && impl.alarms.top().at <= now_) {
+				Fiber* fiber = impl.alarms.pop().fiber;
+				fiber->owner_alarm = UINT32_MAX;
+				ready.push_back(fiber);
+			}
+			// Pushed in reverse, because the deque runs its own work last in, first out.
+			num_runnable = ready.size();
+			impl.pending.store(num_runnable, std::memory_order_release);
+			for (size_t i = ready.size(); i > 0; --i) {
+				worker.runnable.push(ready[i-1]);
+			}
+			if (num_runnable) ++impl.round;
+		}
+		if (num_runnable == 0) return;
+		impl.round_started.notify_all();
+		
+		FiberScheduler::Worker* previous_worker = t_worker;
+		t_worker = &worker;
+		impl.run_round(worker);
+		t_worker = previous_worker;
+		
+		std::exception_ptr ex;
+		{
+			std::lock_guard<std::mutex> lock(impl.mutex);
+			std::swap(ex, impl.unhandled_exception);
+		}
+		if (ex) {
+			std::rethrow_exception(ex);
+		}
+	}
+	
+	void FiberScheduler::set_alarm_clock(Fiber* fiber, GameTime at) {
+		ASSERT(fiber->owner() == this);
+		ASSERT(fiber == current_fiber()); // otherwise it may be queued on some worker
+		std::lock_guard<std::mutex> lock(impl_->mutex);
+		detail::FiberAlarm alarm = {at, impl_->next_alarm_sequence++, fiber};
+		detail::FiberAlarmQueue::Handle handle;
+		handle.slot = fiber->owner_alarm;
+		if (handle.is_valid()) {
+			impl_->alarms.update(handle, alarm);
+		} else {
+			fiber->owner_alarm = impl_->alarms.insert(alarm).slot;
+		}
+	}
+	
+	void FiberScheduler::launch(Function<void()> function) {
+		Fiber* fiber = impl_->add_fiber(std::move(function), now_);
+		impl_->enqueue(fiber);
+	}
+	
+	void FiberScheduler::defer(Function<void()> function, GameTime until) {
+		if (until <= now_) {
+			launch(std::move(function));
+			return;
+		}
+		Fiber* fiber = impl_->add_fiber(std::move(function), until);
+		std::lock_guard<std::mutex> lock(impl_->mutex);
+		detail::FiberAlarm alarm = {until, impl_->next_alarm_sequence++, fiber};
+		fiber->owner_alarm = impl_->alarms.insert(alarm).slot;
+	}
+	
+	Fiber* FiberScheduler::current_fiber() const {
+		return t_worker && &t_worker->owner == impl_ ? t_worker->current : nullptr;
+	}
+	
+	void FiberScheduler::parallel_launch(size_t n, Function<void(size_t)> function) {
+		if (n == 0) return;
+		ParallelTaskRef ref(new(default_allocator()) ParallelTask(std::move(function)));
+		for (size_t i = 0; i < n; ++i) {
+			launch([ref, i]() {
+				ref.task->function(i);
+			});
+		}
+	}
+	
+	size_t FiberScheduler::num_workers() const {
+		return impl_->workers.size();
+	}
+}
@@ -0,0 +1,53 @@
+//
+//  fiber_scheduler.hpp
+//  grace
+//
+
+#ifndef grace_fiber_scheduler_hpp
+#define grace_fiber_scheduler_hpp
+
+#include "base/fiber.hpp"
+
+namespace grace {
+	/*
+		FiberScheduler runs fibers on a pool of worker threads, one per hardware thread by default. update()
+		works like FiberManager::update(): it resumes every fiber that is due, each at most once, and returns
+		when all of them have yielded or finished. The calling thread takes part as the first worker, and the
+		other workers wait between updates.
+		
+		Each worker keeps its runnable fibers in a work-stealing deque. Fibers launched from a fiber go on
+		the deque of the worker running it, and idle workers steal from the others, so a fiber may continue
+		on another thread after it yields, and must not keep thread-local state across a yield. A worker that
+		finds nothing to steal for a while sleeps until a fiber is launched or the update is over.
+		
+		A fiber can only set its own alarm clock, which is all Fiber::sleep() does. An unhandled exception in
+		a fiber is rethrown from update() once the other fibers are done.
+	*/
+	class FiberScheduler : public IFiberManager {
+	public:
+		explicit FiberScheduler(size_t num_workers = 0); // 0 means one per hardware thread
+		virtual ~FiberScheduler();
+		FiberScheduler(const FiberScheduler&) = delete;
+		FiberScheduler& operator=(const FiberScheduler&) = delete;
+		
+		GameTime now() const override { return now_; }
+		void update(GameTime current_time_sync) override;
+		void set_alarm_clock(Fiber* fiber, GameTime at) override;
+		void launch(Function<void()> f) override;
+		void defer(Function<void()> f, GameTime until) override;
+		Fiber* current_fiber() const override;
+		
+		// Launches a fiber for each index in [0, n), all sharing one copy of the function.
+		void parallel_launch(size_t n, Function<void(size_t)> f);
+		
+		size_t num_workers() const;
+		
+		struct Impl;
+		struct Worker;
+	private:
+		Impl* impl_;
+		GameTime now_;
+	};
+}
+
+#endif
@@ -0,0 +1,132 @@
+//
+//  fiber_stack_pool.cpp
+//  grace
+//
+
+#include "base/fiber_stack_pool.hpp"
+#include "base/fiber.hpp"
+#include "base/exceptions.hpp"
+#include "base/raise.hpp"
+
+#include <sys/mman.h>
+
+namespace grace {
+#if !defined(PAGE_SIZE)
+	static const size_t PAGE_SIZE = 4096;
+#endif
+
+	namespace {
+		size_t round_up_to_pages(size_t n) {
+			return (n + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+		}
+
+		byte* reserve_stack(size_t size) {
+			void* p = ::mmap(nullptr, size + PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+			if (p == MAP_FAILED) {
+				raise<OutOfMemoryError>("Could not map a fiber stack of {0} bytes.", size);
+			}
+			::mprotect(p, PAGE_SIZE, PROT_NONE); // guard page
+			return (byte*)p + PAGE_SIZE;
+		}
+
+		void unmap_stack(byte* bottom, size_t size) {
+			::munmap(bottom - PAGE_SIZE, size + PAGE_SIZE);
+		}
+
+	}
+
+	FiberStackPool::FiberStackPool(size_t stack_size, size_t max_cached) : stack_size_(round_up_to_pages(stack_size)), max_cached_(max_cached < MAX_CACHED ? max_cached : MAX_CACHED) {}
+
+	FiberStackPool::~FiberStackPool() {
+		ASSERT(num_in_use_ == 0);
+		for (size_t i = 0; i < num_cached_; ++i) {
+			unmap_stack(cached_[i], stack_size_);
+		}
+	}
+
+	FiberStackPool& FiberStackPool::default_pool() {
+		// Never destroyed, since fibers may outlive static destruction order.
+		static byte memory[sizeof(FiberStackPool)] __attribute__((aligned(alignof(FiberStackPool))));
+		static FiberStackPool* pool = new(memory) FiberStackPool(Fiber::STACK_SIZE);
+		return *pool;
+	}
+
+	FiberStack FiberStackPool::acquire() {
+		FiberStack stack;
+		stack.size = stack_size_;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (num_cached_) {
+				stack.bottom = cached_[--num_cached_];
+				++num_in_use_;
+				return stack;
+			}
+		}
+		stack.bottom = reserve_stack(stack_size_); // may throw, so count it only once we have it
+		std::lock_guard<std::mutex> lock(mutex_);
+		++num_in_use_;
+		return stack;
+	}
+
+	size_t FiberStackPool::release(FiberStack stack) {
+		ASSERT(stack.size == stack_size_);
+		size_t used = high_water_mark(stack);
+		::madvise(stack.bottom, stack.size, MADV_DONTNEED);
+		std::lock_guard<std::mutex> lock(mutex_);
+		--num_in_use_;
+		if (used > peak_high_water_mark_) peak_high_water_mark_ = used;
+		if (num_cached_ < max_cached_) {
+			cached_[num_cached_++] = stack.bottom;
+		} else {
+			unmap_stack(stack.bottom, stack.size);
+		}
+		return used;
+	}
+
+	size_t FiberStackPool::high_water_mark(const FiberStack& stack) {
+		// Stacks grow down, so find the lowest page that has been touched, then the lowest nonzero word in it.
+		static const size_t CHUNK_PAGES = 64;
+		size_t num_pages = stack.size / PAGE_SIZE;
+		byte* first_page = nullptr;
+		for (size_t page = 0; page < num_pages && first_page == nullptr; page += CHUNK_PAGES) {
+			size_t n = num_pages - page < CHUNK_PAGES ? num_pages - page : CHUNK_PAGES;
+			unsigned char resident[CHUNK_PAGES];
+			byte* chunk = stack.bottom + page * PAGE_SIZE;
+#if defined(__APPLE__)
+			int r = ::mincore(chunk, n * PAGE_SIZE, (char*)resident);
+#else
+			int r = ::mincore(chunk, n * PAGE_SIZE, resident);
+#endif
+			if (r != 0) {
+				first_page = stack.bottom; // can't tell, so scan it all
+				break;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				if (resident[i] & 1) {
+					first_page = chunk + i * PAGE_SIZE;
+					break;
+				}
+			}
+		}
+		if (first_page == nullptr) return 0;
+		const uintptr_t* p = (const uintptr_t*)first_page;
+		const uintptr_t* end = (const uintptr_t*)stack.top();
+		while (p < end && *p == 0) ++p;
+		return (const byte*)end - (const byte*)p;
+	}
+
+	size_t FiberStackPool::num_cached() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return num_cached_;
+	}
+
+	size_t FiberStackPool::num_in_use() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return num_in_use_;
+	}
+
+	size_t FiberStackPool::peak_high_water_mark() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return peak_high_water_mark_;
+	}
+}
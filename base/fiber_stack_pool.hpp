@@ -0,0 +1,63 @@
+//
+//  fiber_stack_pool.hpp
+//  grace
+//
+
+#ifndef grace_fiber_stack_pool_hpp
+#define grace_fiber_stack_pool_hpp
+
+#include "base/basic.hpp"
+
+#include <mutex>
+
+namespace grace {
+	struct FiberStack {
+		byte* bottom = nullptr; // lowest usable address, right above the guard page
+		size_t size = 0;
+		byte* top() const { return bottom + size; }
+	};
+
+	/*
+		FiberStackPool hands out fiber stacks and takes them back for reuse, so launching a fiber doesn't
+		cost an mmap.
+
+		Each stack is a lazily committed mapping with a PROT_NONE guard page below it, so an overflow
+		faults right away instead of corrupting a neighbour. Released stacks are given back to the system
+		with MADV_DONTNEED before they are cached, which keeps the resident size bounded by what running
+		fibers actually touch.
+
+		That also makes every unused byte of a stack read as zero, and high_water_mark() uses those zeros
+		as its canary: the deepest nonzero word is as far as the stack has ever grown since it was handed
+		out. Pages that were never touched are skipped without reading them.
+	*/
+	class FiberStackPool {
+	public:
+		static const size_t MAX_CACHED = 64;
+
+		explicit FiberStackPool(size_t stack_size, size_t max_cached = MAX_CACHED);
+		~FiberStackPool();
+		FiberStackPool(const FiberStackPool&) = delete;
+		FiberStackPool& operator=(const FiberStackPool&) = delete;
+
+		static FiberStackPool& default_pool();
+
+		FiberStack acquire();
+		size_t release(FiberStack stack); // returns the stack's high_water_mark()
+		static size_t high_water_mark(const FiberStack& stack);
+
+		size_t stack_size() const { return stack_size_; }
+		size_t num_cached() const;
+		size_t num_in_use() const;
+		size_t peak_high_water_mark() const; // deepest use of any stack released so far
+	private:
+		mutable std::mutex mutex_;
+		size_t stack_size_;
+		size_t max_cached_;
+		byte* cached_[MAX_CACHED];
+		size_t num_cached_ = 0;
+		size_t num_in_use_ = 0;
+		size_t peak_high_water_mark_ = 0;
+	};
+}
+
+#endif
@@ -27,11 +27,22 @@ namespace grace {
 		void empty_function_call_error() __attribute__((noreturn));
 	}
 	
+	/*
+		Function holds any callable with a matching signature.
+		
+		Plain function pointers and function objects of up to InlineSize bytes that can be moved without
+		throwing are stored inside the Function itself, so wrapping a lambda that captures a few pointers
+		allocates nothing. Larger function objects are allocated with the given allocator.
+		
+		Invoking a Function is a single indirect call through a per-type invoker. Copying, moving and
+		destroying the stored object goes through a per-type manager, which is null for function pointers.
+	*/
 	template <typename R, typename... Args>
 	class Function<R(Args...)> {
 	public:
 		using FunctionPointerType = R(*)(Args...);
 		using Self = Function<R(Args...)>;
+		static const size_t InlineSize = 3 * sizeof(void*);
 		
 		Function() {}
 		Function(FunctionPointerType ptr) { assign(ptr); }
@@ -50,7 +61,7 @@ namespace grace {
 		
 		template <typename... A>
 		inline R invoke(A&&... args) const {
-			return (this->*invoke_)(std::forward<A>(args)...);
+			return invoke_(storage_, std::forward<A>(args)...);
 		}
 		
 		template <typename... A>
@@ -59,84 +70,131 @@ namespace grace {
 		}
 		
 		explicit operator bool() const {
-			return type_ != InvokerType::Empty;
+			return invoke_ != &Self::empty_invoker;
 		}
 	private:
-		using InvokerPad = R(Function<R(Args...)>::*)(Args...) const;
+		union Storage {
+			FunctionPointerType fptr;
+			void* heap;
+			alignas(void*) byte buffer[InlineSize];
+		};
 		
-		R empty_invoker_pad(Args...) const {
-			detail::empty_function_call_error();
-		}
-	
-		struct CallerBase {
-			CallerBase(IAllocator& alloc) : allocator(alloc) {}
-			virtual ~CallerBase() {}
-			virtual R invoke(Args&&...) = 0;
-			virtual CallerBase* duplicate(IAllocator& alloc) const = 0;
-			IAllocator& allocator;
+		enum class Operation : uint8 {
+			Destroy,
+			Copy,
+			Move,
 		};
 		
+		using Invoker = R(*)(Storage&, Args...);
+		// dst and src are unused for Destroy. alloc is null when the copy should use the allocator of src.
+		using Manager = void(*)(Operation op, Storage& self, Storage* src, IAllocator* alloc);
+		
 		template <typename T>
-		struct Caller : CallerBase {
-			T object;
-			Caller(const T& object, IAllocator& alloc) : CallerBase(alloc), object(object) {}
-			Caller(T&& object, IAllocator& alloc) : CallerBase(alloc), object(move(object)) {}
-			inline R invoke(Args&&... args) final {
-				return object(std::forward<Args>(args)...);
-			}
-			CallerBase* duplicate(IAllocator& alloc) const {
-				return new(alloc) Caller<T>(object, alloc);
-			}
+		struct Inline {
+			static const bool value = sizeof(T) <= InlineSize && alignof(T) <= alignof(void*) && std::is_nothrow_move_constructible<T>::value;
 		};
 		
-		enum class InvokerType : uint8 {
-			Empty,
-			Thin, // Just a function pointer (overhead: two indirect jumps).
-			Fat,  // A full-featured caller  (overhead: one indirect jump, one virtual call, memory allocation).
+		template <typename T>
+		struct Heap {
+			IAllocator& allocator;
+			T object;
+			Heap(IAllocator& alloc, const T& object) : allocator(alloc), object(object) {}
+			Heap(IAllocator& alloc, T&& object) : allocator(alloc), object(move(object)) {}
 		};
-		union {
-			FunctionPointerType fptr;
-			CallerBase* cptr;
-		} payload = {nullptr};
-		InvokerPad invoke_ = &Function<R(Args...)>::empty_invoker_pad;
-		InvokerType type_ = InvokerType::Empty;
 		
-		R fptr_invoker_pad(Args... args) const {
-			return payload.fptr(std::forward<Args>(args)...);
+		mutable Storage storage_ = {nullptr};
+		Invoker invoke_ = &Self::empty_invoker;
+		Manager manage_ = nullptr;
+		
+		static R empty_invoker(Storage&, Args...) {
+			detail::empty_function_call_error();
 		}
 		
-		R cptr_invoker_pad(Args... args) const {
-			return payload.cptr->invoke(std::forward<Args>(args)...);
+		static R fptr_invoker(Storage& s, Args... args) {
+			return s.fptr(std::forward<Args>(args)...);
 		}
 		
-		void assign_fptr(FunctionPointerType fptr) {
-			type_ = InvokerType::Thin;
-			payload.fptr = fptr;
-			invoke_ = &Function<R(Args...)>::fptr_invoker_pad;
+		template <typename T>
+		static R inline_invoker(Storage& s, Args... args) {
+			return (*reinterpret_cast<T*>(s.buffer))(std::forward<Args>(args)...);
 		}
 		
-		void assign_cptr_impl(CallerBase* caller) {
-			type_ = InvokerType::Fat;
-			payload.cptr = caller;
-			invoke_ = &Function<R(Args...)>::cptr_invoker_pad;
+		template <typename T>
+		static R heap_invoker(Storage& s, Args... args) {
+			return static_cast<Heap<T>*>(s.heap)->object(std::forward<Args>(args)...);
 		}
 		
 		template <typename T>
-		void assign_cptr(T&& function_object, IAllocator& alloc) {
-			assign_cptr_impl(new(alloc) Caller<T>(move(function_object), alloc));
+		static void inline_manager(Operation op, Storage& self, Storage* src, IAllocator*) {
+			switch (op) {
+				case Operation::Destroy: reinterpret_cast<T*>(self.buffer)->~T(); return;
+				case Operation::Copy: new(self.buffer) T(*reinterpret_cast<const T*>(src->buffer)); return;
+				case Operation::Move: {
+					T* object = reinterpret_cast<T*>(src->buffer);
+					new(self.buffer) T(move(*object));
+					object->~T();
+					return;
+				}
+			}
+		}
+		
+		template <typename T>
+		static void heap_manager(Operation op, Storage& self, Storage* src, IAllocator* alloc) {
+			switch (op) {
+				case Operation::Destroy: {
+					Heap<T>* heap = static_cast<Heap<T>*>(self.heap);
+					destroy(heap, heap->allocator);
+					return;
+				}
+				case Operation::Copy: {
+					const Heap<T>* other = static_cast<const Heap<T>*>(src->heap);
+					IAllocator& a = alloc ? *alloc : other->allocator;
+					self.heap = new(a) Heap<T>(a, other->object);
+					return;
+				}
+				case Operation::Move: {
+					Heap<T>* other = static_cast<Heap<T>*>(src->heap);
+					if (alloc == nullptr || alloc == &other->allocator) {
+						self.heap = other;
+					} else {
+						self.heap = new(*alloc) Heap<T>(*alloc, move(other->object));
+						destroy(other, other->allocator);
+					}
+					return;
+				}
+			}
 		}
 		
 		void clear() {
-			if (type_ == InvokerType::Fat && payload.cptr) {
-				destroy(payload.cptr, payload.cptr->allocator);
-				payload.cptr = nullptr;
-			} else if (type_ == InvokerType::Thin) {
-				payload.fptr = nullptr;
+			if (manage_) {
+				manage_(Operation::Destroy, storage_, nullptr, nullptr);
 			}
-			type_ = InvokerType::Empty;
-			invoke_ = &Function<R(Args...)>::empty_invoker_pad;
+			storage_.fptr = nullptr;
+			invoke_ = &Self::empty_invoker;
+			manage_ = nullptr;
 		}
-	
+		
+		template <typename T>
+		typename std::enable_if<Inline<T>::value, void>::type
+		assign_object(T&& function_object, IAllocator&) {
+			new(storage_.buffer) T(move(function_object));
+			invoke_ = &Self::inline_invoker<T>;
+			manage_ = &Self::inline_manager<T>;
+		}
+		
+		template <typename T>
+		typename std::enable_if<!Inline<T>::value, void>::type
+		assign_object(T&& function_object, IAllocator& alloc) {
+			storage_.heap = new(alloc) Heap<T>(alloc, move(function_object));
+			invoke_ = &Self::heap_invoker<T>;
+			manage_ = &Self::heap_manager<T>;
+		}
+		
+		void assign_fptr(FunctionPointerType fptr) {
+			storage_.fptr = fptr;
+			invoke_ = fptr ? &Self::fptr_invoker : &Self::empty_invoker;
+		}
+		
 		template <typename T>
 		typename std::enable_if<std::is_convertible<T, FunctionPointerType>::value, void>::type
 		assign(const T& function_object) {
@@ -155,98 +213,40 @@ namespace grace {
 		typename std::enable_if<!std::is_convertible<T, FunctionPointerType>::value, void>::type
 		assign(T&& function_object, IAllocator& alloc) {
 			clear();
-			assign_cptr(move(function_object), alloc);
-		}
-		
-		void assign(const Function<R(Args...)>& other) {
-			if (&other == this) return;
-			clear();
-			type_ = other.type_;
-			
-			switch (type_) {
-				case InvokerType::Fat: {
-					assign_cptr_impl(other.payload.cptr->duplicate(other.payload.cptr->allocator));
-					return;
-				}
-				case InvokerType::Thin: {
-					assign_fptr(other.payload.fptr);
-					return;
-				}
-				default: return;
-			}
+			assign_object(move(function_object), alloc);
 		}
 		
-		void assign(const Function<R(Args...)>& other, IAllocator& alloc) {
+		void assign_from(const Function<R(Args...)>& other, IAllocator* alloc) {
 			if (&other == this) return;
 			clear();
-			type_ = other.type_;
-			
-			switch (type_) {
-				case InvokerType::Fat: {
-					assign_cptr_impl(other.payload.cptr->duplicate(alloc));
-					return;
-				}
-				case InvokerType::Thin: {
-					assign_fptr(other.payload.fptr);
-					return;
-				}
-				default: return;
+			if (other.manage_) {
+				other.manage_(Operation::Copy, storage_, &other.storage_, alloc);
+			} else {
+				storage_ = other.storage_;
 			}
-		}
-		
-		void assign(Function<R(Args...)>&& other) {
-			if (&other == this) return;
-			clear();
-			type_ = other.type_;
 			invoke_ = other.invoke_;
-			
-			switch (type_) {
-				case InvokerType::Fat: {
-					payload.cptr = other.payload.cptr;
-					other.payload.cptr = nullptr;
-					break;
-				}
-				case InvokerType::Thin: {
-					payload.fptr = other.payload.fptr;
-					other.payload.fptr = nullptr;
-					break;
-				}
-				default: break;
-			}
-			other.type_ = InvokerType::Empty;
-			other.invoke_ = &Function<R(Args...)>::empty_invoker_pad;
+			manage_ = other.manage_;
 		}
 		
-		void assign(Function<R(Args...)>&& other, IAllocator& alloc) {
+		void assign_from(Function<R(Args...)>&& other, IAllocator* alloc) {
 			if (&other == this) return;
 			clear();
-			type_ = other.type_;
-			invoke_ = other.invoke_;
-			
-			switch (type_) {
-				case InvokerType::Fat: {
-					if (&alloc == &other.payload.cptr->allocator) {
-						payload.cptr = other.payload.cptr;
-						other.payload.cptr = nullptr;
-						other.invoke_ = &Function<R(Args...)>::empty_invoker_pad;
-						other.payload.cptr = nullptr;
-					} else {
-						assign_cptr_impl(other.payload.cptr->duplicate(alloc));
-						other.clear();
-					}
-					break;
-				}
-				case InvokerType::Thin: {
-					payload.fptr = other.payload.fptr;
-					other.type_ = InvokerType::Empty;
-					other.invoke_ = &Function<R(Args...)>::empty_invoker_pad;
-					other.payload.fptr = nullptr;
-					break;
-				}
-				default: break;
+			if (other.manage_) {
+				other.manage_(Operation::Move, storage_, &other.storage_, alloc);
+			} else {
+				storage_ = other.storage_;
 			}
+			invoke_ = other.invoke_;
+			manage_ = other.manage_;
+			other.storage_.fptr = nullptr;
+			other.invoke_ = &Self::empty_invoker;
+			other.manage_ = nullptr;
 		}
 		
+		void assign(const Function<R(Args...)>& other) { assign_from(other, nullptr); }
+		void assign(const Function<R(Args...)>& other, IAllocator& alloc) { assign_from(other, &alloc); }
+		void assign(Function<R(Args...)>&& other) { assign_from(move(other), nullptr); }
+		void assign(Function<R(Args...)>&& other, IAllocator& alloc) { assign_from(move(other), &alloc); }
 	};
 	
 	template <typename T, typename R, typename... Args>
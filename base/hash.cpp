@@ -0,0 +1,29 @@
+//
+//  hash.cpp
+//  grace
+//
+
+#include "base/hash.hpp"
+
+#include <string.h>
+
+namespace grace {
+	uint64 hash_bytes(const void* data, size_t nbytes) {
+		static const uint64 K = 0x9e3779b97f4a7c15ULL;
+		const byte* p = (const byte*)data;
+		uint64 h = nbytes * K;
+		while (nbytes >= 8) {
+			uint64 word;
+			::memcpy(&word, p, 8);
+			h = (h ^ hash_mix(word)) * K;
+			p += 8;
+			nbytes -= 8;
+		}
+		if (nbytes) {
+			uint64 word = 0;
+			::memcpy(&word, p, nbytes);
+			h = (h ^ hash_mix(word)) * K;
+		}
+		return hash_mix(h);
+	}
+}
@@ -0,0 +1,56 @@
+//
+//  hash.hpp
+//  grace
+//
+
+#ifndef grace_hash_hpp
+#define grace_hash_hpp
+
+#include "base/basic.hpp"
+#include "base/string.hpp"
+
+#include <type_traits>
+
+namespace grace {
+	// Finalizer from MurmurHash3. Spreads every input bit over the whole word, so that
+	// both the high and the low bits of the result can be used.
+	inline uint64 hash_mix(uint64 x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return x;
+	}
+
+	uint64 hash_bytes(const void* data, size_t nbytes);
+
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint64>::type
+	hash_of(T x) { return hash_mix((uint64)x); }
+	template <typename T>
+	uint64 hash_of(T* p) { return hash_mix((uint64)(uintptr_t)p); }
+	inline uint64 hash_of(StringRef str) { return hash_bytes(str.data(), str.size()); }
+	inline uint64 hash_of(const String& str) { return hash_bytes(str.data(), str.size()); }
+	inline uint64 hash_of(const char* str) { return hash_of(StringRef(str)); }
+
+	/// Hash function object for HashMap. Keys that compare equal must hash equal across
+	/// types too (String and StringRef), so that lookups don't have to convert the key.
+	/// Other types opt in by declaring hash_of next to them.
+	struct Hash {
+		template <typename T>
+		uint64 operator()(const T& x) const {
+			return hash_of(x);
+		}
+	};
+
+	/// Equality comparison struct. Equivalent to std::equal_to.
+	struct Equal {
+		template <typename A, typename B>
+		bool operator()(const A& a, const B& b) const {
+			return a == b;
+		}
+	};
+}
+
+#endif
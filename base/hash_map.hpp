@@ -0,0 +1,502 @@
+//
+//  hash_map.hpp
+//  grace
+//
+
+#ifndef grace_hash_map_hpp
+#define grace_hash_map_hpp
+
+#include "base/map.hpp"
+#include "base/hash.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace grace {
+	namespace detail {
+		static const int8 HASH_CTRL_EMPTY = -128;
+		static const int8 HASH_CTRL_DELETED = -2;
+		// Full buckets hold the low 7 bits of the hash, so they are never negative.
+
+		// A window of control bytes that is matched against in one go.
+		struct HashGroup {
+			static const size_t WIDTH = 16;
+
+#if defined(__SSE2__)
+			explicit HashGroup(const int8* ctrl) : ctrl_(_mm_loadu_si128((const __m128i*)ctrl)) {}
+			uint32 match(int8 h2) const { return (uint32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(h2))); }
+			uint32 match_empty_or_deleted() const { return (uint32)_mm_movemask_epi8(ctrl_); }
+		private:
+			__m128i ctrl_;
+#else
+			explicit HashGroup(const int8* ctrl) : ctrl_(ctrl) {}
+			uint32 match(int8 h2) const {
+				uint32 m = 0;
+				for (size_t i = 0; i < WIDTH; ++i) {
+					m |= uint32(ctrl_[i] == h2) << i;
+				}
+				return m;
+			}
+			uint32 match_empty_or_deleted() const {
+				uint32 m = 0;
+				for (size_t i = 0; i < WIDTH; ++i) {
+					m |= uint32(ctrl_[i] < 0) << i;
+				}
+				return m;
+			}
+		private:
+			const int8* ctrl_;
+#endif
+		public:
+			uint32 match_empty() const { return match(HASH_CTRL_EMPTY); }
+		};
+	}
+
+	/*
+	 HashMap has the interface of Map, but finds keys by hashing instead of binary search,
+	 so that set and erase are O(1) instead of shifting the arrays.
+
+	 Keys and values are kept in dense arrays like Map's, in insertion order, and
+	 keys()/values() and iteration work the same way. Erasing moves the last entry into
+	 the hole, so erasing while iterating only invalidates the erased position and the end.
+	 The arrays are indexed by an open-addressing table in the style of SwissTable: one
+	 control byte per bucket holds 7 bits of the key's hash, and 16 of them are compared
+	 at a time with SSE2 before any key is looked at.
+	*/
+	template <typename Key, typename Value, typename HashFn = Hash, typename Eq = Equal>
+	class HashMap {
+	public:
+		using Self = HashMap<Key,Value,HashFn,Eq>;
+		using mapped_type = Value;
+		using key_type = const Key;
+		HashMap(IAllocator& alloc = default_allocator());
+		HashMap(const Self&, IAllocator& alloc = default_allocator());
+		HashMap(Self&& other);
+		HashMap(std::initializer_list<Pair<Key, Value>> list, IAllocator& alloc = default_allocator());
+		~HashMap() { clear(true); }
+
+		IAllocator& allocator() const { return allocator_; }
+		size_t size() const { return size_; }
+		size_t capacity() const { return alloc_size_; }
+		size_t bucket_count() const { return num_buckets_; }
+		void clear(bool free_memory = true);
+		void swap(Self& other);
+		void reserve(size_t new_size);
+
+		ArrayRef<const Key> keys() const { return ArrayRef<const Key>(keys_, keys_ + size_); }
+		ArrayRef<Value> values() { return ArrayRef<Value>(values_, values_ + size_); }
+		ArrayRef<const Value> values() const { return ArrayRef<const Value>(values_, values_ + size_); }
+
+		Self& operator=(const Self& other);
+		Self& operator=(Self&& other);
+
+		bool operator==(const Self& other) const; // Independent of order.
+		bool operator!=(const Self& other) const { return !(*this == other); }
+
+		template <typename ComparableAndConvertibleKey = Key>
+		Value& operator[](const ComparableAndConvertibleKey& key);
+		template <typename ComparableKey = Key>
+		Maybe<const Value&> operator[](const ComparableKey& key) const;
+
+		template <bool IsConst>
+		using IteratorImpl = MapIteratorImpl<Key,Value,IsConst>;
+		using iterator = IteratorImpl<false>;
+		using const_iterator = IteratorImpl<true>;
+
+		iterator begin() { return iterator(keys_, values_); }
+		iterator end() { return iterator(keys_ + size_, values_ + size_); }
+		const_iterator begin() const { return const_iterator(keys_, values_); }
+		const_iterator end() const { return const_iterator(keys_ + size_, values_ + size_); }
+
+		iterator erase(iterator it);
+		template <typename ComparableKey>
+		iterator erase(const ComparableKey& key);
+
+		template <typename InputIterator>
+		void insert(InputIterator a, InputIterator b);
+		template <typename ComparableAndConvertibleKey = Key>
+		iterator set(ComparableAndConvertibleKey key, Value value);
+
+		template <typename ComparableKey = Key>
+		iterator find(const ComparableKey& key);
+		template <typename ComparableKey = Key>
+		const_iterator find(const ComparableKey& key) const;
+		template <typename ComparableKey = Key>
+		size_t count(const ComparableKey& key) const { return find(key) != end() ? 1 : 0; }
+
+		template <typename ComparableKey = Key>
+		iterator at(const ComparableKey& key) { return find(key); }
+		template <typename ComparableKey = Key>
+		const_iterator at(const ComparableKey& key) const { return find(key); }
+	private:
+		using Group = detail::HashGroup;
+		static const size_t NOT_FOUND = SIZE_MAX;
+
+		IAllocator& allocator_;
+		HashFn hash_;
+		Eq eq_;
+		uint32 alloc_size_ = 0;
+		uint32 size_ = 0;
+		Key* keys_ = nullptr;
+		Value* values_ = nullptr;
+		int8* ctrl_ = nullptr;     // num_buckets_ + Group::WIDTH bytes; the last group mirrors the first.
+		uint32* index_ = nullptr;  // Position in keys_/values_ for each full bucket.
+		uint32 num_buckets_ = 0;   // 0 or a power of two no smaller than Group::WIDTH.
+		uint32 growth_left_ = 0;   // Empty buckets that may be filled before rehashing.
+
+		static size_t max_load(size_t buckets) { return buckets - buckets / 8; }
+		static size_t bucket_count_for(size_t n);
+		static int8 h2(uint64 hash) { return (int8)(hash & 0x7f); }
+
+		template <typename ComparableKey>
+		size_t find_bucket(const ComparableKey& key, uint64 hash) const;
+		size_t find_insert_bucket(uint64 hash) const;
+		void set_ctrl(size_t bucket, int8 c);
+		void rehash(size_t new_num_buckets);
+		void free_table();
+		void grow_entries(size_t n);
+		void erase_at(size_t idx);
+		template <typename ComparableAndConvertibleKey>
+		iterator insert_one(ComparableAndConvertibleKey key, Value value);
+	};
+
+	template <typename K, typename V, typename H, typename E>
+	HashMap<K,V,H,E>::HashMap(IAllocator& alloc) : allocator_(alloc) {}
+
+	template <typename K, typename V, typename H, typename E>
+	HashMap<K,V,H,E>::HashMap(const Self& other, IAllocator& alloc) : allocator_(alloc) {
+		insert(other.begin(), other.end());
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	HashMap<K,V,H,E>::HashMap(Self&& other) : allocator_(other.allocator_) {
+		swap(other);
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	HashMap<K,V,H,E>::HashMap(std::initializer_list<Pair<K,V>> list, IAllocator& alloc) : allocator_(alloc) {
+		insert(list.begin(), list.end());
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::clear(bool free_memory) {
+		destruct_range(keys_, keys_ + size_);
+		destruct_range(values_, values_ + size_);
+		size_ = 0;
+		if (free_memory) {
+			allocator_.free(keys_, sizeof(K) * alloc_size_);
+			allocator_.free(values_, sizeof(V) * alloc_size_);
+			keys_ = nullptr;
+			values_ = nullptr;
+			alloc_size_ = 0;
+			free_table();
+		} else if (num_buckets_) {
+			::memset(ctrl_, detail::HASH_CTRL_EMPTY, num_buckets_ + Group::WIDTH);
+			growth_left_ = (uint32)max_load(num_buckets_);
+		}
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::swap(Self& other) {
+		if (&allocator_ == &other.allocator_) {
+			std::swap(hash_, other.hash_);
+			std::swap(eq_, other.eq_);
+			std::swap(alloc_size_, other.alloc_size_);
+			std::swap(size_, other.size_);
+			std::swap(keys_, other.keys_);
+			std::swap(values_, other.values_);
+			std::swap(ctrl_, other.ctrl_);
+			std::swap(index_, other.index_);
+			std::swap(num_buckets_, other.num_buckets_);
+			std::swap(growth_left_, other.growth_left_);
+		} else {
+			Self tmp = move(other);
+			other = move(*this);
+			*this = move(tmp);
+		}
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	HashMap<K,V,H,E>& HashMap<K,V,H,E>::operator=(const Self& other) {
+		if (this != &other) {
+			clear(false);
+			insert(other.begin(), other.end());
+		}
+		return *this;
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	HashMap<K,V,H,E>& HashMap<K,V,H,E>::operator=(Self&& other) {
+		clear(true);
+		if (&allocator_ == &other.allocator_) {
+			swap(other);
+		} else {
+			insert(other.begin(), other.end());
+			other.clear();
+		}
+		return *this;
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	bool HashMap<K,V,H,E>::operator==(const Self& other) const {
+		if (size_ != other.size_) {
+			return false;
+		}
+		for (size_t i = 0; i < size_; ++i) {
+			auto it = other.find(keys_[i]);
+			if (it == other.end() || !(it->second == values_[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableAndConvertibleKey>
+	V& HashMap<K,V,H,E>::operator[](const ComparableAndConvertibleKey& key) {
+		auto found = find(key);
+		if (found == end()) {
+			found = set(key, V());
+		}
+		return found.value();
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableKey>
+	Maybe<const V&> HashMap<K,V,H,E>::operator[](const ComparableKey& key) const {
+		auto found = find(key);
+		if (found == end()) {
+			return Nothing;
+		}
+		return found->second;
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableKey>
+	typename HashMap<K,V,H,E>::iterator HashMap<K,V,H,E>::find(const ComparableKey& key) {
+		size_t b = find_bucket(key, hash_(key));
+		if (b == NOT_FOUND) {
+			return end();
+		}
+		return iterator(keys_ + index_[b], values_ + index_[b]);
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableKey>
+	typename HashMap<K,V,H,E>::const_iterator HashMap<K,V,H,E>::find(const ComparableKey& key) const {
+		size_t b = find_bucket(key, hash_(key));
+		if (b == NOT_FOUND) {
+			return end();
+		}
+		return const_iterator(keys_ + index_[b], values_ + index_[b]);
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename InputIterator>
+	void HashMap<K,V,H,E>::insert(InputIterator a, InputIterator b) {
+		auto n = iterator_distance_if_supported(a, b);
+		if (n != SIZE_MAX) {
+			reserve(size_ + n); // May overallocate because keys in a...b may already exist in the map.
+		}
+		for (auto it = a; it != b; ++it) {
+			insert_one(it->first, it->second);
+		}
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableAndConvertibleKey>
+	typename HashMap<K,V,H,E>::iterator HashMap<K,V,H,E>::set(ComparableAndConvertibleKey key, V value) {
+		return insert_one(move(key), move(value));
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableKey>
+	typename HashMap<K,V,H,E>::iterator HashMap<K,V,H,E>::erase(const ComparableKey& key) {
+		auto it = find(key);
+		if (it != end()) {
+			return erase(it);
+		}
+		return end();
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	typename HashMap<K,V,H,E>::iterator HashMap<K,V,H,E>::erase(iterator it) {
+		const K* k = &it->first;
+		ASSERT(k >= keys_ && k < keys_ + size_); // iterator from another map!
+		size_t idx = k - keys_;
+		erase_at(idx);
+		return iterator(keys_ + idx, values_ + idx);
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::reserve(size_t new_size) {
+		if (new_size > alloc_size_) {
+			grow_entries(new_size);
+		}
+		if (new_size > max_load(num_buckets_)) {
+			rehash(bucket_count_for(new_size));
+		}
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	size_t HashMap<K,V,H,E>::bucket_count_for(size_t n) {
+		size_t buckets = Group::WIDTH;
+		while (max_load(buckets) < n) {
+			buckets *= 2;
+		}
+		ASSERT(buckets <= UINT32_MAX);
+		return buckets;
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableKey>
+	size_t HashMap<K,V,H,E>::find_bucket(const ComparableKey& key, uint64 hash) const {
+		if (num_buckets_ == 0) {
+			return NOT_FOUND;
+		}
+		size_t mask = num_buckets_ - 1;
+		size_t pos = (hash >> 7) & mask;
+		int8 tag = h2(hash);
+		for (size_t step = Group::WIDTH;; step += Group::WIDTH) {
+			Group group(ctrl_ + pos);
+			for (uint32 m = group.match(tag); m; m &= m - 1) {
+				size_t b = (pos + __builtin_ctz(m)) & mask;
+				if (eq_(keys_[index_[b]], key)) {
+					return b;
+				}
+			}
+			if (group.match_empty()) {
+				return NOT_FOUND;
+			}
+			pos = (pos + step) & mask;
+		}
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	size_t HashMap<K,V,H,E>::find_insert_bucket(uint64 hash) const {
+		size_t mask = num_buckets_ - 1;
+		size_t pos = (hash >> 7) & mask;
+		for (size_t step = Group::WIDTH;; step += Group::WIDTH) {
+			uint32 m = Group(ctrl_ + pos).match_empty_or_deleted();
+			if (m) {
+				return (pos + __builtin_ctz(m)) & mask;
+			}
+			pos = (pos + step) & mask;
+		}
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::set_ctrl(size_t bucket, int8 c) {
+		ctrl_[bucket] = c;
+		if (bucket < Group::WIDTH) {
+			ctrl_[num_buckets_ + bucket] = c;
+		}
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::rehash(size_t new_num_buckets) {
+		free_table();
+		num_buckets_ = (uint32)new_num_buckets;
+		ctrl_ = (int8*)allocator_.allocate(num_buckets_ + Group::WIDTH, Group::WIDTH);
+		index_ = (uint32*)allocator_.allocate(sizeof(uint32) * num_buckets_, alignof(uint32));
+		::memset(ctrl_, detail::HASH_CTRL_EMPTY, num_buckets_ + Group::WIDTH);
+		for (uint32 i = 0; i < size_; ++i) {
+			uint64 hash = hash_(keys_[i]);
+			size_t b = find_insert_bucket(hash);
+			set_ctrl(b, h2(hash));
+			index_[b] = i;
+		}
+		growth_left_ = (uint32)(max_load(num_buckets_) - size_);
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::free_table() {
+		if (num_buckets_) {
+			allocator_.free(ctrl_, num_buckets_ + Group::WIDTH);
+			allocator_.free(index_, sizeof(uint32) * num_buckets_);
+		}
+		ctrl_ = nullptr;
+		index_ = nullptr;
+		num_buckets_ = 0;
+		growth_left_ = 0;
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::grow_entries(size_t n) {
+		// resize_allocation stops overallocating past a page, which would make one insert
+		// after another copy the arrays every time. Double instead.
+		size_t new_size = alloc_size_ * 2 > n ? alloc_size_ * 2 : n;
+		ASSERT(new_size < UINT32_MAX);
+		size_t k_alloc_size = alloc_size_;
+		size_t v_alloc_size = alloc_size_;
+		keys_ = grace::resize_allocation<K>(allocator_, keys_, &k_alloc_size, size_, new_size, 1, 1);
+		values_ = grace::resize_allocation<V>(allocator_, values_, &v_alloc_size, size_, new_size, 1, 1);
+		ASSERT(k_alloc_size == v_alloc_size);
+		alloc_size_ = (uint32)k_alloc_size;
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	template <typename ComparableAndConvertibleKey>
+	typename HashMap<K,V,H,E>::iterator HashMap<K,V,H,E>::insert_one(ComparableAndConvertibleKey key, V value) {
+		uint64 hash = hash_(key);
+		size_t b = find_bucket(key, hash);
+		if (b != NOT_FOUND) {
+			// key already exists in map, just assign value
+			uint32 idx = index_[b];
+			values_[idx] = move(value);
+			return iterator(keys_ + idx, values_ + idx);
+		}
+
+		if (size_ + 1 > alloc_size_) {
+			grow_entries(size_ + 1);
+		}
+		if (growth_left_ == 0) {
+			// Grows the table if it is more than 2/3 full; otherwise there are enough
+			// tombstones that rehashing at the same size makes room.
+			rehash(bucket_count_for(size_ + size_ / 2 + 1));
+		}
+		b = find_insert_bucket(hash);
+		if (ctrl_[b] == detail::HASH_CTRL_EMPTY) {
+			--growth_left_;
+		}
+		set_ctrl(b, h2(hash));
+		index_[b] = size_;
+		auto kp = new(keys_ + size_) K(move(key));
+		auto vp = new(values_ + size_) V(move(value));
+		++size_;
+		return iterator(kp, vp);
+	}
+
+	template <typename K, typename V, typename H, typename E>
+	void HashMap<K,V,H,E>::erase_at(size_t idx) {
+		size_t mask = num_buckets_ - 1;
+		size_t b = find_bucket(keys_[idx], hash_(keys_[idx]));
+		ASSERT(b != NOT_FOUND && index_[b] == idx);
+
+		// If no full window of buckets around b was ever without an empty bucket, no probe
+		// has gone past b, and it can become empty instead of a tombstone.
+		uint32 empty_before = Group(ctrl_ + ((b - Group::WIDTH) & mask)).match_empty();
+		uint32 empty_after = Group(ctrl_ + b).match_empty();
+		if (empty_before && empty_after && (size_t)(__builtin_ctz(empty_after) + __builtin_clz(empty_before) - 16) < Group::WIDTH) {
+			set_ctrl(b, detail::HASH_CTRL_EMPTY);
+			++growth_left_;
+		} else {
+			set_ctrl(b, detail::HASH_CTRL_DELETED);
+		}
+
+		size_t last = size_ - 1;
+		if (idx != last) {
+			size_t lb = find_bucket(keys_[last], hash_(keys_[last]));
+			ASSERT(lb != NOT_FOUND);
+			index_[lb] = (uint32)idx;
+			keys_[idx] = move(keys_[last]);
+			values_[idx] = move(values_[last]);
+		}
+		keys_[last].~K();
+		values_[last].~V();
+		--size_;
+	}
+}
+
+#endif
@@ -0,0 +1,215 @@
+//
+//  indexed_priority_queue.hpp
+//  grace
+//
+
+#ifndef grace_indexed_priority_queue_hpp
+#define grace_indexed_priority_queue_hpp
+
+#include "base/basic.hpp"
+#include "base/array.hpp"
+#include "base/exceptions.hpp"
+#include "base/raise.hpp"
+#include "memory/allocator.hpp"
+
+namespace grace {
+	/*
+		IndexedPriorityQueue is a 4-ary heap that hands out a Handle for each inserted element. The handle
+		stays valid while the element moves around in the heap, so the element can be reprioritized with
+		update() or removed with erase() in O(log n), where PriorityQueue can only find it by searching.
+
+		Like PriorityQueue, top() is the greatest element according to Compare, so use Greater to get the
+		smallest first (for instance the earliest deadline). A handle is valid until its element is popped or
+		erased, after which it may be handed out again.
+	*/
+	template <typename T, typename Compare = Less>
+	class IndexedPriorityQueue {
+	public:
+		struct Handle {
+			uint32 slot = UINT32_MAX;
+			bool is_valid() const { return slot != UINT32_MAX; }
+			bool operator==(Handle other) const { return slot == other.slot; }
+			bool operator!=(Handle other) const { return slot != other.slot; }
+		};
+		static const size_t Arity = 4;
+
+		explicit IndexedPriorityQueue(IAllocator& alloc = default_allocator()) : heap_(alloc), positions_(alloc), free_slots_(alloc) {}
+		IndexedPriorityQueue(Compare cmp, IAllocator& alloc = default_allocator()) : cmp_(std::move(cmp)), heap_(alloc), positions_(alloc), free_slots_(alloc) {}
+		IndexedPriorityQueue(IndexedPriorityQueue<T,Compare>&& other) = default;
+
+		Handle insert(T element);
+		void update(Handle handle, T element);
+		T erase(Handle handle);
+		T pop();
+
+		const T& top() const;
+		Handle top_handle() const;
+		const T& operator[](Handle handle) const;
+		bool contains(Handle handle) const;
+
+		size_t size() const { return heap_.size(); }
+		IAllocator& allocator() const { return heap_.allocator(); }
+		const Compare& compare() const { return cmp_; }
+		void reserve(size_t n);
+		void clear();
+	private:
+		struct Entry {
+			T value;
+			uint32 slot;
+		};
+		static const uint32 NotInHeap = UINT32_MAX;
+
+		Compare cmp_;
+		Array<Entry> heap_;
+		Array<uint32> positions_; // heap index of the element for each slot, or NotInHeap
+		Array<uint32> free_slots_;
+
+		void place(size_t idx, Entry entry);
+		void sift_up(size_t idx);
+		void sift_down(size_t idx);
+		size_t position_of(Handle handle) const;
+	};
+
+	template <typename T, typename C>
+	typename IndexedPriorityQueue<T,C>::Handle IndexedPriorityQueue<T,C>::insert(T element) {
+		Handle handle;
+		if (free_slots_.size()) {
+			handle.slot = free_slots_.pop_back();
+		} else {
+			ASSERT(positions_.size() < NotInHeap);
+			handle.slot = (uint32)positions_.size();
+			positions_.push_back(NotInHeap);
+		}
+		size_t idx = heap_.size();
+		heap_.push_back(Entry{std::move(element), handle.slot});
+		positions_[handle.slot] = (uint32)idx;
+		sift_up(idx);
+		return handle;
+	}
+
+	template <typename T, typename C>
+	void IndexedPriorityQueue<T,C>::update(Handle handle, T element) {
+		size_t idx = position_of(handle);
+		bool raised = cmp_(heap_[idx].value, element);
+		heap_[idx].value = std::move(element);
+		if (raised) {
+			sift_up(idx);
+		} else {
+			sift_down(idx);
+		}
+	}
+
+	template <typename T, typename C>
+	T IndexedPriorityQueue<T,C>::erase(Handle handle) {
+		size_t idx = position_of(handle);
+		T value = std::move(heap_[idx].value);
+		positions_[handle.slot] = NotInHeap;
+		free_slots_.push_back(handle.slot);
+		Entry last = heap_.pop_back();
+		if (idx < heap_.size()) {
+			// Fill the hole with the last element, which may belong above or below it.
+			bool raised = idx > 0 && cmp_(heap_[(idx - 1) / Arity].value, last.value);
+			place(idx, std::move(last));
+			if (raised) {
+				sift_up(idx);
+			} else {
+				sift_down(idx);
+			}
+		}
+		return value;
+	}
+
+	template <typename T, typename C>
+	T IndexedPriorityQueue<T,C>::pop() {
+		if (size() == 0) {
+			raise<IndexOutOfBoundsException>("Tried to pop from empty IndexedPriorityQueue.");
+		}
+		return erase(top_handle());
+	}
+
+	template <typename T, typename C>
+	const T& IndexedPriorityQueue<T,C>::top() const {
+		return heap_.front().value;
+	}
+
+	template <typename T, typename C>
+	typename IndexedPriorityQueue<T,C>::Handle IndexedPriorityQueue<T,C>::top_handle() const {
+		Handle handle;
+		handle.slot = heap_.front().slot;
+		return handle;
+	}
+
+	template <typename T, typename C>
+	const T& IndexedPriorityQueue<T,C>::operator[](Handle handle) const {
+		return heap_[position_of(handle)].value;
+	}
+
+	template <typename T, typename C>
+	bool IndexedPriorityQueue<T,C>::contains(Handle handle) const {
+		return handle.slot < positions_.size() && positions_[handle.slot] != NotInHeap;
+	}
+
+	template <typename T, typename C>
+	void IndexedPriorityQueue<T,C>::reserve(size_t n) {
+		heap_.reserve(n);
+		positions_.reserve(n);
+	}
+
+	template <typename T, typename C>
+	void IndexedPriorityQueue<T,C>::clear() {
+		heap_.clear();
+		positions_.clear();
+		free_slots_.clear();
+	}
+
+	template <typename T, typename C>
+	void IndexedPriorityQueue<T,C>::place(size_t idx, Entry entry) {
+		// Unchecked, because this runs at every level of every sift.
+		positions_.data()[entry.slot] = (uint32)idx;
+		heap_.data()[idx] = std::move(entry);
+	}
+
+	template <typename T, typename C>
+	void IndexedPriorityQueue<T,C>::sift_up(size_t idx) {
+		// Move the element into a hole that travels up, rather than swapping at each level.
+		Entry* heap = heap_.data();
+		Entry entry = std::move(heap[idx]);
+		while (idx > 0) {
+			size_t parent = (idx - 1) / Arity;
+			if (!cmp_(heap[parent].value, entry.value)) break;
+			place(idx, std::move(heap[parent]));
+			idx = parent;
+		}
+		place(idx, std::move(entry));
+	}
+
+	template <typename T, typename C>
+	void IndexedPriorityQueue<T,C>::sift_down(size_t idx) {
+		Entry* heap = heap_.data();
+		Entry entry = std::move(heap[idx]);
+		size_t n = heap_.size();
+		while (true) {
+			size_t first_child = idx * Arity + 1;
+			if (first_child >= n) break;
+			size_t last_child = first_child + Arity < n ? first_child + Arity : n;
+			size_t best = first_child;
+			for (size_t c = first_child + 1; c < last_child; ++c) {
+				if (cmp_(heap[best].value, heap[c].value)) best = c;
+			}
+			if (!cmp_(entry.value, heap[best].value)) break;
+			place(idx, std::move(heap[best]));
+			idx = best;
+		}
+		place(idx, std::move(entry));
+	}
+
+	template <typename T, typename C>
+	size_t IndexedPriorityQueue<T,C>::position_of(Handle handle) const {
+		if (!contains(handle)) {
+			raise<IndexOutOfBoundsException>("Invalid IndexedPriorityQueue handle: {0}.", handle.slot);
+		}
+		return positions_[handle.slot];
+	}
+}
+
+#endif
@@ -82,6 +82,19 @@ namespace grace {
 		template <typename ComparableAndConvertibleKey = Key>
 		iterator set(ComparableAndConvertibleKey key, Value value);
 		
+		// Bulk construction. Inserting n keys one at a time shifts the arrays for each key that
+		// doesn't sort last, which is O(n^2) for unordered input. These sort the new entries once
+		// and merge them in a single linear pass instead. Entries that come later win over earlier
+		// ones with the same key, and over existing entries, just as with repeated set().
+		template <typename InputIterator>
+		void insert_unsorted_bulk(InputIterator a, InputIterator b);
+		void insert_unsorted_bulk_move(Pair<Key,Value>* a, Pair<Key,Value>* b); // Reorders a...b, and leaves it moved-from.
+		// Replaces the contents with a...b, which must already be sorted by key without duplicates. This is not checked.
+		template <typename InputIterator>
+		void build_from_sorted(InputIterator a, InputIterator b);
+		void merge(const Self& other);
+		void merge(Self&& other);
+		
 		template <typename ComparableKey = Key>
 		iterator find(const ComparableKey& key);
 		template <typename ComparableKey = Key>
@@ -103,6 +116,12 @@ namespace grace {
 		
 		template <typename ComparableAndConvertibleKey>
 		iterator insert_one(ComparableAndConvertibleKey key, Value v);
+		template <bool Move, typename InputIterator>
+		void merge_sorted(InputIterator a, InputIterator b, size_t n);
+	};
+	
+	template <typename K, typename V, typename C> struct IsTriviallyRelocatable<Map<K,V,C>> {
+		static const bool Value = true;
 	};
 	
 	template <typename Key, typename Value, bool IsConst>
@@ -421,6 +440,115 @@ namespace grace {
 		return insert_one(move(key), move(value));
 	}
 	
+	template <typename K, typename V, typename C>
+	template <typename InputIterator>
+	void Map<K,V,C>::insert_unsorted_bulk(InputIterator a, InputIterator b) {
+		size_t n = b - a;
+		if (n == 0) return;
+		using PairType = Pair<K,V>;
+		PairType* tmp = (PairType*)allocator_.allocate(sizeof(PairType) * n, alignof(PairType));
+		size_t i = 0;
+		for (auto it = a; it != b; ++it, ++i) {
+			new(tmp + i) PairType{it->first, it->second};
+		}
+		insert_unsorted_bulk_move(tmp, tmp + n);
+		destruct_range(tmp, tmp + n);
+		allocator_.free(tmp, sizeof(PairType) * n);
+	}
+	
+	template <typename K, typename V, typename C>
+	void Map<K,V,C>::insert_unsorted_bulk_move(Pair<K,V>* a, Pair<K,V>* b) {
+		if (a == b) return;
+		auto by_key = [&](const Pair<K,V>& x, const Pair<K,V>& y) { return cmp_(x.first, y.first); };
+		std::stable_sort(a, b, by_key);
+		// Collapse runs of equal keys, keeping the last entry of each.
+		Pair<K,V>* w = a;
+		for (Pair<K,V>* r = a + 1; r != b; ++r) {
+			if (by_key(*w, *r)) {
+				++w;
+			}
+			if (w != r) {
+				*w = move(*r);
+			}
+		}
+		++w;
+		merge_sorted<true>(a, w, w - a);
+	}
+	
+	template <typename K, typename V, typename C>
+	template <typename InputIterator>
+	void Map<K,V,C>::build_from_sorted(InputIterator a, InputIterator b) {
+		clear(false);
+		auto n = iterator_distance_if_supported(a, b);
+		if (n != SIZE_MAX) {
+			reserve(n);
+		}
+		for (auto it = a; it != b; ++it) {
+			reserve(size_ + 1);
+			new(keys_ + size_) K(it->first);
+			new(values_ + size_) V(it->second);
+			++size_;
+		}
+	}
+	
+	template <typename K, typename V, typename C>
+	void Map<K,V,C>::merge(const Self& other) {
+		if (&other == this) return;
+		merge_sorted<false>(other.begin(), other.end(), other.size());
+	}
+	
+	template <typename K, typename V, typename C>
+	void Map<K,V,C>::merge(Self&& other) {
+		if (&other == this) return;
+		merge_sorted<true>(other.begin(), other.end(), other.size());
+		other.clear();
+	}
+	
+	template <typename K, typename V, typename C>
+	template <bool Move, typename InputIterator>
+	void Map<K,V,C>::merge_sorted(InputIterator a, InputIterator b, size_t n) {
+		if (n == 0) return;
+		size_t new_alloc_size = size_ + n;
+		new_alloc_size += new_alloc_size & 1;
+		ASSERT(new_alloc_size < UINT32_MAX);
+		K* new_keys = (K*)allocator_.allocate(sizeof(K) * new_alloc_size, alignof(K));
+		V* new_values = (V*)allocator_.allocate(sizeof(V) * new_alloc_size, alignof(V));
+		size_t i = 0;
+		size_t out = 0;
+		auto it = a;
+		while (i < size_ && it != b) {
+			if (cmp_(keys_[i], it->first)) {
+				new(new_keys + out) K(move(keys_[i]));
+				new(new_values + out) V(move(values_[i]));
+				++i;
+			} else {
+				if (cmp_(it->first, keys_[i])) {
+					move_or_copy_construct<Move>(new_keys + out, it->first);
+				} else {
+					// Same key, so the incoming value replaces ours.
+					new(new_keys + out) K(move(keys_[i]));
+					++i;
+				}
+				move_or_copy_construct<Move>(new_values + out, it->second);
+				++it;
+			}
+			++out;
+		}
+		for (; i < size_; ++i, ++out) {
+			new(new_keys + out) K(move(keys_[i]));
+			new(new_values + out) V(move(values_[i]));
+		}
+		for (; it != b; ++it, ++out) {
+			move_or_copy_construct<Move>(new_keys + out, it->first);
+			move_or_copy_construct<Move>(new_values + out, it->second);
+		}
+		clear(true);
+		keys_ = new_keys;
+		values_ = new_values;
+		size_ = (uint32)out;
+		alloc_size_ = (uint32)new_alloc_size;
+	}
+	
 	template <typename K, typename V, typename C>
 	template <typename ComparableAndConvertibleKey>
 	typename Map<K,V,C>::iterator Map<K,V,C>::insert_one(ComparableAndConvertibleKey key, V value) {
@@ -438,18 +566,39 @@ namespace grace {
 				// key already exists in map, just assign value
 				values_[insert_idx] = move(value);
 			} else {
-				// construct an empty element at the end
-				new(keys_   + size_) K;
-				new(values_ + size_) V;
-				
-				// shift existing values by one
-				std::move_backward(keys_ + insert_idx,   keys_   + size_, keys_   + size_ + 1);
-				std::move_backward(values_ + insert_idx, values_ + size_, values_ + size_ + 1);
-				++size_;
-				
-				// assign new key and value
-				keys_[insert_idx] = move(key);
-				values_[insert_idx] = move(value);
+				if (IsTriviallyRelocatable<K>::Value && IsTriviallyRelocatable<V>::Value) {
+					// shift existing elements by one, and construct the new ones in the gap
+					size_t tail = size_ - insert_idx;
+					::memmove((void*)(keys_ + insert_idx + 1), (void*)(keys_ + insert_idx), tail * sizeof(K));
+					::memmove((void*)(values_ + insert_idx + 1), (void*)(values_ + insert_idx), tail * sizeof(V));
+					bool key_constructed = false;
+					try {
+						new(keys_ + insert_idx) K(move(key));
+						key_constructed = true;
+						new(values_ + insert_idx) V(move(value));
+					}
+					catch (...) {
+						// close the gap again, so the map is as it was
+						if (key_constructed) keys_[insert_idx].~K();
+						::memmove((void*)(keys_ + insert_idx), (void*)(keys_ + insert_idx + 1), tail * sizeof(K));
+						::memmove((void*)(values_ + insert_idx), (void*)(values_ + insert_idx + 1), tail * sizeof(V));
+						throw;
+					}
+					++size_;
+				} else {
+					// construct an empty element at the end
+					new(keys_   + size_) K;
+					new(values_ + size_) V;
+					
+					// shift existing values by one
+					std::move_backward(keys_ + insert_idx,   keys_   + size_, keys_   + size_ + 1);
+					std::move_backward(values_ + insert_idx, values_ + size_, values_ + size_ + 1);
+					++size_;
+					
+					// assign new key and value
+					keys_[insert_idx] = move(key);
+					values_[insert_idx] = move(value);
+				}
 			}
 			return iterator(keys_ + insert_idx, values_ + insert_idx);
 		}
@@ -493,10 +642,16 @@ namespace grace {
 	
 	template <typename K, typename V, typename C>
 	void Map<K,V,C>::reserve(size_t new_size) {
+		if (new_size <= alloc_size_) return;
+		// Keys and values share one capacity, so grow both by the same amount. Growing by a
+		// factor also above a page keeps one set() after another from copying every time.
+		size_t grown = alloc_size_ + alloc_size_ / 2;
+		new_size = grown > new_size ? grown : new_size;
+		new_size += new_size & 1; // resize_allocation rounds odd sizes up
 		size_t k_alloc_size = alloc_size_;
 		size_t v_alloc_size = alloc_size_;
-		keys_ = grace::resize_allocation<K>(allocator_, keys_, &k_alloc_size, size_, new_size, 3, 2);
-		values_ = grace::resize_allocation(allocator_, values_, &v_alloc_size, size_, new_size, 3, 2);
+		keys_ = grace::resize_allocation<K>(allocator_, keys_, &k_alloc_size, size_, new_size, 1, 1);
+		values_ = grace::resize_allocation(allocator_, values_, &v_alloc_size, size_, new_size, 1, 1);
 		ASSERT(k_alloc_size == v_alloc_size);
 		ASSERT(k_alloc_size < UINT32_MAX);
 		alloc_size_ = (uint32)k_alloc_size;
@@ -519,11 +674,19 @@ namespace grace {
 		ASSERT(k >= keys_ && k < keys_ + size_); // iterator from another map!
 		ASSERT(v >= values_ && v < values_ + size_); // iterator from another map!
 		size_t idx = k - keys_;
-		std::move(k + 1, keys_ + size_, k);
-		std::move(v + 1, values_ + size_, v);
-		--size_;
-		keys_[size_].~K();
-		values_[size_].~V();
+		if (IsTriviallyRelocatable<K>::Value && IsTriviallyRelocatable<V>::Value) {
+			k->~K();
+			v->~V();
+			::memmove((void*)k, (void*)(k + 1), (size_ - idx - 1) * sizeof(K));
+			::memmove((void*)v, (void*)(v + 1), (size_ - idx - 1) * sizeof(V));
+			--size_;
+		} else {
+			std::move(k + 1, keys_ + size_, k);
+			std::move(v + 1, values_ + size_, v);
+			--size_;
+			keys_[size_].~K();
+			values_[size_].~V();
+		}
 		return iterator(keys_ + idx, values_ + idx);
 	}
 }
@@ -9,6 +9,8 @@
 #ifndef grace_pair_hpp
 #define grace_pair_hpp
 
+#include "base/type_traits.hpp"
+
 namespace grace {
 	template <typename Key, typename Value>
 	struct Pair {
@@ -21,6 +23,10 @@ namespace grace {
 			return this;
 		}
 	};
+	
+	template <typename K, typename V> struct IsTriviallyRelocatable<Pair<K,V>> {
+		static const bool Value = IsTriviallyRelocatable<K>::Value && IsTriviallyRelocatable<V>::Value;
+	};
 }
 
 #endif
@@ -4,6 +4,7 @@
 #include "io/formatted_stream.hpp"
 #include "base/stack_array.hpp"
 #include "base/array.hpp"
+#include "base/small_array.hpp"
 #include "base/string.hpp"
 #include "base/error.hpp"
 #include "base/raise.hpp"
@@ -57,8 +58,8 @@ namespace grace {
 		} else if (pid == 0) {
 			// transform arguments into a format that execvp can understand
 			COPY_STRING_REF_TO_CSTR_BUFFER(exe_cstr, exe);
-			Array<String> args;
-			Array<const char*> argv;
+			SmallArray<String, 8> args;
+			SmallArray<const char*, 8> argv;
 			args.reserve(arguments.size()+1);
 			argv.reserve(arguments.size()+2);
 			argv.push_back(exe_cstr.data());
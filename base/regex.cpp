@@ -134,7 +134,7 @@ namespace grace {
 	}
 	
 	Regex::SearchResults Regex::search(StringRef haystack, IAllocator& alloc) const {
-		Array<Array<StringRef>> matches(alloc);
+		Array<MatchGroups> matches(alloc);
 		search(haystack, [&](ArrayRef<StringRef> match) {
 			matches.emplace_back(match, alloc);
 		});
@@ -12,6 +12,7 @@
 #include "base/string.hpp"
 #include "base/basic.hpp"
 #include "base/array.hpp"
+#include "base/small_array.hpp"
 #include "base/function.hpp"
 
 namespace grace {
@@ -41,13 +42,16 @@ namespace grace {
 		bool is_case_insensitive() const;
 		bool is_newline_sensitive() const;
 		
+		// Most patterns have a few groups at most, so the groups of each match are stored inline.
+		using MatchGroups = SmallArray<StringRef, 4>;
+		
 		struct SearchResults {
-			Array<Array<StringRef>> matches;
-			SearchResults(Array<Array<StringRef>>&& m) : matches(std::move(m)) {}
+			Array<MatchGroups> matches;
+			SearchResults(Array<MatchGroups>&& m) : matches(std::move(m)) {}
 			SearchResults(const SearchResults&) = default;
 			SearchResults(SearchResults&&) = default;
 			
-			using iterator = Array<Array<StringRef>>::const_iterator;
+			using iterator = Array<MatchGroups>::const_iterator;
 			iterator begin() const { return matches.begin(); }
 			iterator end()   const { return matches.end(); }
 			StringRef operator[](size_t idx) const { return matches[idx][0]; }
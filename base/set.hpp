@@ -43,6 +43,14 @@ namespace grace {
 		bool operator!=(ArrayRef<T> range) const;
 		
 		iterator insert(T element);
+		// Appends a...b, sorts the new elements once and merges them in, dropping duplicates,
+		// rather than shifting the container for each element.
+		template <typename InputIterator>
+		void insert_unsorted_bulk(InputIterator a, InputIterator b);
+		// Replaces the contents with a...b, which must already be sorted without duplicates. This is not checked.
+		template <typename InputIterator>
+		void build_from_sorted(InputIterator a, InputIterator b);
+		void merge(const Self& other) { if (&other != this) insert_sorted(other.begin(), other.end()); }
 		
 		const Container& container() const { return container_; }
 		const Compare& compare() const { return *this; }
@@ -67,6 +75,10 @@ namespace grace {
 		const Compare& cmp() const {
 			return *this;
 		}
+		
+		template <typename InputIterator>
+		void insert_sorted(InputIterator a, InputIterator b);
+		void merge_tail(size_t old_size);
 	};
 	
 	template <typename T, typename C, typename Cmp>
@@ -131,6 +143,41 @@ namespace grace {
 		return container_.insert(std::move(element), insertion_place);
 	}
 
+	template <typename T, typename C, typename Cmp>
+	template <typename InputIterator>
+	void Set<T,C,Cmp>::insert_unsorted_bulk(InputIterator a, InputIterator b) {
+		size_t old_size = size();
+		container_.insert(a, b);
+		std::sort(container_.begin() + old_size, container_.end(), cmp());
+		merge_tail(old_size);
+	}
+	
+	template <typename T, typename C, typename Cmp>
+	template <typename InputIterator>
+	void Set<T,C,Cmp>::build_from_sorted(InputIterator a, InputIterator b) {
+		container_.clear(false);
+		container_.insert(a, b);
+	}
+	
+	template <typename T, typename C, typename Cmp>
+	template <typename InputIterator>
+	void Set<T,C,Cmp>::insert_sorted(InputIterator a, InputIterator b) {
+		size_t old_size = size();
+		container_.insert(a, b);
+		merge_tail(old_size);
+	}
+	
+	template <typename T, typename C, typename Cmp>
+	void Set<T,C,Cmp>::merge_tail(size_t old_size) {
+		auto begin = container_.begin();
+		std::inplace_merge(begin, begin + old_size, container_.end(), cmp());
+		auto last = std::unique(begin, container_.end(), [&](const T& x, const T& y) { return !cmp()(x, y) && !cmp()(y, x); });
+		size_t n = last - begin;
+		while (size() > n) {
+			container_.pop_back();
+		}
+	}
+	
 	template <typename T, typename C, typename Cmp>
 	bool Set<T,C,Cmp>::operator==(const Self& other) const {
 		return (this == &other) || (container_ == other.container_);
@@ -0,0 +1,379 @@
+//
+//  small_array.hpp
+//  grace
+//
+
+#ifndef grace_small_array_hpp
+#define grace_small_array_hpp
+
+#include "base/basic.hpp"
+#include "base/array_ref.hpp"
+#include "base/array_utils.hpp"
+#include "base/iterators.hpp"
+#include "memory/allocator.hpp"
+#include <type_traits>
+
+namespace grace {
+	namespace detail {
+		void array_index_out_of_bounds(size_t idx, size_t max);
+	}
+
+	/*
+		SmallArray has the interface of Array, but stores up to N elements inside the object itself. Past N it
+		moves its elements to memory from its allocator, and grows like Array from there on.
+
+		Use it for temporaries that are nearly always small but must not fail when they are not, where Array
+		would allocate for every use and MaxArray would raise.
+	*/
+	template <typename T, uint32 N>
+	class SmallArray {
+	public:
+		typedef T value_type;
+		using iterator = LinearMemoryIterator<T, false>;
+		using const_iterator = LinearMemoryIterator<T, true>;
+
+		SmallArray() : allocator_(default_allocator()) {}
+		explicit SmallArray(IAllocator& alloc) : allocator_(alloc) {}
+		SmallArray(std::initializer_list<T> list, IAllocator& alloc = default_allocator());
+		SmallArray(const SmallArray<T,N>& other, IAllocator& alloc);
+		SmallArray(const SmallArray<T,N>& other);
+		SmallArray(SmallArray<T,N>&& other);
+		explicit SmallArray(ArrayRef<T> array, IAllocator& alloc = default_allocator());
+		~SmallArray();
+		SmallArray<T,N>& operator=(std::initializer_list<T> list);
+		SmallArray<T,N>& operator=(const SmallArray<T,N>& other);
+		SmallArray<T,N>& operator=(SmallArray<T,N>&& other);
+		bool operator==(ArrayRef<const T> other) const { return cref() == other; }
+		bool operator!=(ArrayRef<const T> other) const { return cref() != other; }
+
+		IAllocator& allocator() const { return allocator_; }
+
+		ArrayRef<T> ref() const {
+			return ArrayRef<T>(data_, data_ + size_);
+		}
+
+		ArrayRef<const T> cref() const {
+			return ArrayRef<const T>(data_, data_ + size_);
+		}
+
+		operator ArrayRef<T>() const {
+			return ref();
+		}
+
+		T& operator[](size_t idx);
+		const T& operator[](size_t idx) const;
+
+		uint32 size() const { return size_; }
+		uint32 capacity() const { return alloc_size_; }
+		bool is_inline() const { return data_ == inline_data(); }
+		void push_back(T element);
+		T pop_back();
+		T& back();
+		const T& back() const;
+		T& front();
+		const T& front() const;
+		void reserve(size_t);
+		void resize(size_t, T fill = T());
+		void clear(bool deallocate = true);
+
+		template <typename InputIterator>
+		iterator insert(InputIterator begin, InputIterator end);
+		template <typename InputIterator>
+		iterator insert_move(InputIterator begin, InputIterator end);
+		template <typename InputIterator>
+		iterator insert(InputIterator begin, InputIterator end, iterator before);
+		template <typename InputIterator>
+		iterator insert_move(InputIterator begin, InputIterator end, iterator before);
+		iterator insert(T element, iterator before);
+
+		template <typename... Args>
+		void emplace_back(Args&&... args);
+
+		iterator begin() { return data_; }
+		iterator end() { return data_ + size_; }
+		const_iterator begin() const { return data_; }
+		const_iterator end() const { return data_ + size_; }
+		T* data() { return data_; }
+		const T* data() const { return data_; }
+
+		size_t erase(size_t idx);
+		iterator erase(iterator);
+	private:
+		using Storage = typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type;
+		IAllocator& allocator_;
+		T* data_ = inline_data();
+		uint32 size_ = 0;
+		uint32 alloc_size_ = N;
+		Storage inline_;
+
+		T* inline_data() { return reinterpret_cast<T*>(&inline_); }
+		const T* inline_data() const { return reinterpret_cast<const T*>(&inline_); }
+		void check_index_valid(size_t idx) const;
+		void steal_or_move_from(SmallArray<T,N>& other);
+		template <typename InputIterator, bool Move>
+		iterator insert_impl(InputIterator b, InputIterator e, iterator before);
+	};
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>::SmallArray(std::initializer_list<T> list, IAllocator& alloc) : allocator_(alloc) {
+		insert(list.begin(), list.end());
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>::SmallArray(const SmallArray<T,N>& other) : allocator_(default_allocator()) {
+		insert(other.begin(), other.end());
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>::SmallArray(const SmallArray<T,N>& other, IAllocator& alloc) : allocator_(alloc) {
+		insert(other.begin(), other.end());
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>::SmallArray(ArrayRef<T> other, IAllocator& alloc) : allocator_(alloc) {
+		insert(other.begin(), other.end());
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>::SmallArray(SmallArray<T,N>&& other) : allocator_(other.allocator_) {
+		steal_or_move_from(other);
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>::~SmallArray() {
+		clear(true);
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>& SmallArray<T,N>::operator=(std::initializer_list<T> list) {
+		clear(false);
+		insert(list.begin(), list.end());
+		return *this;
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>& SmallArray<T,N>::operator=(const SmallArray<T,N>& other) {
+		if (this == &other) return *this;
+		clear(false);
+		insert(other.begin(), other.end());
+		return *this;
+	}
+
+	template <typename T, uint32 N>
+	SmallArray<T,N>& SmallArray<T,N>::operator=(SmallArray<T,N>&& other) {
+		if (this == &other) return *this;
+		clear(true);
+		steal_or_move_from(other);
+		return *this;
+	}
+
+	template <typename T, uint32 N>
+	void SmallArray<T,N>::steal_or_move_from(SmallArray<T,N>& other) {
+		// Expects this to be empty and inline.
+		if (!other.is_inline() && &allocator_ == &other.allocator_) {
+			data_ = other.data_;
+			size_ = other.size_;
+			alloc_size_ = other.alloc_size_;
+			other.data_ = other.inline_data();
+			other.size_ = 0;
+			other.alloc_size_ = N;
+		} else {
+			insert_move(other.begin(), other.end());
+			other.clear(true);
+		}
+	}
+
+	template <typename T, uint32 N>
+	T& SmallArray<T,N>::operator[](size_t idx) {
+		check_index_valid(idx);
+		return data_[idx];
+	}
+
+	template <typename T, uint32 N>
+	const T& SmallArray<T,N>::operator[](size_t idx) const {
+		check_index_valid(idx);
+		return data_[idx];
+	}
+
+	template <typename T, uint32 N>
+	T& SmallArray<T,N>::back() {
+		check_index_valid(size_-1);
+		return data_[size_-1];
+	}
+
+	template <typename T, uint32 N>
+	const T& SmallArray<T,N>::back() const {
+		check_index_valid(size_-1);
+		return data_[size_-1];
+	}
+
+	template <typename T, uint32 N>
+	T& SmallArray<T,N>::front() {
+		check_index_valid(0);
+		return data_[0];
+	}
+
+	template <typename T, uint32 N>
+	const T& SmallArray<T,N>::front() const {
+		check_index_valid(0);
+		return data_[0];
+	}
+
+	template <typename T, uint32 N>
+	void SmallArray<T,N>::push_back(T element) {
+		reserve(size_+1);
+		new(data_ + size_) T(std::move(element));
+		size_++;
+	}
+
+	template <typename T, uint32 N>
+	template <typename... Args>
+	void SmallArray<T,N>::emplace_back(Args&&... args) {
+		reserve(size_+1);
+		new(data_ + size_) T(std::forward<Args>(args)...);
+		size_++;
+	}
+
+	template <typename T, uint32 N>
+	T SmallArray<T,N>::pop_back() {
+		check_index_valid(size_-1);
+		T element = std::move(data_[size_-1]);
+		erase(size_-1);
+		return element;
+	}
+
+	template <typename T, uint32 N>
+	void SmallArray<T,N>::reserve(size_t new_size) {
+		if (new_size <= alloc_size_) return;
+		size_t alloc_size;
+		if (is_inline()) {
+			// Spill: resize_allocation can't take over the inline storage, so move the elements over here.
+			alloc_size = 0;
+			T* heap = grace::resize_allocation<T>(allocator_, (T*)nullptr, &alloc_size, 0, new_size, 3, 2);
+			for (uint32 i = 0; i < size_; ++i) {
+				new(heap + i) T(std::move(data_[i]));
+				data_[i].~T();
+			}
+			data_ = heap;
+		} else {
+			alloc_size = alloc_size_;
+			data_ = grace::resize_allocation<T>(allocator_, data_, &alloc_size, size_, new_size, 3, 2);
+		}
+		alloc_size_ = (uint32)alloc_size;
+	}
+
+	template <typename T, uint32 N>
+	void SmallArray<T,N>::resize(size_t new_size, T x) {
+		reserve(new_size);
+		while (size_ < new_size) push_back(x);
+		while (size_ > new_size) erase(size_-1);
+	}
+
+	template <typename T, uint32 N>
+	void SmallArray<T,N>::clear(bool deallocate) {
+		for (uint32 i = 0; i < size_; ++i) {
+			data_[i].~T();
+		}
+		size_ = 0;
+		if (deallocate && !is_inline()) {
+			allocator_.free(data_, sizeof(T) * alloc_size_);
+			data_ = inline_data();
+			alloc_size_ = N;
+		}
+	}
+
+	template <typename T, uint32 N>
+	template <typename InputIterator>
+	typename SmallArray<T,N>::iterator SmallArray<T,N>::insert(InputIterator b, InputIterator e) {
+		return insert(b, e, end());
+	}
+
+	template <typename T, uint32 N>
+	template <typename InputIterator>
+	typename SmallArray<T,N>::iterator SmallArray<T,N>::insert_move(InputIterator b, InputIterator e) {
+		return insert_move(b, e, end());
+	}
+
+	template <typename T, uint32 N>
+	template <typename InputIterator>
+	typename SmallArray<T,N>::iterator SmallArray<T,N>::insert(InputIterator b, InputIterator e, iterator before) {
+		return insert_impl<InputIterator, false>(b, e, before);
+	}
+
+	template <typename T, uint32 N>
+	template <typename InputIterator>
+	typename SmallArray<T,N>::iterator SmallArray<T,N>::insert_move(InputIterator b, InputIterator e, iterator before) {
+		return insert_impl<InputIterator, true>(b, e, before);
+	}
+
+	template <typename T, uint32 N>
+	typename SmallArray<T,N>::iterator SmallArray<T,N>::insert(T element, iterator before) {
+		return insert_move(&element, &element + 1, before);
+	}
+
+	template <typename T, uint32 N>
+	template <typename InputIterator, bool Move>
+	typename SmallArray<T,N>::iterator SmallArray<T,N>::insert_impl(InputIterator b, InputIterator e, iterator before) {
+		size_t add_len = e - b;
+		size_t num_move = end() - before;
+		size_t before_idx = before - begin();
+		reserve(size_ + add_len);
+		// reserve invalidates iterators, so recalculate it:
+		before = begin() + before_idx;
+		iterator move_end = end();
+		iterator move_target_end = end() + add_len;
+		for (size_t i = 0; i < num_move; ++i) {
+			iterator src = move_end - i - 1;
+			iterator dst = move_target_end - i - 1;
+			if (dst >= end()) {
+				// moving to uninitialized memory
+				new(dst.get()) T(std::move(*src));
+			} else {
+				// moving to previously initialized memory
+				*dst = std::move(*src);
+			}
+		}
+		size_t i = 0;
+		for (auto it = b; it != e; ++it, ++i) {
+			iterator dst = before + i;
+			if (dst < end()) {
+				// moving to previously initialized memory
+				move_or_copy<Move>(*dst, *it);
+			} else {
+				// moving to uninitialized memory
+				move_or_copy_construct<Move>(dst.get(), *it);
+			}
+		}
+		size_ += add_len;
+		return before;
+	}
+
+	template <typename T, uint32 N>
+	size_t SmallArray<T,N>::erase(size_t idx) {
+		check_index_valid(idx);
+		for (size_t i = idx; i + 1 < size_; ++i) {
+			data_[i] = std::move(data_[i+1]);
+		}
+		--size_;
+		// destroy last element
+		data_[size_].~T();
+		return idx;
+	}
+
+	template <typename T, uint32 N>
+	typename SmallArray<T,N>::iterator SmallArray<T,N>::erase(iterator it) {
+		size_t idx = it - begin();
+		check_index_valid(idx);
+		idx = erase(idx);
+		return begin() + idx;
+	}
+
+	template <typename T, uint32 N>
+	void SmallArray<T,N>::check_index_valid(size_t idx) const {
+		if (idx >= size_) {
+			detail::array_index_out_of_bounds(idx, size_);
+		}
+	}
+}
+
+#endif
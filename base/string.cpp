@@ -19,12 +19,23 @@ namespace grace {
 
 	String String::take_ownership(IAllocator &alloc, const char *utf8, size_t size) {
 		String s(alloc);
-		s.data_ = utf8;
-		s.size_ = size;
+		if (size <= InlineCapacity) {
+			s.assign(utf8, size);
+			alloc.free((void*)utf8, size);
+		} else {
+			s.storage_.heap = utf8;
+			s.size_ = size;
+		}
 		return s;
 	}
 	
 	String concatenate(StringRef a, StringRef b, IAllocator& alloc) {
+		if (a.size() + b.size() <= String::InlineCapacity) {
+			char buffer[String::InlineCapacity];
+			std::copy(a.begin(), a.end(), buffer);
+			std::copy(b.begin(), b.end(), buffer+a.size());
+			return String(buffer, a.size() + b.size(), alloc);
+		}
 		char* buffer = (char*)alloc.allocate(a.size() + b.size(), 1);
 		std::copy(a.begin(), a.end(), buffer);
 		std::copy(b.begin(), b.end(), buffer+a.size());
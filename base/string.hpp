@@ -14,12 +14,26 @@
 #include "memory/allocator.hpp"
 #include "base/iterators.hpp"
 #include "base/string_ref.hpp"
+#include "base/type_traits.hpp"
 #include <algorithm> // for std::copy
 
 namespace grace {
+	/*
+		String is an immutable, allocator-aware UTF-8 string.
+		
+		Strings of up to InlineCapacity bytes are stored inside the String object itself and never touch the
+		allocator. Most names, keys and scalars in a document are this short. Longer strings live in a buffer
+		from the allocator. Because data() is derived from size(), a String holds no pointers into itself, so
+		moving one is still a plain copy of its bytes.
+		
+		The flip side is that the characters of a short String move with it. A StringRef into a short String
+		dangles once that String is moved, and so does one into a String held by a container that moves or
+		reallocates its elements (Array, Set, Map, HashMap). Use Symbol for names that need a stable address.
+	*/
 	class String {
 	public:
 		static const ssize_t NPos = SSIZE_MAX;
+		static const size_t InlineCapacity = 16;
 	
 		explicit String(IAllocator& alloc = default_allocator()) : allocator_(alloc) {}
 		String(const char* utf8, IAllocator& alloc = default_allocator());
@@ -56,7 +70,7 @@ namespace grace {
 		
 		operator StringRef() const;
 		
-		const char* data() const { return data_; }
+		const char* data() const { return is_inline() ? storage_.chars : storage_.heap; }
 		size_t size() const;
 		
 		char front() const { return (*this)[0]; }
@@ -66,23 +80,33 @@ namespace grace {
 		
 		using const_iterator = LinearMemoryIterator<char, true>;
 		using iterator = const_iterator;
-		const_iterator begin() const { return const_iterator(data_); }
-		const_iterator end() const { return const_iterator(data_ + size_); }
+		const_iterator begin() const { return const_iterator(data()); }
+		const_iterator end() const { return const_iterator(data() + size_); }
 		
 		static String take_ownership(IAllocator& alloc, const char* utf8, size_t size); // WARNING: utf8 *MUST* be allocated with alloc.
 		
 		struct Algorithms;
 		friend struct Algorithms;
 	private:
+		union Storage {
+			const char* heap;
+			char chars[InlineCapacity];
+		};
+		
 		IAllocator& allocator_;
-		const char* data_ = nullptr;
+		Storage storage_;
 		size_t size_ = 0;
 		
+		bool is_inline() const { return size_ <= InlineCapacity; }
 		void assign(const char* utf8);
 		void assign(const char* utf8, size_t sz);
 		void clear();
 	};
 	
+	template <> struct IsTriviallyRelocatable<String> {
+		static const bool Value = true;
+	};
+	
 	/*
 		Substring.
 		
@@ -129,8 +153,8 @@ namespace grace {
 	inline String::String(const String& other) : String(other, default_allocator()) {
 	}
 	
-	inline String::String(String&& other) : allocator_(other.allocator_), data_(nullptr), size_(0) {
-		swap(other);
+	inline String::String(String&& other) : allocator_(other.allocator_), storage_(other.storage_), size_(other.size_) {
+		other.size_ = 0;
 	}
 	
 	inline String::~String() {
@@ -138,7 +162,7 @@ namespace grace {
 	}
 	
 	inline String& String::operator=(const char* utf8) {
-		if (utf8 >= data_ && utf8 < data_ + size_) {
+		if (utf8 >= data() && utf8 < data() + size_) {
 			// assigning a pointer to the inside of this string!!
 			size_t len = strlen(utf8);
 			char buffer[len];
@@ -153,7 +177,7 @@ namespace grace {
 	}
 	
 	inline String& String::operator=(StringRef other) {
-		if (other.data() >= data_ && other.data() <= data_ + size_) {
+		if (other.data() >= data() && other.data() <= data() + size_) {
 			// StringRef is a substring of this!
 			size_t len = other.size();
 			char buffer[len];
@@ -181,11 +205,11 @@ namespace grace {
 			return *this;
 		}
 		if (&allocator_ == &other.allocator_) {
-			std::swap(data_, other.data_);
+			std::swap(storage_, other.storage_);
 			std::swap(size_, other.size_);
 		} else {
 			clear();
-			assign(other.data_, other.size_);
+			assign(other.data(), other.size_);
 			other.clear();
 		}
 		return *this;
@@ -193,7 +217,7 @@ namespace grace {
 	
 	inline void String::swap(String& other) {
 		if (&allocator() == &other.allocator()) {
-			std::swap(data_, other.data_);
+			std::swap(storage_, other.storage_);
 			std::swap(size_, other.size_);
 		} else {
 			String tmp(move(*this));
@@ -203,14 +227,14 @@ namespace grace {
 	}
 	
 	inline String::operator StringRef() const {
-		return StringRef(data_, data_ + size_);
+		return StringRef(data(), data() + size_);
 	}
 	
 	inline char String::operator[](size_t idx) const {
 		if (idx > size_) {
 			detail::string_index_out_of_bounds_exception(idx, size_);
 		}
-		return data_[idx];
+		return data()[idx];
 	}
 	
 	inline ssize_t String::compare(StringRef other) const {
@@ -271,14 +295,19 @@ namespace grace {
 	}
 	
 	inline void String::assign(const char* utf8, size_t len) {
-		data_ = len ? (char*)allocator_.allocate(len, 1) : nullptr;
+		char* buffer = storage_.chars;
+		if (len > InlineCapacity) {
+			buffer = (char*)allocator_.allocate(len, 1);
+			storage_.heap = buffer;
+		}
 		size_ = len;
-		std::copy(utf8, utf8 + len, (char*)data_);
+		std::copy(utf8, utf8 + len, buffer);
 	}
 	
 	inline void String::clear() {
-		allocator_.free((void*)data_, size_);
-		data_ = nullptr;
+		if (!is_inline()) {
+			allocator_.free((void*)storage_.heap, size_);
+		}
 		size_ = 0;
 	}
 }
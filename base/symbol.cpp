@@ -0,0 +1,76 @@
+//
+//  symbol.cpp
+//  grace
+//
+
+#include "base/symbol.hpp"
+#include "base/hash_map.hpp"
+#include "memory/allocator.hpp"
+
+#include <mutex>
+#include <stddef.h>
+
+namespace grace {
+	namespace detail {
+		// hash_bytes of an empty string is 0, so this needs no dynamic initialization.
+		const SymbolEntry EMPTY_SYMBOL_ENTRY = {0, 0, {0}};
+	}
+
+	namespace {
+		static const size_t SYMBOL_ARENA_SIZE = 0x40000; // 256 KiB, per segment
+
+		struct SymbolTable {
+			std::mutex mutex;
+			LinearAllocator storage;
+			HashMap<StringRef, const detail::SymbolEntry*> entries;
+
+			// The index lives in the arena too, so the table never shows up as leaked.
+			SymbolTable() : storage(SYMBOL_ARENA_SIZE, arena_options()), entries(storage) {}
+
+			static LinearAllocatorOptions arena_options() {
+				LinearAllocatorOptions options;
+				options.growable = true;
+				return options;
+			}
+		};
+
+		byte symbol_table_mem[sizeof(SymbolTable)];
+
+		// Never destroyed, because Symbols are held in static storage all over.
+		SymbolTable& symbol_table() {
+			static SymbolTable* table = new(symbol_table_mem) SymbolTable;
+			return *table;
+		}
+	}
+
+	Symbol::Symbol(StringRef str) : entry_(&detail::EMPTY_SYMBOL_ENTRY) {
+		if (str.size() == 0) return;
+		ASSERT(str.size() < UINT32_MAX);
+		SymbolTable& table = symbol_table();
+		std::lock_guard<std::mutex> lock(table.mutex);
+		auto it = table.entries.find(str);
+		if (it != table.entries.end()) {
+			entry_ = it->second;
+			return;
+		}
+		size_t nbytes = offsetof(detail::SymbolEntry, data) + str.size() + 1;
+		detail::SymbolEntry* entry = (detail::SymbolEntry*)table.storage.allocate(nbytes, alignof(detail::SymbolEntry));
+		entry->hash = hash_of(str);
+		entry->size = (uint32)str.size();
+		::memcpy(entry->data, str.data(), str.size());
+		entry->data[str.size()] = '\0';
+		table.entries.set(StringRef(entry->data, entry->size), entry);
+		entry_ = entry;
+	}
+
+	Maybe<Symbol> Symbol::find(StringRef str) {
+		if (str.size() == 0) return Symbol();
+		SymbolTable& table = symbol_table();
+		std::lock_guard<std::mutex> lock(table.mutex);
+		auto it = table.entries.find(str);
+		if (it == table.entries.end()) {
+			return Nothing;
+		}
+		return Symbol(it->second);
+	}
+}
@@ -0,0 +1,73 @@
+//
+//  symbol.hpp
+//  grace
+//
+
+#ifndef grace_symbol_hpp
+#define grace_symbol_hpp
+
+#include "base/basic.hpp"
+#include "base/string_ref.hpp"
+#include "base/maybe.hpp"
+
+namespace grace {
+	namespace detail {
+		struct SymbolEntry {
+			uint64 hash;
+			uint32 size;
+			char data[1]; // NUL-terminated, allocated to fit.
+		};
+		extern const SymbolEntry EMPTY_SYMBOL_ENTRY;
+	}
+
+	/*
+	 Symbol is an interned string. Every distinct string is stored once, in a global table,
+	 and all Symbols with the same text point to the same entry, so comparing two Symbols
+	 for equality compares pointers, and their hash is computed once, when interned.
+
+	 Entries are never freed, so Symbols are meant for names that recur: attribute and slot
+	 names, type names, object IDs, document keys. Interning is thread-safe.
+
+	 Symbols convert to StringRef, and hash like the equivalent String and StringRef, so they
+	 can be used to look up keys in Map, HashMap and Dictionary without converting.
+	*/
+	class Symbol {
+	public:
+		Symbol() : entry_(&detail::EMPTY_SYMBOL_ENTRY) {}
+		explicit Symbol(StringRef str);
+
+		// Returns the Symbol for str if it has been interned, without interning it.
+		static Maybe<Symbol> find(StringRef str);
+
+		StringRef str() const { return StringRef(entry_->data, entry_->size); }
+		operator StringRef() const { return str(); }
+		const char* data() const { return entry_->data; }
+		const char* c_str() const { return entry_->data; }
+		size_t size() const { return entry_->size; }
+		bool empty() const { return entry_->size == 0; }
+		StringRef::const_iterator begin() const { return str().begin(); }
+		StringRef::const_iterator end() const { return str().end(); }
+		uint64 hash() const { return entry_->hash; }
+
+		bool operator==(Symbol other) const { return entry_ == other.entry_; }
+		bool operator!=(Symbol other) const { return entry_ != other.entry_; }
+		bool operator==(StringRef other) const { return str() == other; }
+		bool operator!=(StringRef other) const { return str() != other; }
+		// Symbols order like their text, so that maps keyed by them have a stable order.
+		bool operator<(Symbol other) const { return entry_ != other.entry_ && str() < other.str(); }
+		bool operator<(StringRef other) const { return str() < other; }
+	private:
+		explicit Symbol(const detail::SymbolEntry* entry) : entry_(entry) {}
+		const detail::SymbolEntry* entry_;
+	};
+
+	inline uint64 hash_of(Symbol sym) { return sym.hash(); }
+
+	template <typename OutputStream>
+	OutputStream& operator<<(OutputStream& os, Symbol sym) {
+		os << sym.str();
+		return os;
+	}
+}
+
+#endif
@@ -45,11 +45,20 @@ namespace grace {
 	
 	template <typename T>
 	struct IsTriviallyCopyable {
-	#if defined(__has_trivial_copy)
-		static const bool Value = __has_trivial_copy(T);
-	#else
-		static const bool Value = false;
-	#endif
+		// __has_trivial_copy is a builtin, not a macro, so it can't be detected with defined().
+		static const bool Value = std::is_trivially_copyable<T>::value;
+	};
+	
+	/*
+	 A type is trivially relocatable if moving an object to a new address and destroying the old one
+	 is the same as copying its bytes, i.e. it holds no pointers into itself and nothing else points
+	 at it. Containers move such elements with memmove/realloc instead of one at a time.
+	 
+	 Trivially copyable types are; specialize this for other types that are.
+	*/
+	template <typename T>
+	struct IsTriviallyRelocatable {
+		static const bool Value = IsTriviallyCopyable<T>::Value;
 	};
 	
 	// === AlignedUnion ===
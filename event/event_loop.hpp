@@ -14,6 +14,7 @@
 #include "base/time.hpp"
 #include "event/event_handle.hpp"
 #include "base/function.hpp"
+#include "io/fd.hpp"
 
 namespace grace {
 	struct IAsyncInputStream;
@@ -24,6 +25,12 @@ namespace grace {
 	struct IInputStreamNonblocking;
 	struct IOutputStreamNonblocking;
 
+	enum class DescriptorEvent {
+		Readable,
+		Writable,
+		Timeout,
+	};
+
 	struct IEventLoop {
 		virtual ~IEventLoop() {}
 
@@ -31,6 +38,9 @@ namespace grace {
 		virtual UniquePtr<IEventHandle> schedule(Function<void()>, SystemTimeDelta delay, IAllocator& = default_allocator()) = 0;
 		virtual UniquePtr<IEventHandle> call_repeatedly(Function<void()>, SystemTimeDelta interval, IAllocator& = default_allocator()) = 0;
 		
+		// Descriptor API: calls back once, when fd is Readable or Writable as asked, or with Timeout.
+		virtual UniquePtr<IEventHandle> when_ready(FileDescriptor fd, DescriptorEvent event, Function<void(DescriptorEvent)> callback, SystemTimeDelta timeout, IAllocator& = default_allocator()) = 0;
+		
 		// Main
 		virtual void quit() = 0;
 		virtual void run() = 0;
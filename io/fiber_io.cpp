@@ -0,0 +1,69 @@
+//
+//  fiber_io.cpp
+//  grace
+//
+
+#include "io/fiber_io.hpp"
+#include "io/pipe_stream.hpp"
+#include "io/network_stream.hpp"
+#include "base/fiber.hpp"
+
+namespace grace {
+	namespace {
+		bool would_block(const Either<size_t, IOEvent>& r) {
+			return r.is_a<IOEvent>() && r.get<IOEvent>() == IOEvent::WouldBlock;
+		}
+	}
+
+	Either<size_t, IOEvent> read_in_fiber(IInputStream& stream, FileDescriptor fd, byte* buffer, size_t max, SystemTimeDelta timeout) {
+		bool nonblocking = stream.is_read_nonblocking();
+		while (true) {
+			if (nonblocking) {
+				// Try first, since there is often something already.
+				auto r = stream.read(buffer, max);
+				if (!would_block(r)) return r;
+			}
+			if (!Fiber::await_readable(fd, timeout)) {
+				return IOEvent::Timeout;
+			}
+			if (!nonblocking) {
+				return stream.read(buffer, max);
+			}
+		}
+	}
+
+	Either<size_t, IOEvent> read_in_fiber(InputPipeStream& stream, byte* buffer, size_t max, SystemTimeDelta timeout) {
+		return read_in_fiber(stream, stream.descriptor(), buffer, max, timeout);
+	}
+
+	Either<size_t, IOEvent> read_in_fiber(INetworkStream& stream, byte* buffer, size_t max, SystemTimeDelta timeout) {
+		return read_in_fiber(stream, (FileDescriptor)stream.handle(), buffer, max, timeout);
+	}
+
+	Either<size_t, IOEvent> write_in_fiber(IOutputStream& stream, FileDescriptor fd, const byte* buffer, size_t n, SystemTimeDelta timeout) {
+		bool nonblocking = stream.is_write_nonblocking();
+		size_t written = 0;
+		while (written < n) {
+			if (!nonblocking && !Fiber::await_writable(fd, timeout)) {
+				return IOEvent::Timeout;
+			}
+			auto r = stream.write(buffer + written, n - written);
+			if (r.is_a<size_t>()) {
+				written += r.get<size_t>();
+			} else if (!would_block(r)) {
+				return r;
+			} else if (!Fiber::await_writable(fd, timeout)) {
+				return IOEvent::Timeout;
+			}
+		}
+		return written;
+	}
+
+	Either<size_t, IOEvent> write_in_fiber(OutputPipeStream& stream, const byte* buffer, size_t n, SystemTimeDelta timeout) {
+		return write_in_fiber(stream, stream.descriptor(), buffer, n, timeout);
+	}
+
+	Either<size_t, IOEvent> write_in_fiber(INetworkStream& stream, const byte* buffer, size_t n, SystemTimeDelta timeout) {
+		return write_in_fiber(stream, (FileDescriptor)stream.handle(), buffer, n, timeout);
+	}
+}
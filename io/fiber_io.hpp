@@ -0,0 +1,41 @@
+//
+//  fiber_io.hpp
+//  grace
+//
+
+#ifndef grace_fiber_io_hpp
+#define grace_fiber_io_hpp
+
+#include "io/fd.hpp"
+#include "io/input_stream.hpp"
+#include "io/output_stream.hpp"
+#include "io/ioevent.hpp"
+#include "base/either.hpp"
+#include "base/time.hpp"
+
+namespace grace {
+	struct InputPipeStream;
+	struct OutputPipeStream;
+	struct INetworkStream;
+
+	/*
+		Reading and writing from a fiber without blocking its thread. Whenever the stream has nothing to
+		give or no room to take, the fiber is parked with Fiber::await_readable/await_writable on fd, the
+		descriptor behind the stream, so other fibers keep running meanwhile.
+
+		The timeout applies to each wait, and runs out with IOEvent::Timeout. Streams should be in
+		non-blocking mode, or a write larger than what the descriptor can take blocks after all.
+	*/
+
+	// Reads whatever is available once there is something, up to max bytes.
+	Either<size_t, IOEvent> read_in_fiber(IInputStream& stream, FileDescriptor fd, byte* buffer, size_t max, SystemTimeDelta timeout = SystemTimeDelta::forever());
+	Either<size_t, IOEvent> read_in_fiber(InputPipeStream& stream, byte* buffer, size_t max, SystemTimeDelta timeout = SystemTimeDelta::forever());
+	Either<size_t, IOEvent> read_in_fiber(INetworkStream& stream, byte* buffer, size_t max, SystemTimeDelta timeout = SystemTimeDelta::forever());
+
+	// Writes all n bytes, unless the stream ends or a wait times out first.
+	Either<size_t, IOEvent> write_in_fiber(IOutputStream& stream, FileDescriptor fd, const byte* buffer, size_t n, SystemTimeDelta timeout = SystemTimeDelta::forever());
+	Either<size_t, IOEvent> write_in_fiber(OutputPipeStream& stream, const byte* buffer, size_t n, SystemTimeDelta timeout = SystemTimeDelta::forever());
+	Either<size_t, IOEvent> write_in_fiber(INetworkStream& stream, const byte* buffer, size_t n, SystemTimeDelta timeout = SystemTimeDelta::forever());
+}
+
+#endif
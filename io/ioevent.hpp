@@ -10,6 +10,7 @@ namespace grace {
 	enum class IOEvent {
 		EndOfStream,
 		WouldBlock,
+		Timeout, // only from waiting reads and writes, such as read_in_fiber
 	};
 }
 
@@ -13,11 +13,19 @@
 #include "io/archive.hpp"
 
 #include "base/string.hpp"
+#include "base/hash_map.hpp"
 
 #include "io/file_stream.hpp"
 
 namespace grace {
-	static const size_t RESOURCE_ARENA_SIZE = 0x2000000; // 32 Mb
+	static const size_t RESOURCE_ARENA_SIZE = 0x2000000; // 32 Mb, per segment
+	
+	static LinearAllocatorOptions resource_arena_options() {
+		LinearAllocatorOptions options;
+		options.growable = true;
+		options.huge_pages = true;
+		return options;
+	}
 
 	struct ResourceLoaderFiberManager : IFiberManager {
 		ResourceLoaderFiberManager() {}
@@ -54,13 +62,13 @@ namespace grace {
 	struct ResourceManager::Impl {
 		String resource_path;
 		Array<UniquePtr<IArchive>> archives;
-		Map<ResourceID, Resource*> resource_cache;
-		Map<ResourceLoaderID, ResourceLoaderBase*> resource_loaders;
+		HashMap<ResourceID, Resource*> resource_cache;
+		HashMap<ResourceLoaderID, ResourceLoaderBase*> resource_loaders;
 		bool is_in_resource_loader_fiber = false;
 		ResourceLoaderFiberManager fiber_manager;
 		LinearAllocator allocator;
 		
-		Impl() : allocator(RESOURCE_ARENA_SIZE) {}
+		Impl() : allocator(RESOURCE_ARENA_SIZE, resource_arena_options()) {}
 	};
 	
 	ResourceManager::Impl& ResourceManager::impl() {
@@ -12,6 +12,11 @@ namespace grace {
 	
 	String StringStream::string(IAllocator& alloc) const {
 		size_t len = buffer_.size();
+		if (len <= String::InlineCapacity) {
+			char small[String::InlineCapacity];
+			buffer_.copy_to(small, small + len);
+			return String(small, len, alloc);
+		}
 		char* buffer = (char*)alloc.allocate(len, 1);
 		char* end = buffer + len;
 		buffer_.copy_to(buffer, end);
@@ -25,8 +25,9 @@ namespace grace {
 		do {
 			byte b[1024];
 			auto r = is.read(b, 1024);
-			r.template when<size_t>([&](size_t n) {
-				buffer.insert(b, b + n);
+			r.template when<size_t>([&](size_t nread) {
+				buffer.insert(b, b + nread);
+				n = nread;
 			}).template when<IOEvent>([&](IOEvent ev) {
 				n = 0;
 			});
@@ -7,6 +7,7 @@
 //
 
 #include "memory/allocator.hpp"
+#include "memory/slab_allocator.hpp"
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <errno.h>
@@ -15,7 +16,9 @@
 #else
 #include <malloc.h>
 #endif
+#include <algorithm>
 #include <mutex>
+#include <pthread.h>
 #include "io/formatted_stream.hpp"
 #include "io/formatters.hpp"
 #include "base/arch.hpp"
@@ -23,10 +26,15 @@
 
 #define DETECT_OVERRUN 0
 #define DETECT_REUSE_AFTER_FREE 0
+#if !defined(USE_SLAB_DEFAULT_ALLOCATOR)
+#define USE_SLAB_DEFAULT_ALLOCATOR 0
+#endif
 #if defined(__APPLE__) || defined(malloc_size)
 #define MALLOC_SIZE ::malloc_size
 #elif defined(_msize)
 #define MALLOC_SIZE ::_msize
+#elif defined(__GLIBC__) && !DETECT_OVERRUN && !DETECT_REUSE_AFTER_FREE
+#define MALLOC_SIZE ::malloc_usable_size
 #else
 #undef MALLOC_SIZE
 #endif
@@ -174,17 +182,67 @@ namespace grace {
 #endif
 		}
         
-        void* system_alloc_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) {
+		/*
+		 Maps at least inout_size bytes of anonymous memory, and sets inout_size to the length
+		 that must later be passed to munmap. With huge_pages, requests of HUGE_PAGE_SIZE or more
+		 try the kernel's reserved huge pages first, then fall back to a 2 MiB-aligned range
+		 advised for transparent huge pages. What was obtained is added to out_obtained.
+		*/
+		void* map_pages(size_t& inout_size, bool huge_pages, HugePageStats& out_obtained) {
+			size_t size = round_up<size_t>(inout_size, PAGE_SIZE);
+			if (huge_pages && size >= HUGE_PAGE_SIZE) {
+				size_t huge_size = round_up<size_t>(size, HUGE_PAGE_SIZE);
+#if defined(MAP_HUGETLB)
+				void* p = ::mmap(nullptr, huge_size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE|MAP_HUGETLB, -1, 0);
+				if (p != MAP_FAILED) {
+					out_obtained.reserved += huge_size / HUGE_PAGE_SIZE;
+					inout_size = huge_size;
+					return p;
+				}
+#endif
+#if defined(MADV_HUGEPAGE)
+				// Over-reserve by one huge page, and trim both ends to get an aligned range.
+				size_t reserved_size = huge_size + HUGE_PAGE_SIZE;
+				byte* reserved = (byte*)::mmap(nullptr, reserved_size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+				if (reserved == MAP_FAILED) {
+					throw OutOfMemoryError();
+				}
+				byte* aligned = (byte*)round_up<uintptr_t>((uintptr_t)reserved, HUGE_PAGE_SIZE);
+				if (aligned != reserved) {
+					::munmap(reserved, aligned - reserved);
+				}
+				byte* end = aligned + huge_size;
+				if (end != reserved + reserved_size) {
+					::munmap(end, (reserved + reserved_size) - end);
+				}
+				if (::madvise(aligned, huge_size, MADV_HUGEPAGE) == 0) {
+					out_obtained.transparent += huge_size / HUGE_PAGE_SIZE;
+				}
+				inout_size = huge_size;
+				return aligned;
+#endif
+			}
+			void* p = ::mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+			if (p == MAP_FAILED) {
+				throw OutOfMemoryError();
+			}
+			inout_size = size;
+			return p;
+		}
+		
+        void* system_alloc_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated, HugePageStats* huge_pages = nullptr) {
             size_t object_size = PAGE_SIZE;
 			while (nbytes > object_size) object_size += PAGE_SIZE;
             size_t to_allocate = object_size;
 #if DETECT_OVERRUN
             to_allocate += PAGE_SIZE;
+            huge_pages = nullptr; // The guard page must follow the object directly.
+#endif
+            HugePageStats ignored;
+            byte* pages = (byte*)map_pages(to_allocate, huge_pages != nullptr, huge_pages ? *huge_pages : ignored);
+#if !DETECT_OVERRUN
+            object_size = to_allocate;
 #endif
-            byte* pages = (byte*)::mmap(nullptr, to_allocate, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
-            if (pages == nullptr) {
-				throw OutOfMemoryError();
-			}
             void* object = pages;
             detail::poison_memory(pages, pages + object_size, detail::UNINITIALIZED_MEMORY_PATTERN);
 #if DETECT_OVERRUN
@@ -194,6 +252,27 @@ namespace grace {
             return object;
         }
         
+		/*
+		 Resizes a mapping from system_alloc_large, moving the pages rather than their contents
+		 when the kernel can. Returns nullptr where it can't, and the caller should copy instead.
+		*/
+		void* system_remap_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t& out_actually_allocated) {
+#if defined(MREMAP_MAYMOVE) && !DETECT_OVERRUN && !DETECT_REUSE_AFTER_FREE
+			size_t new_size = round_up<size_t>(nbytes, PAGE_SIZE);
+			void* p = ::mremap(ptr, old_actual_size, new_size, MREMAP_MAYMOVE);
+			if (p == MAP_FAILED) {
+				return nullptr; // e.g. a MAP_HUGETLB mapping from before huge pages were turned off.
+			}
+			if (new_size > old_actual_size) {
+				detail::poison_memory((byte*)p + old_actual_size, (byte*)p + new_size, detail::UNINITIALIZED_MEMORY_PATTERN);
+			}
+			out_actually_allocated = new_size;
+			return p;
+#else
+			return nullptr;
+#endif
+		}
+
         void system_free_large(void* ptr, size_t actual_size) {
             byte* o = (byte*)ptr;
             detail::poison_memory(o, o + actual_size, detail::FREED_MEMORY_PATTERN);
@@ -207,12 +286,58 @@ namespace grace {
         }
 	}
 	
-	SystemAllocator::SystemAllocator() {
+	namespace {
+		/*
+		 Hands pages straight to the default allocator's slabs, so that they don't show up
+		 as leaks or count twice towards its usage.
+		*/
+		class SlabPageAllocator : public IAllocator {
+		public:
+			void* allocate(size_t nbytes, size_t alignment) final { return system_alloc(nbytes, alignment); }
+			void* reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment) final { return system_realloc(ptr, old_size, new_size, alignment); }
+			void free(void* ptr, size_t nbytes) final { system_free(ptr, nbytes); }
+			void* allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) final { return system_alloc_large(nbytes, alignment, out_actually_allocated); }
+			void free_large(void* ptr, size_t actual_size) final { system_free_large(ptr, actual_size); }
+			size_t usage() const final { return 0; }
+			size_t capacity() const final { return SIZE_MAX; }
+		};
+		
+		byte slab_page_allocator_mem[sizeof(SlabPageAllocator)];
+		byte default_slab_allocator_mem[sizeof(SlabAllocator)];
+	}
+	
+	void* IAllocator::reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated) {
+		void* p = allocate_large(nbytes, alignment, out_actually_allocated);
+		if (ptr != nullptr) {
+			::memcpy(p, ptr, std::min(old_actual_size, out_actually_allocated));
+			free_large(ptr, old_actual_size);
+		}
+		return p;
+	}
+	
+	SystemAllocator::SystemAllocator(bool small_object_slabs) {
 		std::atomic_init<size_t>(&usage_, 0);
+		std::atomic_init<bool>(&use_huge_pages_, false);
+		std::atomic_init<size_t>(&reserved_huge_pages_, 0);
+		std::atomic_init<size_t>(&transparent_huge_pages_, 0);
+		if (small_object_slabs) {
+			// There is only one SystemAllocator that uses slabs, and it never dies.
+			IAllocator* pages = new(slab_page_allocator_mem) SlabPageAllocator;
+			slabs_ = new(default_slab_allocator_mem) SlabAllocator(*pages);
+		}
+	}
+	
+	size_t SystemAllocator::usage() const {
+		return usage_ + (slabs_ ? slabs_->usage() : 0);
 	}
 	
 	void* SystemAllocator::allocate(size_t nbytes, size_t alignment) {
 		if (nbytes == 0) return nullptr;
+		if (slabs_ && SlabAllocator::is_small(nbytes, alignment)) {
+			void* ptr = slabs_->allocate(nbytes, alignment);
+			tracker_.track_allocation(ptr, nbytes);
+			return ptr;
+		}
 		void* ptr = system_alloc(nbytes, alignment);
 		usage_ += system_alloc_size(ptr);
 		tracker_.track_allocation(ptr, nbytes);
@@ -220,6 +345,22 @@ namespace grace {
 	}
 	
 	void* SystemAllocator::reallocate(void *ptr, size_t old_size, size_t new_size, size_t alignment) {
+		if (slabs_ && slabs_->owns(ptr)) {
+			if (SlabAllocator::is_small(new_size, alignment)) {
+				tracker_.track_free(ptr);
+				void* result = slabs_->reallocate(ptr, old_size, new_size, alignment);
+				tracker_.track_allocation(result, new_size);
+				return result;
+			}
+			// Outgrew the slabs.
+			void* result = allocate(new_size, alignment);
+			size_t n = std::min(old_size, slabs_->allocation_size(ptr));
+			::memcpy(result, ptr, std::min(n, new_size));
+			free(ptr, old_size);
+			return result;
+		} else if (slabs_ && ptr == nullptr) {
+			return allocate(new_size, alignment);
+		}
 		usage_ -= system_alloc_size(ptr);
 		tracker_.track_free(ptr);
 		void* result = system_realloc(ptr, old_size, new_size, alignment);
@@ -229,7 +370,10 @@ namespace grace {
 	}
 		
 	void SystemAllocator::free(void* ptr) {
-		if (ptr != nullptr) {
+		if (slabs_ && slabs_->owns(ptr)) {
+			tracker_.track_free(ptr);
+			slabs_->free(ptr, 0);
+		} else if (ptr != nullptr) {
 			size_t sz = system_alloc_size(ptr);
 			usage_ -= sz;
 			tracker_.track_free(ptr);
@@ -238,7 +382,10 @@ namespace grace {
 	}
 	
 	void SystemAllocator::free(void* ptr, size_t nbytes) {
-		if (ptr != nullptr) {
+		if (slabs_ && slabs_->owns(ptr)) {
+			tracker_.track_free(ptr);
+			slabs_->free(ptr, nbytes);
+		} else if (ptr != nullptr) {
 			size_t sz = system_alloc_size(ptr);
 			usage_ -= sz;
 			tracker_.track_free(ptr);
@@ -248,7 +395,15 @@ namespace grace {
     
     void* SystemAllocator::allocate_large(size_t nbytes, size_t alignment, size_t& out_actual_size) {
 		if (nbytes == 0) return nullptr;
-        void* ptr = system_alloc_large(nbytes, alignment, out_actual_size);
+		void* ptr;
+		if (use_huge_pages_) {
+			HugePageStats obtained;
+			ptr = system_alloc_large(nbytes, alignment, out_actual_size, &obtained);
+			reserved_huge_pages_ += obtained.reserved;
+			transparent_huge_pages_ += obtained.transparent;
+		} else {
+			ptr = system_alloc_large(nbytes, alignment, out_actual_size);
+		}
 		usage_ += out_actual_size;
 		tracker_.track_allocation(ptr, out_actual_size);
 		return ptr;
@@ -260,6 +415,28 @@ namespace grace {
 		tracker_.track_free(ptr);
     }
 	
+	void* SystemAllocator::reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated) {
+		// Huge page mappings must stay aligned to HUGE_PAGE_SIZE, which mremap doesn't guarantee.
+		if (ptr != nullptr && nbytes != 0 && alignment <= PAGE_SIZE && !use_huge_pages_) {
+			void* p = system_remap_large(ptr, old_actual_size, nbytes, out_actually_allocated);
+			if (p != nullptr) {
+				usage_ += out_actually_allocated;
+				usage_ -= old_actual_size;
+				tracker_.track_free(ptr);
+				tracker_.track_allocation(p, out_actually_allocated);
+				return p;
+			}
+		}
+		return IAllocator::reallocate_large(ptr, old_actual_size, nbytes, alignment, out_actually_allocated);
+	}
+	
+	HugePageStats SystemAllocator::huge_page_stats() const {
+		HugePageStats stats;
+		stats.reserved = reserved_huge_pages_;
+		stats.transparent = transparent_huge_pages_;
+		return stats;
+	}
+	
 	void SystemAllocator::start_allocation_tracking() {
 		tracker_.start();
 	}
@@ -279,6 +456,22 @@ namespace grace {
 		return move(leaks);
 	}
 	
+	void SystemAllocator::start_heap_sampling(size_t sample_interval) {
+		tracker_.start_sampling(sample_interval);
+	}
+	
+	void SystemAllocator::stop_heap_sampling() {
+		tracker_.stop();
+	}
+	
+	void SystemAllocator::write_heap_profile(FormattedStream& out) {
+		tracker_.write_heap_profile(out);
+	}
+	
+	void SystemAllocator::write_collapsed_heap_profile(FormattedStream& out) {
+		tracker_.write_collapsed_stacks(out);
+	}
+	
 	SystemAllocator::~SystemAllocator() {
 		// TODO: Do leak checks.
 	}
@@ -311,29 +504,42 @@ namespace grace {
 		if (sys_alloc == nullptr) {
 			// Bypass operator new.
 			sys_alloc = (SystemAllocator*)default_allocator_mem;
-			new(sys_alloc) SystemAllocator;
+			new(sys_alloc) SystemAllocator(USE_SLAB_DEFAULT_ALLOCATOR && !DETECT_OVERRUN && !DETECT_REUSE_AFTER_FREE);
 		}
 		return *sys_alloc;
 	}
 	
-	LinearAllocator::LinearAllocator(size_t size) {
+	struct LinearAllocator::Segment {
+		Segment* previous;
+		size_t mapped_size;
+		size_t usable_size;
+		byte* high_water; // current_ at the time the next segment was pushed.
+		
+		static const size_t HEADER_SIZE = 32;
+		byte* begin() { return (byte*)this + HEADER_SIZE; }
+		byte* end() { return begin() + usable_size; }
+		bool contains(byte* p) { return p >= begin() && p <= end(); }
+	};
+	
+	LinearAllocator::LinearAllocator(size_t size, LinearAllocatorOptions options) : options_(options), segment_size_(size) {
+		static_assert(sizeof(Segment) <= Segment::HEADER_SIZE, "Segment header doesn't fit.");
 		if (size) {
-			begin_ = (byte*)::mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
-			if (begin_ == MAP_FAILED) {
-				throw OutOfMemoryError();
-			}
-			detail::poison_memory(begin_, begin_+size, detail::UNALLOCATED_MEMORY_PATTERN);
-		} else {
-			begin_ = nullptr;
+			push_segment(map_segment(size));
+			origin_ = begin_;
 		}
-		current_ = begin_;
-		end_ = begin_ + size;
 	}
 	
 	LinearAllocator::~LinearAllocator() {
-		if (begin_) {
-			detail::poison_memory(begin_, end_, detail::FREED_MEMORY_PATTERN);
-			::munmap(begin_, end_-begin_);
+		while (segment_) {
+			Segment* s = segment_;
+			segment_ = s->previous;
+			detail::poison_memory(s->begin(), s->end(), detail::FREED_MEMORY_PATTERN);
+			::munmap(s, s->mapped_size);
+		}
+		while (retained_) {
+			Segment* s = retained_;
+			retained_ = s->previous;
+			::munmap(s, s->mapped_size);
 		}
 	}
 	
@@ -342,17 +548,19 @@ namespace grace {
 		if (alignment > 1) {
 			alignment = next_pow2(alignment);
 			intptr_t rest = c & (alignment-1);
-			if (rest != alignment) {
+			if (rest != 0) {
 				c += alignment - rest;
 			}
 		}
-		current_ = (byte*)c;
-		void* ptr = current_;
-		current_ += nbytes;
-		if (current_ < begin_ || current_ > end_) {
-			throw OutOfMemoryError();
+		byte* ptr = (byte*)c;
+		if (ptr < current_ || ptr + nbytes > end_ || ptr + nbytes < ptr) {
+			if (!options_.growable) {
+				throw OutOfMemoryError();
+			}
+			return allocate_in_new_segment(nbytes, alignment);
 		}
-		detail::poison_memory((byte*)ptr, (byte*)ptr + nbytes, detail::UNINITIALIZED_MEMORY_PATTERN);
+		current_ = ptr + nbytes;
+		detail::poison_memory(ptr, ptr + nbytes, detail::UNINITIALIZED_MEMORY_PATTERN);
 		
 		if (alignment) {
 			ASSERT(((intptr_t)ptr & (alignment-1)) == 0);
@@ -361,14 +569,148 @@ namespace grace {
 		return ptr;
 	}
 	
-	static byte linear_allocator_mem[sizeof(LinearAllocator)];
-	static const size_t STANDARD_LINEAR_ALLOCATOR_SIZE = 0x4000000; // 64 MiB
+	void* LinearAllocator::allocate_in_new_segment(size_t nbytes, size_t alignment) {
+		size_t needed = nbytes + (alignment > Segment::HEADER_SIZE ? alignment : 0);
+		Segment* segment = nullptr;
+		
+		// Reuse the first retained segment that is big enough.
+		for (Segment** p = &retained_; *p; p = &(*p)->previous) {
+			if ((*p)->usable_size >= needed) {
+				segment = *p;
+				*p = segment->previous;
+				--num_retained_segments_;
+				break;
+			}
+		}
+		if (segment == nullptr) {
+			segment = map_segment(needed > segment_size_ ? needed : segment_size_);
+		}
+		
+		push_segment(segment);
+		if (origin_ == nullptr) {
+			origin_ = begin_;
+		}
+		return allocate(nbytes, alignment);
+	}
+	
+	LinearAllocator::Segment* LinearAllocator::map_segment(size_t usable_size) {
+		size_t mapped_size = usable_size + Segment::HEADER_SIZE;
+		void* p = map_pages(mapped_size, options_.huge_pages, huge_pages_);
+		Segment* segment = (Segment*)p;
+		segment->previous = nullptr;
+		segment->mapped_size = mapped_size;
+		segment->usable_size = usable_size;
+		segment->high_water = nullptr;
+		detail::poison_memory(segment->begin(), segment->end(), detail::UNALLOCATED_MEMORY_PATTERN);
+		return segment;
+	}
+	
+	void LinearAllocator::push_segment(Segment* segment) {
+		if (segment_) {
+			segment_->high_water = current_;
+			used_in_previous_segments_ += current_ - begin_;
+		}
+		segment->previous = segment_;
+		segment_ = segment;
+		begin_ = current_ = segment->begin();
+		end_ = segment->end();
+		capacity_ += segment->usable_size;
+		++num_segments_;
+	}
+	
+	void LinearAllocator::pop_segment() {
+		Segment* s = segment_;
+		detail::poison_memory(begin_, current_, detail::FREED_MEMORY_PATTERN);
+		segment_ = s->previous;
+		capacity_ -= s->usable_size;
+		--num_segments_;
+		release_segment(s);
+		if (segment_) {
+			begin_ = segment_->begin();
+			end_ = segment_->end();
+			current_ = segment_->high_water;
+			used_in_previous_segments_ -= current_ - begin_;
+		} else {
+			origin_ = begin_ = end_ = current_ = nullptr;
+			used_in_previous_segments_ = 0;
+		}
+	}
+	
+	void LinearAllocator::release_segment(Segment* segment) {
+		if (options_.retain_segments) {
+			segment->previous = retained_;
+			retained_ = segment;
+			++num_retained_segments_;
+		} else {
+			::munmap(segment, segment->mapped_size);
+		}
+	}
+	
+	void LinearAllocator::reset(byte* new_current) {
+		// Release all segments that were pushed after new_current was obtained.
+		while (segment_ && !segment_->contains(new_current)) {
+			ASSERT(segment_->previous || new_current == nullptr); // new_current is not from this allocator!
+			pop_segment();
+		}
+		if (segment_ == nullptr) {
+			ASSERT(new_current == nullptr);
+			return;
+		}
+		ASSERT(new_current <= current_);
+		detail::poison_memory(new_current, current_, detail::FREED_MEMORY_PATTERN);
+		current_ = new_current;
+	}
 	
+	static const size_t STANDARD_LINEAR_ALLOCATOR_SIZE = 0x4000000; // 64 MiB
+
+	namespace {
+		std::atomic<size_t> g_scratch_arena_size(STANDARD_LINEAR_ALLOCATOR_SIZE);
+		std::atomic<bool> g_scratch_arena_huge_pages(false);
+		THREAD_LOCAL LinearAllocator* t_scratch_arena = nullptr;
+		pthread_key_t g_scratch_arena_key;
+		pthread_once_t g_scratch_arena_key_once = PTHREAD_ONCE_INIT;
+
+		void destroy_scratch_arena(void* p) {
+			LinearAllocator* arena = static_cast<LinearAllocator*>(p);
+			arena->~LinearAllocator();
+			::free(arena);
+			t_scratch_arena = nullptr;
+		}
+
+		void create_scratch_arena_key() {
+			pthread_key_create(&g_scratch_arena_key, destroy_scratch_arena);
+		}
+	}
+
+	void set_scratch_arena_size(size_t nbytes) {
+		g_scratch_arena_size = nbytes;
+	}
+
+	size_t scratch_arena_size() {
+		return g_scratch_arena_size;
+	}
+
+	void set_scratch_arena_huge_pages(bool enable) {
+		g_scratch_arena_huge_pages = enable;
+	}
+
+	bool scratch_arena_huge_pages() {
+		return g_scratch_arena_huge_pages;
+	}
+
 	LinearAllocator& scratch_linear_allocator() {
-		// TODO: Thread-local
-		static LinearAllocator* p = nullptr;
+		LinearAllocator* p = t_scratch_arena;
 		if (p == nullptr) {
-			p = new(linear_allocator_mem) LinearAllocator(STANDARD_LINEAR_ALLOCATOR_SIZE);
+			pthread_once(&g_scratch_arena_key_once, create_scratch_arena_key);
+			// Bypass the default allocator, so the arena doesn't show up in leak reports.
+			void* mem = ::malloc(sizeof(LinearAllocator));
+			LinearAllocatorOptions options;
+			options.growable = true;
+			options.retain_segments = true;
+			options.huge_pages = g_scratch_arena_huge_pages;
+			p = new(mem) LinearAllocator(g_scratch_arena_size, options);
+			pthread_setspecific(g_scratch_arena_key, p);
+			t_scratch_arena = p;
 		}
 		return *p;
 	}
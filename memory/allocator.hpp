@@ -32,6 +32,9 @@ namespace grace {
 		virtual void free(void* ptr, size_t nbytes) = 0; // Should not call finalizer!
         virtual void* allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) = 0;
         virtual void free_large(void* ptr, size_t actual_size) = 0;
+		// Grows or shrinks memory from allocate_large, keeping the contents. By default this allocates anew
+		// and copies; SystemAllocator remaps the pages instead where the OS can.
+		virtual void* reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated);
 		virtual size_t usage() const = 0;
 		virtual size_t capacity() const = 0;
 	private:
@@ -42,13 +45,30 @@ namespace grace {
 	
 	struct MemoryTracker;
 	struct MemoryLeak;
+	class SlabAllocator;
+	
+	static const size_t HUGE_PAGE_SIZE = 0x200000; // 2 MiB
+	
+	/*
+	 Huge pages obtained by an allocator so far, in units of HUGE_PAGE_SIZE.
+	 Reserved pages come from the kernel's pool (MAP_HUGETLB), so they are certainly huge.
+	 Transparent pages are ranges advised with MADV_HUGEPAGE, which the kernel backs with
+	 huge pages whenever it can find them (see AnonHugePages in /proc/self/smaps).
+	*/
+	struct HugePageStats {
+		size_t reserved = 0;
+		size_t transparent = 0;
+	};
 
 	/*
 	 SystemAllocator has same semantics as malloc/free.
+	 
+	 With small_object_slabs, small requests are served by a SlabAllocator instead of malloc.
+	 default_allocator() does this when built with USE_SLAB_DEFAULT_ALLOCATOR.
 	*/
 	class SystemAllocator : public IAllocator {
 	public:
-		SystemAllocator();
+		explicit SystemAllocator(bool small_object_slabs = false);
 		~SystemAllocator();
 		void* allocate(size_t nbytes, size_t alignment) final;
 		void* reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment) final;
@@ -56,32 +76,64 @@ namespace grace {
 		void free(void* ptr); // simple version that doesn't poison memory.
         void* allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
         void free_large(void* ptr, size_t actual_size) final;
+		void* reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
 		
-		size_t usage() const final { return usage_; }
+		size_t usage() const final;
 		size_t capacity() const final { return SIZE_MAX; }
 		
+		bool uses_slabs() const { return slabs_ != nullptr; }
+		
+		// Back allocate_large() requests of HUGE_PAGE_SIZE or more with huge pages.
+		void set_use_huge_pages(bool enable) { use_huge_pages_ = enable; }
+		bool uses_huge_pages() const { return use_huge_pages_; }
+		HugePageStats huge_page_stats() const;
+		
 		void start_allocation_tracking();
 		void pause_allocation_tracking();
 		void unpause_allocation_tracking();
 		Array<MemoryLeak> finish_allocation_tracking(IAllocator& leak_info_alloc);
 		
+		// Heap profiling: records a backtrace roughly every sample_interval allocated bytes.
+		void start_heap_sampling(size_t sample_interval = DEFAULT_HEAP_SAMPLE_INTERVAL);
+		void stop_heap_sampling();
+		void write_heap_profile(FormattedStream& out);
+		void write_collapsed_heap_profile(FormattedStream& out);
+		
 		void display_backtrace_for_allocation(void* ptr);
 	private:
 		std::atomic<size_t> usage_;
 		MemoryTracker tracker_;
+		SlabAllocator* slabs_ = nullptr;
+		std::atomic<bool> use_huge_pages_;
+		std::atomic<size_t> reserved_huge_pages_;
+		std::atomic<size_t> transparent_huge_pages_;
 	};
 	
 	SystemAllocator& default_allocator();
 	
 	void display_backtrace_for_system_allocation(void* ptr);
 	
+	class ScratchAllocator;
+
+	struct LinearAllocatorOptions {
+		// Map another segment when the current one runs out, instead of throwing OutOfMemoryError.
+		bool growable = false;
+		// Keep segments released by reset() around for reuse, instead of unmapping them.
+		bool retain_segments = false;
+		// Map segments of HUGE_PAGE_SIZE or more with huge pages, to take pressure off the TLB.
+		bool huge_pages = false;
+	};
+
 	/*
 	 LinearAllocator initially allocates one huge block of memory, which other allocators can
 	 use as a basis.
+	 
+	 A growable LinearAllocator maps further segments of (at least) the initial size on demand.
+	 Pointers returned by current() stay valid as reset points across segment boundaries.
 	*/
 	class LinearAllocator : public IAllocator {
 	public:
-		explicit LinearAllocator(size_t size);
+		explicit LinearAllocator(size_t size, LinearAllocatorOptions options = LinearAllocatorOptions());
 		~LinearAllocator();
 		
 		void* allocate(size_t nbytes, size_t alignment) final;
@@ -90,29 +142,74 @@ namespace grace {
         void* allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
         void free_large(void* ptr, size_t actual_size) final;
 		
-		size_t usage() const final { return current_ - begin_; }
-		size_t capacity() const final { return end_ - begin_; }
+		size_t usage() const final { return used_in_previous_segments_ + (current_ - begin_); }
+		size_t capacity() const final { return capacity_; }
 		
 		byte* current() const;
-		byte* begin() const { return begin_; }
-		byte* end() const { return end_; }
+		byte* begin() const { return origin_; } // Resetting to begin() releases everything.
+		byte* segment_begin() const { return begin_; } // Start of the current segment.
+		byte* end() const { return end_; } // End of the current segment.
 		void reset(byte* p);
+		
+		size_t num_segments() const { return num_segments_; }
+		size_t num_retained_segments() const { return num_retained_segments_; }
+		HugePageStats huge_page_stats() const { return huge_pages_; }
 	private:
+		friend class ScratchAllocator;
+		struct Segment;
+		
+		LinearAllocatorOptions options_;
+		size_t segment_size_ = 0;
+		Segment* segment_ = nullptr;  // current segment
+		Segment* retained_ = nullptr; // free segments kept for reuse
+		byte* origin_ = nullptr;
 		byte* begin_ = nullptr;
 		byte* end_ = nullptr;
 		byte* current_ = nullptr;
+		size_t used_in_previous_segments_ = 0;
+		size_t capacity_ = 0;
+		size_t num_segments_ = 0;
+		size_t num_retained_segments_ = 0;
+		HugePageStats huge_pages_;
+		ScratchAllocator* innermost_scratch_ = nullptr;
+		
+		bool resize_in_place(void* ptr, size_t old_size, size_t new_size, size_t alignment);
+		void* allocate_in_new_segment(size_t nbytes, size_t alignment);
+		Segment* map_segment(size_t usable_size);
+		void push_segment(Segment* segment);
+		void pop_segment();
+		void release_segment(Segment* segment);
 	};
-	
+
+	/*
+	 Each thread gets its own scratch arena, which is mapped the first time the thread asks for it,
+	 and unmapped when the thread exits.
+	*/
 	LinearAllocator& scratch_linear_allocator();
+
+	/*
+	 Size of scratch arenas created from now on. Threads that already have an arena keep it.
+	*/
+	void set_scratch_arena_size(size_t nbytes);
+	size_t scratch_arena_size();
 	
+	/*
+	 Whether scratch arenas created from now on use huge pages. Off by default, since a thread
+	 that touches a single byte of its arena then holds on to 2 MiB of physical memory.
+	*/
+	void set_scratch_arena_huge_pages(bool enable);
+	bool scratch_arena_huge_pages();
+
 	/*
 	 ScratchAllocator automatically destroys all objects when it gets destroyed.
 	 This is in effect a crude form of GC.
 	*/
 	class ScratchAllocator : public IAllocator {
 	public:
-		ScratchAllocator() : base_(scratch_linear_allocator()), reset_(base_.current()), last_current_(reset_) {}
-		explicit ScratchAllocator(LinearAllocator& base) : base_(base), reset_(base.current()), last_current_(reset_) {}
+		ScratchAllocator() : ScratchAllocator(scratch_linear_allocator()) {}
+		explicit ScratchAllocator(LinearAllocator& base) : base_(base), reset_(base.current()), reset_usage_(base.usage()), last_current_(reset_), outer_(base.innermost_scratch_) {
+			base_.innermost_scratch_ = this;
+		}
 		~ScratchAllocator();
 		void* allocate_with_finalizer(size_t nbytes, size_t alignment, void(*finalize)(void*));
 		void* allocate(size_t nbytes, size_t alignment) final;
@@ -121,8 +218,8 @@ namespace grace {
         void* allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
         void free_large(void* ptr, size_t actual_size) final { /* no-op */ }
 		
-		size_t usage() const final { return base_.current() - reset_; }
-		size_t capacity() const final { return base_.end() - reset_; }
+		size_t usage() const final { return base_.usage() - reset_usage_; }
+		size_t capacity() const final { return base_.capacity() - reset_usage_; }
 		
 		template <typename T, typename... Args>
 		typename std::enable_if<std::is_pod<T>::value, T*>::type
@@ -147,8 +244,10 @@ namespace grace {
 	
 		LinearAllocator& base_;
 		byte* reset_ = nullptr;
+		size_t reset_usage_ = 0;
 		Finalizer* finalizers_ = nullptr;
 		byte* last_current_ = nullptr;
+		ScratchAllocator* outer_ = nullptr;
 	};
 	
 	namespace detail {
@@ -164,11 +263,32 @@ namespace grace {
 	}
 	
 	
+	inline bool LinearAllocator::resize_in_place(void* ptr, size_t old_size, size_t new_size, size_t alignment) {
+		// Only the most recent allocation can move the end of the arena.
+		byte* p = (byte*)ptr;
+		if (p == nullptr || p + old_size != current_ || new_size > (size_t)(end_ - p)) {
+			return false;
+		}
+		if (alignment > 1 && ((intptr_t)p & (alignment-1)) != 0) {
+			return false;
+		}
+		if (new_size > old_size) {
+			detail::poison_memory(current_, p + new_size, detail::UNINITIALIZED_MEMORY_PATTERN);
+		} else {
+			detail::poison_memory(p + new_size, current_, detail::FREED_MEMORY_PATTERN);
+		}
+		current_ = p + new_size;
+		return true;
+	}
+	
 	inline void* LinearAllocator::reallocate(void *ptr, size_t old_size, size_t new_size, size_t alignment) {
+		// Growing in place under a ScratchAllocator would move memory into its scope, to be reset with it.
+		if (innermost_scratch_ == nullptr && resize_in_place(ptr, old_size, new_size, alignment)) {
+			return ptr;
+		}
 		void* new_ptr = allocate(new_size, alignment);
-		ASSERT(ptr < new_ptr);
 		if (ptr != nullptr) {
-			::memcpy(new_ptr, ptr, old_size);
+			::memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
 		}
 		return new_ptr;
 	}
@@ -190,12 +310,6 @@ namespace grace {
 		return current_;
 	}
 	
-	inline void LinearAllocator::reset(byte* new_current) {
-		ASSERT(new_current >= begin_ && new_current < end_);
-		detail::poison_memory(new_current, current_, detail::FREED_MEMORY_PATTERN);
-		current_ = new_current;
-	}
-	
 	inline void* ScratchAllocator::allocate(size_t nbytes, size_t alignment) {
 		byte* ptr = (byte*)base_.allocate(nbytes, alignment);
 		last_current_ = base_.current();
@@ -204,10 +318,14 @@ namespace grace {
 	}
 	
 	inline void* ScratchAllocator::reallocate(void *ptr, size_t old_size, size_t new_size, size_t alignment) {
+		// Nested scratch allocators own everything above their reset point, so only the innermost one may move the end.
+		if (base_.innermost_scratch_ == this && base_.resize_in_place(ptr, old_size, new_size, alignment)) {
+			last_current_ = base_.current();
+			return ptr;
+		}
 		void* new_ptr = allocate(new_size, alignment);
-		ASSERT(ptr < new_ptr);
 		if (ptr != nullptr) {
-			::memcpy(new_ptr, ptr, old_size);
+			::memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
 		}
 		return new_ptr;
 	}
@@ -244,11 +362,15 @@ namespace grace {
 		// ScratchAllocator alloc2;
 		// alloc1.~ScratchAllocator();
 		// alloc2.~ScratchAllocator();
+		//
+		// The innermost check catches this even when alloc2 never allocated anything.
+		ASSERT(base_.innermost_scratch_ == this);
 		ASSERT(last_current_ == base_.current());
 		for (Finalizer* f = finalizers_; f; f = f->next) {
 			f->finalize(f->ptr);
 		}
 		base_.reset(reset_);
+		base_.innermost_scratch_ = outer_;
 	}
 	
 	template <typename T>
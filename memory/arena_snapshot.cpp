@@ -0,0 +1,172 @@
+//
+//  arena_snapshot.cpp
+//  grace
+//
+
+#include "memory/arena_snapshot.hpp"
+#include "io/file_stream.hpp"
+#include "base/stack_array.hpp"
+#include "base/raise.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace grace {
+	namespace {
+		static const char SNAPSHOT_MAGIC[8] = {'G', 'R', 'A', 'C', 'E', 'I', 'M', 'G'};
+		static const uint32 SNAPSHOT_VERSION = 1;
+		// Data starts at the same offset within a page as it had in the arena, so that it
+		// keeps its alignment. This covers both 4 KiB and 16 KiB pages.
+		static const size_t SNAPSHOT_PAGE_SIZE = 0x4000;
+
+		struct SnapshotHeader {
+			char magic[8];
+			uint32 version;
+			uint32 pointer_size;
+			uint64 data_offset;
+			uint64 data_size;
+			uint64 base_address; // Address of the data when it was written.
+			uint64 root_offset;
+			uint64 relocations_offset;
+			uint64 num_relocations;
+		};
+		static_assert(sizeof(SnapshotHeader) <= SNAPSHOT_PAGE_SIZE, "Snapshot header doesn't fit.");
+
+		void write_zeros(FileStream& f, size_t n) {
+			static const byte zeros[256] = {0};
+			while (n) {
+				size_t chunk = n < sizeof(zeros) ? n : sizeof(zeros);
+				f.write(zeros, chunk);
+				n -= chunk;
+			}
+		}
+	}
+
+	ArenaSnapshotWriter::ArenaSnapshotWriter(LinearAllocator& arena, IAllocator& alloc) : ArenaSnapshotWriter(arena, arena.current(), alloc) {}
+
+	ArenaSnapshotWriter::ArenaSnapshotWriter(LinearAllocator& arena, byte* region_begin, IAllocator& alloc) : arena_(arena), begin_(region_begin), relocations_(alloc) {
+		ASSERT(region_begin >= arena.segment_begin() && region_begin <= arena.current()); // The region must be in the current segment.
+	}
+
+	void ArenaSnapshotWriter::add_relocation(void* const* pointer) {
+		byte* p = (byte*)pointer;
+		ASSERT(p >= begin_ && p + sizeof(void*) <= region_end()); // Only pointers inside the region can be relocated.
+		relocations_.push_back(p - begin_);
+	}
+
+	void ArenaSnapshotWriter::set_root(const void* root) {
+		byte* p = (byte*)root;
+		ASSERT(p >= begin_ && p <= region_end());
+		root_offset_ = p - begin_;
+	}
+
+	void ArenaSnapshotWriter::write(StringRef path) const {
+		byte* end = region_end();
+		ASSERT(end >= begin_ && end <= arena_.end()); // The arena has moved on to another segment.
+		for (uint64 offset: relocations_) {
+			byte* target = *(byte**)(begin_ + offset);
+			if (target != nullptr && (target < begin_ || target > end)) {
+				raise<SnapshotError>("Pointer at offset {0} points outside of the snapshot.", offset);
+			}
+		}
+
+		SnapshotHeader header;
+		::memset(&header, 0, sizeof(header));
+		::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		header.version = SNAPSHOT_VERSION;
+		header.pointer_size = sizeof(void*);
+		header.data_offset = SNAPSHOT_PAGE_SIZE + ((uintptr_t)begin_ & (SNAPSHOT_PAGE_SIZE - 1));
+		header.data_size = end - begin_;
+		header.base_address = (uintptr_t)begin_;
+		header.root_offset = root_offset_;
+		header.relocations_offset = round_up<uint64>(header.data_offset + header.data_size, sizeof(uint64));
+		header.num_relocations = relocations_.size();
+
+		FileStream f = FileStream::open(path, FileMode::WriteCreate);
+		f.write((const byte*)&header, sizeof(header));
+		write_zeros(f, header.data_offset - sizeof(header));
+		f.write(begin_, header.data_size);
+		write_zeros(f, header.relocations_offset - (header.data_offset + header.data_size));
+		if (relocations_.size()) {
+			f.write((const byte*)relocations_.data(), relocations_.size() * sizeof(uint64));
+		}
+		f.close();
+	}
+
+	ArenaSnapshot ArenaSnapshot::map(StringRef path, bool writable) {
+		COPY_STRING_REF_TO_CSTR_BUFFER(path_cstr, path);
+		int fd = ::open(path_cstr.data(), O_RDONLY);
+		if (fd < 0) {
+			raise<SnapshotError>("open ({0}): {1}", path, ::strerror(errno));
+		}
+		struct stat st;
+		SnapshotHeader header;
+		if (::fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header) || ::pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+			::close(fd);
+			raise<SnapshotError>("{0}: Not a snapshot.", path);
+		}
+		size_t file_size = st.st_size;
+		if (::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.version != SNAPSHOT_VERSION || header.pointer_size != sizeof(void*)) {
+			::close(fd);
+			raise<SnapshotError>("{0}: Not a snapshot, or from an incompatible build.", path);
+		}
+		if (header.data_offset + header.data_size > file_size || header.root_offset > header.data_size ||
+			header.relocations_offset + header.num_relocations * sizeof(uint64) > file_size) {
+			::close(fd);
+			raise<SnapshotError>("{0}: Snapshot is truncated.", path);
+		}
+
+		// Ask for the original address. If it's free, the data needs no fixing up.
+		void* hint = (void*)(uintptr_t)(header.base_address - header.data_offset);
+		void* mapping = ::mmap(hint, file_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapping == MAP_FAILED) {
+			raise<SnapshotError>("mmap ({0}): {1}", path, ::strerror(errno));
+		}
+
+		ArenaSnapshot snapshot;
+		snapshot.mapping_ = mapping;
+		snapshot.mapping_size_ = file_size;
+		snapshot.begin_ = (byte*)mapping + header.data_offset;
+		snapshot.size_ = header.data_size;
+		snapshot.root_offset_ = header.root_offset;
+
+		intptr_t delta = (intptr_t)snapshot.begin_ - (intptr_t)header.base_address;
+		if (delta != 0) {
+			const uint64* relocations = (const uint64*)((byte*)mapping + header.relocations_offset);
+			for (uint64 i = 0; i < header.num_relocations; ++i) {
+				uint64 offset = relocations[i];
+				if (offset + sizeof(void*) > header.data_size) {
+					raise<SnapshotError>("{0}: Relocation outside of the snapshot.", path);
+				}
+				uintptr_t& pointer = *(uintptr_t*)(snapshot.begin_ + offset);
+				if (pointer != 0) {
+					pointer += delta;
+				}
+			}
+			snapshot.relocated_ = true;
+		}
+		if (!writable) {
+			::mprotect(mapping, file_size, PROT_READ);
+		}
+		return snapshot;
+	}
+
+	ArenaSnapshot::ArenaSnapshot(ArenaSnapshot&& other) {
+		std::swap(mapping_, other.mapping_);
+		std::swap(mapping_size_, other.mapping_size_);
+		std::swap(begin_, other.begin_);
+		std::swap(size_, other.size_);
+		std::swap(root_offset_, other.root_offset_);
+		std::swap(relocated_, other.relocated_);
+	}
+
+	ArenaSnapshot::~ArenaSnapshot() {
+		if (mapping_) {
+			::munmap(mapping_, mapping_size_);
+		}
+	}
+}
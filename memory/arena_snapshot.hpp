@@ -0,0 +1,104 @@
+//
+//  arena_snapshot.hpp
+//  grace
+//
+
+#ifndef grace_arena_snapshot_hpp
+#define grace_arena_snapshot_hpp
+
+#include "memory/allocator.hpp"
+#include "base/array.hpp"
+#include "base/string.hpp"
+#include "base/error.hpp"
+
+namespace grace {
+	struct SnapshotError : ErrorBase<SnapshotError> {};
+
+	/*
+	 Pointer stored as an offset from its own address, so that it stays valid wherever the
+	 memory holding both it and its target is mapped.
+	*/
+	template <typename T>
+	class RelativePtr {
+	public:
+		RelativePtr() {}
+		RelativePtr(T* p) { *this = p; }
+		RelativePtr(const RelativePtr<T>& other) { *this = other.get(); }
+		RelativePtr<T>& operator=(const RelativePtr<T>& other) { return *this = other.get(); }
+		RelativePtr<T>& operator=(T* p) {
+			offset_ = p ? (intptr_t)p - (intptr_t)this : 0;
+			return *this;
+		}
+
+		T* get() const { return offset_ ? (T*)((intptr_t)this + offset_) : nullptr; }
+		T* operator->() const { return get(); }
+		T& operator*() const { return *get(); }
+		explicit operator bool() const { return offset_ != 0; }
+	private:
+		intptr_t offset_ = 0;
+	};
+
+	/*
+	 Writes the region of a LinearAllocator from region_begin to its current position to a
+	 file, which ArenaSnapshot can map back on the next run instead of rebuilding the data.
+
+	 The region must lie in a single segment, and must not point outside of itself: no
+	 allocator references, no vtables. Pointers within it are either RelativePtr, or raw
+	 pointers registered with add_relocation(), which are rebased if the snapshot can't be
+	 mapped at its original address.
+	*/
+	class ArenaSnapshotWriter {
+	public:
+		explicit ArenaSnapshotWriter(LinearAllocator& arena, IAllocator& alloc = default_allocator());
+		ArenaSnapshotWriter(LinearAllocator& arena, byte* region_begin, IAllocator& alloc = default_allocator());
+
+		byte* region_begin() const { return begin_; }
+		byte* region_end() const { return arena_.current(); }
+
+		void add_relocation(void* const* pointer);
+		template <typename T>
+		void add_relocation(T* const* pointer) { add_relocation((void* const*)pointer); }
+		void set_root(const void* root);
+
+		void write(StringRef path) const; // Raises SnapshotError or FileError.
+	private:
+		LinearAllocator& arena_;
+		byte* begin_;
+		Array<uint64> relocations_;
+		uint64 root_offset_ = 0;
+	};
+
+	/*
+	 A snapshot mapped copy-on-write from its file. It is mapped at its original address when
+	 that is free, in which case nothing is written and pages are shared with the page cache.
+	 Otherwise the registered pointers are rebased first.
+	*/
+	class ArenaSnapshot {
+	public:
+		static ArenaSnapshot map(StringRef path, bool writable = false); // Raises SnapshotError.
+
+		ArenaSnapshot(ArenaSnapshot&& other);
+		~ArenaSnapshot();
+
+		byte* begin() const { return begin_; }
+		byte* end() const { return begin_ + size_; }
+		size_t size() const { return size_; }
+		bool was_relocated() const { return relocated_; }
+
+		template <typename T>
+		T* root() const { return (T*)(begin_ + root_offset_); }
+	private:
+		ArenaSnapshot() {}
+		ArenaSnapshot(const ArenaSnapshot&) = delete;
+		ArenaSnapshot& operator=(const ArenaSnapshot&) = delete;
+
+		void* mapping_ = nullptr;
+		size_t mapping_size_ = 0;
+		byte* begin_ = nullptr;
+		size_t size_ = 0;
+		uint64 root_offset_ = 0;
+		bool relocated_ = false;
+	};
+}
+
+#endif
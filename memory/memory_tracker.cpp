@@ -7,136 +7,496 @@
 //
 
 #include "memory/memory_tracker.hpp"
+#include "memory/allocator.hpp"
 #include "base/array.hpp"
 #include "base/string.hpp"
-#include "io/string_stream.hpp"
-#include "base/stack_array.hpp"
 #include "base/arch.hpp"
+#include "base/exceptions.hpp"
+#include "io/formatted_stream.hpp"
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <atomic>
+#include <mutex>
 
 namespace grace {
+	namespace {
+		/*
+		 Growable array backed directly by mmap, so that the tracker never allocates through
+		 the allocator it is tracking. New memory is zeroed.
+		*/
+		template <typename T>
+		struct MappedArray {
+			T* data = nullptr;
+			size_t capacity = 0;
+
+			~MappedArray() { release(); }
+
+			T& operator[](size_t idx) { return data[idx]; }
+
+			void resize(size_t new_capacity) {
+				T* p = (T*)::mmap(nullptr, new_capacity * sizeof(T), PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+				if (p == MAP_FAILED) {
+					throw OutOfMemoryError();
+				}
+				if (data) {
+					::memcpy(p, data, (capacity < new_capacity ? capacity : new_capacity) * sizeof(T));
+					::munmap(data, capacity * sizeof(T));
+				}
+				data = p;
+				capacity = new_capacity;
+			}
+
+			void release() {
+				if (data) {
+					::munmap(data, capacity * sizeof(T));
+				}
+				data = nullptr;
+				capacity = 0;
+			}
+		};
+
+		struct StackTrace {
+			uint64 hash;
+			size_t depth;
+			void* frames[MEMORY_LEAK_BACKTRACE_STEPS];
+			size_t live_count;
+			size_t live_bytes;
+			size_t total_count;
+			size_t total_bytes;
+		};
+
+		struct LiveAllocation {
+			void* address; // nullptr means the slot is empty.
+			size_t size;
+			size_t stack;
+		};
+
+		static const size_t INITIAL_LIVE_CAPACITY = 4096;
+		static const size_t INITIAL_STACK_CAPACITY = 512;
+		static const size_t FILTER_BITS = 16;
+		static const size_t FILTER_SIZE = 1 << FILTER_BITS;
+
+		inline uint64 hash_pointer(const void* p) {
+			return ((uint64)(uintptr_t)p >> 4) * 0x9e3779b97f4a7c15ULL;
+		}
+
+		uint64 hash_stack(void* const* frames, size_t depth) {
+			uint64 h = 0xcbf29ce484222325ULL;
+			for (size_t i = 0; i < depth; ++i) {
+				h = (h ^ (uint64)(uintptr_t)frames[i]) * 0x100000001b3ULL;
+			}
+			return h;
+		}
+
+		// Bytes this thread may allocate before the next sample is taken.
+		THREAD_LOCAL ptrdiff_t t_bytes_until_sample = 0;
+		THREAD_LOCAL uint64 t_sample_rng = 0;
+		std::atomic<uint64> g_sample_seed(0x2545f4914f6cdd1dULL);
+
+		// Distance to the next sample, exponentially distributed with mean interval.
+		size_t next_sample_distance(size_t interval) {
+			uint64 x = t_sample_rng;
+			x ^= x >> 12;
+			x ^= x << 25;
+			x ^= x >> 27;
+			t_sample_rng = x;
+			double u = (double)(((x * 0x2545f4914f6cdd1dULL) >> 11) + 1) / (double)(1ULL << 53); // (0, 1]
+			return (size_t)(-::log(u) * (double)interval) + 1;
+		}
+
+		bool pick_next_sample(size_t interval) {
+			bool first = t_sample_rng == 0;
+			if (first) {
+				t_sample_rng = g_sample_seed.fetch_add(0x9e3779b97f4a7c15ULL) | 1;
+			}
+			t_bytes_until_sample = (ptrdiff_t)next_sample_distance(interval);
+			return !first; // A new thread starts counting instead of sampling its first allocation.
+		}
+
+		inline bool should_sample(size_t size, size_t interval) {
+			t_bytes_until_sample -= (ptrdiff_t)size;
+			if (t_bytes_until_sample > 0) return false;
+			return pick_next_sample(interval);
+		}
+
+		// How many bytes a stack's samples stand for, since bigger allocations are more likely to be sampled.
+		double unsample_bytes(size_t count, size_t bytes, size_t interval) {
+			if (interval == 0 || count == 0) return (double)bytes;
+			double average = (double)bytes / (double)count;
+			return (double)bytes / (1.0 - ::exp(-average / (double)interval));
+		}
+	}
+
 	struct MemoryTracker::Impl {
-		MemoryLeak* begin;
-		MemoryLeak* end;
-		size_t num_live_allocations = 0;
-		bool is_tracking = false;
-		bool is_paused = false;
+		std::mutex mutex;
+		std::atomic<bool> is_tracking;
+		std::atomic<bool> is_paused;
+		std::atomic<size_t> sample_interval; // 0 means every allocation is recorded.
+
+		// Open addressing with linear probing, keyed by address.
+		MappedArray<LiveAllocation> live;
+		size_t num_live = 0;
+
+		// Unique call stacks, and an open addressing index into them (entries are index+1).
+		MappedArray<StackTrace> stacks;
+		size_t num_stacks = 0;
+		MappedArray<size_t> stack_index;
+
+		// Number of recorded addresses per hash, so that frees of unrecorded memory don't need the lock.
+		std::atomic<uint32> filter[FILTER_SIZE];
+
+		Impl() {
+			std::atomic_init(&is_tracking, false);
+			std::atomic_init(&is_paused, false);
+			std::atomic_init<size_t>(&sample_interval, 0);
+			for (auto& f: filter) {
+				std::atomic_init<uint32>(&f, 0);
+			}
+		}
+
+		static size_t filter_slot(const void* address) {
+			return (size_t)(hash_pointer(address) >> (64 - FILTER_BITS));
+		}
+
+		bool may_contain(const void* address) const {
+			return filter[filter_slot(address)].load(std::memory_order_relaxed) != 0;
+		}
+
+		void clear() {
+			live.release();
+			stacks.release();
+			stack_index.release();
+			num_live = 0;
+			num_stacks = 0;
+			for (auto& f: filter) {
+				f.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		size_t find_live(const void* address) {
+			size_t mask = live.capacity - 1;
+			size_t i = hash_pointer(address) & mask;
+			while (live[i].address != nullptr && live[i].address != address) {
+				i = (i + 1) & mask;
+			}
+			return i;
+		}
+
+		void grow_live() {
+			MappedArray<LiveAllocation> old;
+			std::swap(old.data, live.data);
+			std::swap(old.capacity, live.capacity);
+			live.resize(old.capacity ? old.capacity * 2 : INITIAL_LIVE_CAPACITY);
+			for (size_t i = 0; i < old.capacity; ++i) {
+				if (old[i].address) {
+					live[find_live(old[i].address)] = old[i];
+				}
+			}
+		}
+
+		void remove_live(size_t i) {
+			// Backward shift deletion, so that probe sequences stay unbroken without tombstones.
+			size_t mask = live.capacity - 1;
+			for (size_t j = (i + 1) & mask; live[j].address != nullptr; j = (j + 1) & mask) {
+				size_t home = hash_pointer(live[j].address) & mask;
+				bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+				if (!stays) {
+					live[i] = live[j];
+					i = j;
+				}
+			}
+			live[i].address = nullptr;
+			live[i].size = 0;
+			live[i].stack = 0;
+		}
+
+		size_t find_stack(uint64 hash, void* const* frames, size_t depth) {
+			size_t mask = stack_index.capacity - 1;
+			size_t i = hash & mask;
+			while (stack_index[i] != 0) {
+				StackTrace& s = stacks[stack_index[i] - 1];
+				if (s.hash == hash && s.depth == depth && ::memcmp(s.frames, frames, depth * sizeof(void*)) == 0) {
+					break;
+				}
+				i = (i + 1) & mask;
+			}
+			return i;
+		}
+
+		size_t intern_stack(void* const* frames, size_t depth) {
+			if ((num_stacks + 1) * 2 > stack_index.capacity) {
+				stack_index.release();
+				stack_index.resize(num_stacks ? num_stacks * 4 : INITIAL_STACK_CAPACITY * 2);
+				for (size_t s = 0; s < num_stacks; ++s) {
+					stack_index[find_stack(stacks[s].hash, stacks[s].frames, stacks[s].depth)] = s + 1;
+				}
+			}
+			uint64 hash = hash_stack(frames, depth);
+			size_t slot = find_stack(hash, frames, depth);
+			if (stack_index[slot] != 0) {
+				return stack_index[slot] - 1;
+			}
+			if (num_stacks == stacks.capacity) {
+				stacks.resize(num_stacks ? num_stacks * 2 : INITIAL_STACK_CAPACITY);
+			}
+			StackTrace& s = stacks[num_stacks];
+			s.hash = hash;
+			s.depth = depth;
+			::memcpy(s.frames, frames, depth * sizeof(void*));
+			stack_index[slot] = ++num_stacks;
+			return num_stacks - 1;
+		}
+
+		void unaccount(const LiveAllocation& a) {
+			StackTrace& s = stacks[a.stack];
+			s.live_count -= 1;
+			s.live_bytes -= a.size;
+		}
+
+		void record(void* address, size_t size, void* const* frames, size_t depth) {
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t stack = intern_stack(frames, depth);
+			if ((num_live + 1) * 4 > live.capacity * 3) {
+				grow_live();
+			}
+			size_t slot = find_live(address);
+			if (live[slot].address == address) {
+				// The previous allocation at this address was freed without us seeing it.
+				unaccount(live[slot]);
+			} else {
+				++num_live;
+				filter[filter_slot(address)].fetch_add(1, std::memory_order_relaxed);
+			}
+			live[slot].address = address;
+			live[slot].size = size;
+			live[slot].stack = stack;
+			StackTrace& s = stacks[stack];
+			s.live_count += 1;
+			s.live_bytes += size;
+			s.total_count += 1;
+			s.total_bytes += size;
+		}
+
+		void forget(void* address) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (num_live == 0) return;
+			size_t slot = find_live(address);
+			if (live[slot].address == address) {
+				unaccount(live[slot]);
+				remove_live(slot);
+				--num_live;
+				filter[filter_slot(address)].fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		// Copies out the stacks, so they can be formatted without holding the lock.
+		size_t snapshot_stacks(MappedArray<StackTrace>& out) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (num_stacks) {
+				out.resize(num_stacks);
+				::memcpy(out.data, stacks.data, num_stacks * sizeof(StackTrace));
+			}
+			return num_stacks;
+		}
 	};
-	
-	static const size_t TRACKING_ARENA_SIZE = 1 << 25; // 32 MiB
-	static const size_t LEAKS_PER_ARENA = TRACKING_ARENA_SIZE / sizeof(MemoryLeak);
-	static const size_t NUM_BUCKETS = 128; // 256 KiB/bucket == L2 cache size
-	static const size_t BUCKET_SIZE = TRACKING_ARENA_SIZE / NUM_BUCKETS;
-	static const size_t LEAKS_PER_BUCKET = BUCKET_SIZE / sizeof(MemoryLeak);
-	static const size_t BUCKET_MASK_BITS = (NUM_BUCKETS - 1);
-	
-	static inline MemoryLeak* get_bucket_for_address(MemoryLeak* begin, MemoryLeak* end, void* addr) {
-		uintptr_t p = (uintptr_t)addr;
-		uintptr_t idx = (p & (BUCKET_MASK_BITS << 4)) >> 4;
-		return begin + LEAKS_PER_BUCKET * idx;
-	}
-	
+
 	MemoryTracker::~MemoryTracker() {
 		if (impl) {
-			::munmap(impl->begin, (impl->end - impl->begin) * sizeof(MemoryLeak));
+			impl->~Impl();
 			::free(impl);
 		}
 	}
-	
-	
+
 	void MemoryTracker::ensure_init() {
 		if (impl == nullptr) {
-			impl = (Impl*)malloc(sizeof(MemoryTracker::Impl));
-			new(impl) Impl;
-			impl->begin = (MemoryLeak*)::mmap(nullptr, TRACKING_ARENA_SIZE, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
-			memset(impl->begin, 0, TRACKING_ARENA_SIZE);
-			byte* end = (byte*)impl->begin + TRACKING_ARENA_SIZE;
-			impl->end = (MemoryLeak*)end;
-			impl->is_tracking = false;
-			impl->is_paused = false;
+			Impl* p = (Impl*)malloc(sizeof(MemoryTracker::Impl));
+			new(p) Impl;
+			impl = p;
 		}
 	}
-	
+
 	void MemoryTracker::track_allocation(void *address, size_t size) {
-		if (impl && impl->is_tracking && !impl->is_paused) {
-			MemoryLeak* bucket = get_bucket_for_address(impl->begin, impl->end, address);
-			for (size_t i = 0; i < LEAKS_PER_BUCKET; ++i) {
-				if (bucket[i].address == nullptr) {
-					impl->num_live_allocations++;
-					bucket[i].address = address;
-					bucket[i].size = size;
-					get_backtrace(bucket[i].backtrace, MEMORY_LEAK_BACKTRACE_STEPS, 2);
-					return;
-				} else if (bucket[i].address == address) {
-					bucket[i].address = address;
-					bucket[i].size = size;
-					get_backtrace(bucket[i].backtrace, MEMORY_LEAK_BACKTRACE_STEPS, 2);
-					return;
-				}
-			}
-			ASSERT(false); // Bucket is full! Something is wrong.
+		Impl* p = impl;
+		if (p == nullptr || address == nullptr || !p->is_tracking.load(std::memory_order_relaxed) || p->is_paused.load(std::memory_order_relaxed)) {
+			return;
+		}
+		size_t interval = p->sample_interval.load(std::memory_order_relaxed);
+		if (interval && !should_sample(size, interval)) {
+			return;
 		}
+		void* frames[MEMORY_LEAK_BACKTRACE_STEPS];
+		size_t depth = get_backtrace(frames, MEMORY_LEAK_BACKTRACE_STEPS, 2);
+		p->record(address, size, frames, depth);
 	}
-	
+
 	void MemoryTracker::track_free(void *address) {
 		if (address == nullptr) return;
-		if (impl && impl->is_tracking && !impl->is_paused) {
-			MemoryLeak* bucket = get_bucket_for_address(impl->begin, impl->end, address);
-			for (size_t i = 0; i < LEAKS_PER_BUCKET; ++i) {
-				if (bucket[i].address == address) {
-					ASSERT(impl->num_live_allocations != 0);
-					impl->num_live_allocations--;
-					memset(bucket + i, 0, sizeof(MemoryLeak));
-					return;
-				}
-			}
+		Impl* p = impl;
+		// Frees are honored while paused, so allocations from before the pause don't show up as leaks.
+		if (p && p->is_tracking.load(std::memory_order_relaxed) && p->may_contain(address)) {
+			p->forget(address);
 		}
 	}
-	
+
 	void MemoryTracker::start() {
 		ensure_init();
-		impl->is_tracking = true;
-		if (impl->is_paused) {
+		if (impl->is_tracking && impl->is_paused) {
 			impl->is_paused = false;
-		} else {
-			::memset(impl->begin, 0, TRACKING_ARENA_SIZE);
+			return;
 		}
+		std::lock_guard<std::mutex> lock(impl->mutex);
+		impl->clear();
+		impl->sample_interval = 0;
+		impl->is_paused = false;
+		impl->is_tracking = true;
+	}
+
+	void MemoryTracker::start_sampling(size_t sample_interval) {
+		ensure_init();
+		std::lock_guard<std::mutex> lock(impl->mutex);
+		impl->clear();
+		impl->sample_interval = sample_interval ? sample_interval : 1;
+		impl->is_paused = false;
+		impl->is_tracking = true;
 	}
-	
+
 	void MemoryTracker::pause() {
 		if (impl == nullptr) return;
 		impl->is_paused = true;
 	}
-	
+
 	void MemoryTracker::unpause() {
 		if (impl == nullptr) return;
 		impl->is_paused = false;
 	}
-	
+
 	void MemoryTracker::stop() {
 		if (impl != nullptr) {
 			impl->is_tracking = false;
 			impl->is_paused = false;
 		}
 	}
-	
+
+	bool MemoryTracker::is_sampling() const {
+		return impl && impl->is_tracking && impl->sample_interval != 0;
+	}
+
+	size_t MemoryTracker::sample_interval() const {
+		return impl ? impl->sample_interval.load() : 0;
+	}
+
+	size_t MemoryTracker::num_live_allocations() const {
+		if (impl == nullptr) return 0;
+		std::lock_guard<std::mutex> lock(impl->mutex);
+		return impl->num_live;
+	}
+
 	void MemoryTracker::get_results(Array<MemoryLeak>& out_results) {
 		if (impl == nullptr) return;
-		out_results.reserve(impl->num_live_allocations);
-		for (MemoryLeak* p = impl->begin; p != impl->end; ++p) {
-			if (p->address != nullptr) {
-				out_results.push_back(*p);
+		// out_results may allocate through this tracker, so copy everything out first.
+		MappedArray<MemoryLeak> leaks;
+		size_t n = 0;
+		{
+			std::lock_guard<std::mutex> lock(impl->mutex);
+			if (impl->num_live) {
+				leaks.resize(impl->num_live);
+			}
+			for (size_t i = 0; i < impl->live.capacity; ++i) {
+				LiveAllocation& a = impl->live[i];
+				if (a.address != nullptr) {
+					StackTrace& s = impl->stacks[a.stack];
+					MemoryLeak& leak = leaks[n++];
+					leak.address = a.address;
+					leak.size = a.size;
+					::memcpy(leak.backtrace, s.frames, s.depth * sizeof(void*));
+				}
 			}
 		}
+		out_results.reserve(out_results.size() + n);
+		for (size_t i = 0; i < n; ++i) {
+			out_results.push_back(leaks[i]);
+		}
 	}
-	
+
 	Maybe<MemoryLeak> MemoryTracker::get_allocation(void *ptr) {
-		MemoryLeak* bucket = get_bucket_for_address(impl->begin, impl->end, ptr);
-		for (size_t i = 0; i < LEAKS_PER_BUCKET; ++i) {
-			if (bucket[i].address == ptr) {
-				return bucket[i];
+		if (impl == nullptr) return Nothing;
+		std::lock_guard<std::mutex> lock(impl->mutex);
+		if (impl->num_live == 0) return Nothing;
+		LiveAllocation& a = impl->live[impl->find_live(ptr)];
+		if (a.address != ptr) return Nothing;
+		StackTrace& s = impl->stacks[a.stack];
+		MemoryLeak leak;
+		::memset(&leak, 0, sizeof(leak));
+		leak.address = a.address;
+		leak.size = a.size;
+		::memcpy(leak.backtrace, s.frames, s.depth * sizeof(void*));
+		return leak;
+	}
+
+	void MemoryTracker::write_heap_profile(FormattedStream& out) {
+		MappedArray<StackTrace> stacks;
+		size_t n = impl ? impl->snapshot_stacks(stacks) : 0;
+		size_t interval = sample_interval();
+
+		uint64 live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+		for (size_t i = 0; i < n; ++i) {
+			live_count += stacks[i].live_count;
+			live_bytes += stacks[i].live_bytes;
+			total_count += stacks[i].total_count;
+			total_bytes += stacks[i].total_bytes;
+		}
+		out << "heap profile: " << live_count << ": " << live_bytes << " [" << total_count << ": " << total_bytes << "] @ ";
+		if (interval) {
+			out << "heap_v2/" << (uint64)interval << '\n';
+		} else {
+			out << "heap\n";
+		}
+		for (size_t i = 0; i < n; ++i) {
+			StackTrace& s = stacks[i];
+			out << (uint64)s.live_count << ": " << (uint64)s.live_bytes << " [" << (uint64)s.total_count << ": " << (uint64)s.total_bytes << "] @";
+			for (size_t f = 0; f < s.depth; ++f) {
+				out << ' ' << s.frames[f];
+			}
+			out << '\n';
+		}
+
+#if defined(__linux__)
+		// pprof needs the memory map to symbolize addresses in a position-independent binary.
+		out << "\nMAPPED_LIBRARIES:\n";
+		int fd = ::open("/proc/self/maps", O_RDONLY);
+		if (fd >= 0) {
+			byte buffer[4096];
+			ssize_t r;
+			while ((r = ::read(fd, buffer, sizeof(buffer))) > 0) {
+				out.write(buffer, r);
+			}
+			::close(fd);
+		}
+#endif
+	}
+
+	void MemoryTracker::write_collapsed_stacks(FormattedStream& out) {
+		MappedArray<StackTrace> stacks;
+		size_t n = impl ? impl->snapshot_stacks(stacks) : 0;
+		size_t interval = sample_interval();
+
+		ScratchAllocator scratch;
+		String module(scratch);
+		String symbol(scratch);
+		uint32 offset;
+		for (size_t i = 0; i < n; ++i) {
+			StackTrace& s = stacks[i];
+			if (s.live_count == 0 || s.depth == 0) continue;
+			for (size_t f = s.depth; f > 0; --f) {
+				resolve_symbol(s.frames[f-1], module, symbol, offset);
+				if (f != s.depth) {
+					out << ';';
+				}
+				out << symbol;
 			}
+			out << ' ' << (uint64)unsample_bytes(s.live_count, s.live_bytes, interval) << '\n';
 		}
-		return Nothing;
 	}
 }
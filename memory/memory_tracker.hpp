@@ -15,30 +15,51 @@
 
 namespace grace {
 	class String;
-	
+	class FormattedStream;
+
 	static const size_t MEMORY_LEAK_BACKTRACE_STEPS = 14;
-	
+	static const size_t DEFAULT_HEAP_SAMPLE_INTERVAL = 512 * 1024; // bytes
+
 	struct MemoryLeak {
 		void* address;
 		size_t size;
 		void* backtrace[MEMORY_LEAK_BACKTRACE_STEPS];
 	};
-	
+
 	template <typename T> class Array;
 
+	/*
+	 MemoryTracker records where live allocations came from.
+
+	 start() records every allocation, which is what the leak report in the test runner uses.
+	 start_sampling() records an allocation roughly every sample_interval bytes instead (the
+	 distance between samples is exponentially distributed, so every byte is equally likely
+	 to be picked). That is cheap enough to leave on in production.
+
+	 Either way, allocations are aggregated by call stack, and the profile can be written in
+	 pprof's heap format or as collapsed stacks (one line per stack, for flame graphs).
+	 All functions are thread-safe.
+	*/
 	struct MemoryTracker {
 	public:
 		~MemoryTracker();
 		void track_allocation(void* address, size_t size);
 		void track_free(void* address);
 		void start();
+		void start_sampling(size_t sample_interval = DEFAULT_HEAP_SAMPLE_INTERVAL);
 		void pause();
 		void unpause();
 		void stop();
-		
+
+		bool is_sampling() const;
+		size_t sample_interval() const;
+		size_t num_live_allocations() const; // Recorded allocations, so only the sampled ones when sampling.
+
 		void get_results(Array<MemoryLeak>& out_results);
-		
 		Maybe<MemoryLeak> get_allocation(void* ptr);
+
+		void write_heap_profile(FormattedStream& out); // pprof legacy heap profile (heap_v2).
+		void write_collapsed_stacks(FormattedStream& out); // "outer;inner <live bytes>" lines, using resolve_symbol.
 	private:
 		struct Impl;
 		Impl* impl = nullptr;
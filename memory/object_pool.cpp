@@ -0,0 +1,91 @@
+//
+//  object_pool.cpp
+//  grace
+//
+
+#include "memory/object_pool.hpp"
+
+namespace grace {
+	ObjectPool::ObjectPool(IAllocator& alloc, size_t object_size, size_t alignment) : allocator_(alloc) {
+		if (alignment < alignof(FreeSlot)) {
+			alignment = alignof(FreeSlot);
+		}
+		alignment_ = alignment;
+		slot_size_ = round_up(object_size < sizeof(FreeSlot) ? sizeof(FreeSlot) : object_size, alignment);
+		slots_offset_ = round_up(sizeof(Chunk), alignment);
+		slots_per_chunk_ = TARGET_CHUNK_SIZE / slot_size_;
+		if (slots_per_chunk_ < 1) slots_per_chunk_ = 1;
+		if (slots_per_chunk_ > MAX_SLOTS_PER_CHUNK) slots_per_chunk_ = MAX_SLOTS_PER_CHUNK;
+	}
+
+	void ObjectPool::add_chunk() {
+		Chunk* chunk = (Chunk*)allocator_.allocate(chunk_size(), alignment_);
+		chunk->next = nullptr;
+		chunk->live = 0;
+		if (last_) {
+			last_->next = chunk;
+		} else {
+			first_ = chunk;
+		}
+		last_ = chunk;
+		++num_chunks_;
+
+		// Push in reverse, so that slots are handed out in address order.
+		byte* base = slots(chunk);
+		for (size_t i = slots_per_chunk_; i > 0; --i) {
+			FreeSlot* slot = (FreeSlot*)(base + (i-1) * slot_size_);
+			slot->next = free_list_;
+			slot->chunk = chunk;
+			free_list_ = slot;
+		}
+	}
+
+	void* ObjectPool::allocate() {
+		if (free_list_ == nullptr) {
+			add_chunk();
+		}
+		FreeSlot* slot = free_list_;
+		free_list_ = slot->next;
+		Chunk* chunk = slot->chunk;
+		size_t idx = ((byte*)slot - slots(chunk)) / slot_size_;
+		chunk->live |= uint64(1) << idx;
+		++size_;
+		return slot;
+	}
+
+	void ObjectPool::free(void* ptr) {
+		if (ptr == nullptr) return;
+		byte* p = (byte*)ptr;
+		for (Chunk* chunk = first_; chunk; chunk = chunk->next) {
+			byte* base = slots(chunk);
+			if (p >= base && p < base + slot_size_ * slots_per_chunk_) {
+				size_t idx = (p - base) / slot_size_;
+				ASSERT(base + idx * slot_size_ == p); // Not the start of a slot.
+				ASSERT((chunk->live & (uint64(1) << idx)) != 0); // Double free.
+				chunk->live &= ~(uint64(1) << idx);
+				detail::poison_memory(p, p + slot_size_, detail::FREED_MEMORY_PATTERN);
+				FreeSlot* slot = (FreeSlot*)p;
+				slot->next = free_list_;
+				slot->chunk = chunk;
+				free_list_ = slot;
+				--size_;
+				return;
+			}
+		}
+		ASSERT(false); // ptr is not from this pool.
+	}
+
+	void ObjectPool::clear() {
+		size_t nbytes = chunk_size();
+		Chunk* chunk = first_;
+		while (chunk) {
+			Chunk* next = chunk->next;
+			allocator_.free(chunk, nbytes);
+			chunk = next;
+		}
+		first_ = last_ = nullptr;
+		free_list_ = nullptr;
+		size_ = 0;
+		num_chunks_ = 0;
+	}
+}
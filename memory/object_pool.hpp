@@ -0,0 +1,81 @@
+//
+//  object_pool.hpp
+//  grace
+//
+
+#ifndef grace_object_pool_hpp
+#define grace_object_pool_hpp
+
+#include "memory/allocator.hpp"
+
+namespace grace {
+	/*
+	 ObjectPool hands out fixed-size slots from chunks of up to 64 slots, so that objects of
+	 one type sit next to each other in memory. Freed slots go on a free list and are reused
+	 before a new chunk is allocated.
+
+	 The pool never constructs or destructs anything. clear() releases all chunks at once,
+	 so tearing down a pool costs one free per chunk rather than one per object.
+	*/
+	class ObjectPool {
+	public:
+		static const size_t MAX_SLOTS_PER_CHUNK = 64;
+		static const size_t TARGET_CHUNK_SIZE = 0x4000; // 16 KiB
+
+		ObjectPool(IAllocator& alloc, size_t object_size, size_t alignment);
+		~ObjectPool() { clear(); }
+
+		void* allocate();
+		void free(void* ptr); // Linear in the number of chunks.
+		void clear();
+
+		size_t slot_size() const { return slot_size_; }
+		size_t slots_per_chunk() const { return slots_per_chunk_; }
+		size_t size() const { return size_; }
+		size_t num_chunks() const { return num_chunks_; }
+		IAllocator& allocator() const { return allocator_; }
+
+		// Calls function(void*) for every allocated slot, in chunk order.
+		template <typename Function>
+		void each(Function function) const;
+	private:
+		struct Chunk {
+			Chunk* next;
+			uint64 live; // Bit n is set if slot n is allocated.
+		};
+		struct FreeSlot {
+			FreeSlot* next;
+			Chunk* chunk;
+		};
+
+		IAllocator& allocator_;
+		size_t slot_size_;
+		size_t alignment_;
+		size_t slots_offset_;
+		size_t slots_per_chunk_;
+		Chunk* first_ = nullptr;
+		Chunk* last_ = nullptr;
+		FreeSlot* free_list_ = nullptr;
+		size_t size_ = 0;
+		size_t num_chunks_ = 0;
+
+		ObjectPool(const ObjectPool&) = delete;
+		ObjectPool& operator=(const ObjectPool&) = delete;
+
+		byte* slots(Chunk* chunk) const { return (byte*)chunk + slots_offset_; }
+		size_t chunk_size() const { return slots_offset_ + slot_size_ * slots_per_chunk_; }
+		void add_chunk();
+	};
+
+	template <typename Function>
+	void ObjectPool::each(Function function) const {
+		for (Chunk* chunk = first_; chunk; chunk = chunk->next) {
+			byte* base = slots(chunk);
+			for (uint64 live = chunk->live; live; live &= live - 1) {
+				function((void*)(base + __builtin_ctzll(live) * slot_size_));
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,529 @@
+//
+//  slab_allocator.cpp
+//  grace
+//
+
+#include "memory/slab_allocator.hpp"
+#include "base/exceptions.hpp"
+#include <sys/mman.h>
+#include <stdlib.h>
+
+namespace grace {
+	namespace {
+		static const size_t SLAB_SHIFT = 16;
+		static const size_t SLAB_HEADER_SIZE = 128;
+		static_assert((size_t(1) << SLAB_SHIFT) == SlabAllocator::SLAB_SIZE, "SLAB_SHIFT doesn't match SLAB_SIZE.");
+
+		/*
+		 Maps every slab-aligned address to the SlabAllocator that carved it, so free() can tell slab
+		 objects from base allocations without trusting nbytes. Two levels over a 47-bit address space;
+		 leaves are mapped on demand and never released.
+		*/
+		static const size_t SLAB_MAP_LEAF_BITS = 16;
+		static const size_t SLAB_MAP_LEAF_SIZE = size_t(1) << SLAB_MAP_LEAF_BITS;
+		static const size_t SLAB_MAP_ROOT_SIZE = size_t(1) << (47 - SLAB_SHIFT - SLAB_MAP_LEAF_BITS);
+		typedef const SlabAllocator* SlabMapLeaf[SLAB_MAP_LEAF_SIZE];
+		std::atomic<SlabMapLeaf*> g_slab_map[SLAB_MAP_ROOT_SIZE];
+
+		const SlabAllocator* slab_map_get(const void* ptr) {
+			uintptr_t idx = (uintptr_t)ptr >> SLAB_SHIFT;
+			uintptr_t root = idx >> SLAB_MAP_LEAF_BITS;
+			if (root >= SLAB_MAP_ROOT_SIZE) return nullptr;
+			SlabMapLeaf* leaf = g_slab_map[root].load(std::memory_order_acquire);
+			return leaf ? (*leaf)[idx & (SLAB_MAP_LEAF_SIZE-1)] : nullptr;
+		}
+
+		void slab_map_set(const void* slab, const SlabAllocator* owner) {
+			uintptr_t idx = (uintptr_t)slab >> SLAB_SHIFT;
+			uintptr_t root = idx >> SLAB_MAP_LEAF_BITS;
+			ASSERT(root < SLAB_MAP_ROOT_SIZE);
+			SlabMapLeaf* leaf = g_slab_map[root].load(std::memory_order_acquire);
+			if (leaf == nullptr) {
+				void* mem = ::mmap(nullptr, sizeof(SlabMapLeaf), PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+				if (mem == MAP_FAILED) {
+					throw OutOfMemoryError();
+				}
+				SlabMapLeaf* expected = nullptr;
+				if (g_slab_map[root].compare_exchange_strong(expected, (SlabMapLeaf*)mem, std::memory_order_acq_rel)) {
+					leaf = (SlabMapLeaf*)mem;
+				} else {
+					::munmap(mem, sizeof(SlabMapLeaf));
+					leaf = expected;
+				}
+			}
+			(*leaf)[idx & (SLAB_MAP_LEAF_SIZE-1)] = owner;
+		}
+
+		std::atomic<size_t> g_next_slab_allocator_id(1);
+
+		// Base allocations carry their size right below the pointer handed out, since free() can't trust
+		// nbytes. offset is where the pointer is in the base allocation, which is at least the alignment.
+		struct BaseHeader {
+			size_t size;
+			size_t offset;
+		};
+
+		size_t base_alignment(size_t alignment) {
+			return alignment > alignof(BaseHeader) ? alignment : alignof(BaseHeader);
+		}
+
+		size_t base_header_offset(size_t alignment) {
+			return round_up<size_t>(sizeof(BaseHeader), base_alignment(alignment));
+		}
+
+		BaseHeader* base_header(void* ptr) {
+			return (BaseHeader*)ptr - 1;
+		}
+
+		// One-entry cache in front of pthread_getspecific.
+		struct LastThreadCache {
+			size_t allocator_id;
+			void* cache;
+		};
+		THREAD_LOCAL LastThreadCache t_last_thread_cache = {0, nullptr};
+	}
+
+	struct SlabAllocator::Slab {
+		std::atomic<ThreadCache*> owner; // nullptr while abandoned or unused.
+		Slab* next = nullptr;
+		Slab* previous = nullptr;
+		size_t size_class = 0;
+		size_t object_size = 0;
+
+		// Only touched by the owning thread:
+		void* free_list = nullptr;
+		byte* bump = nullptr; // Start of the part of the slab that has never been handed out.
+		byte* end = nullptr;
+		size_t num_used = 0;  // Includes objects freed by other threads that haven't been collected yet.
+		bool is_full = false;
+
+		std::atomic<void*> remote_free; // Objects freed by other threads.
+
+		Slab() : owner(nullptr), remote_free(nullptr) {}
+
+		static Slab* of(const void* ptr) { return (Slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE-1)); }
+		byte* objects() { return (byte*)this + SLAB_HEADER_SIZE; }
+		bool has_space() const { return free_list != nullptr || bump != end; }
+
+		void reset() {
+			free_list = nullptr;
+			bump = end = objects();
+			num_used = 0;
+			is_full = false;
+			owner.store(nullptr, std::memory_order_relaxed);
+		}
+
+		void format(size_t cls) {
+			size_class = cls;
+			object_size = size_of_class(cls);
+			free_list = nullptr;
+			bump = objects();
+			end = bump + ((SLAB_SIZE - SLAB_HEADER_SIZE) / object_size) * object_size;
+			num_used = 0;
+			is_full = false;
+		}
+
+		// Take back everything other threads have freed in one go.
+		void collect_remote_frees() {
+			void* list = remote_free.exchange(nullptr, std::memory_order_acquire);
+			while (list != nullptr) {
+				void* next_object = *(void**)list;
+				*(void**)list = free_list;
+				free_list = list;
+				--num_used;
+				list = next_object;
+			}
+		}
+	};
+
+	struct SlabAllocator::ThreadCache {
+		SlabAllocator* allocator;
+		ThreadCache* next = nullptr;
+		ThreadCache* previous = nullptr;
+		Slab* available[NUM_SIZE_CLASSES]; // Head is the slab currently allocated from.
+		Slab* full[NUM_SIZE_CLASSES];
+		size_t num_full[NUM_SIZE_CLASSES];
+		size_t misses_since_sweep[NUM_SIZE_CLASSES];
+		std::atomic<ptrdiff_t> usage; // Only written by the owning thread, read by usage().
+
+		explicit ThreadCache(SlabAllocator* a) : allocator(a), usage(0) {
+			for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+				available[i] = nullptr;
+				full[i] = nullptr;
+				num_full[i] = 0;
+				misses_since_sweep[i] = 0;
+			}
+		}
+
+		void add_usage(ptrdiff_t delta) {
+			usage.store(usage.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+		}
+	};
+
+	struct SlabAllocator::Chunk {
+		Chunk* next;
+		void* memory;
+		size_t size;
+	};
+
+	namespace {
+		template <typename T>
+		void link_front(T*& head, T* x) {
+			x->previous = nullptr;
+			x->next = head;
+			if (head) head->previous = x;
+			head = x;
+		}
+
+		template <typename T>
+		void unlink(T*& head, T* x) {
+			if (x->previous) x->previous->next = x->next;
+			else head = x->next;
+			if (x->next) x->next->previous = x->previous;
+			x->next = x->previous = nullptr;
+		}
+	}
+
+	size_t SlabAllocator::size_class_for(size_t nbytes) {
+		ASSERT(nbytes <= MAX_SMALL_SIZE);
+		if (nbytes <= 128) {
+			return nbytes ? (nbytes - 1) >> 4 : 0;
+		}
+		size_t n = nbytes - 1;
+		size_t log2 = 63 - __builtin_clzll(n);
+		return 8 + (log2 - 7) * 4 + ((n >> (log2 - 2)) - 4);
+	}
+
+	size_t SlabAllocator::size_of_class(size_t cls) {
+		ASSERT(cls < NUM_SIZE_CLASSES);
+		if (cls < 8) {
+			return (cls + 1) * 16;
+		}
+		size_t k = cls - 8;
+		size_t log2 = 7 + k / 4;
+		return (5 + k % 4) << (log2 - 2);
+	}
+
+	SlabAllocator::SlabAllocator(IAllocator& base) : base_(base), id_(g_next_slab_allocator_id++) {
+		for (auto& s: abandoned_slabs_) {
+			s = nullptr;
+		}
+		pthread_key_create(&cache_key_, destroy_thread_cache);
+	}
+
+	SlabAllocator::~SlabAllocator() {
+		// Threads that are still running lose their caches without notice.
+		pthread_key_delete(cache_key_);
+		if (t_last_thread_cache.allocator_id == id_) {
+			t_last_thread_cache = {0, nullptr};
+		}
+		while (caches_) {
+			ThreadCache* c = caches_;
+			caches_ = c->next;
+			c->~ThreadCache();
+			::free(c);
+		}
+		while (chunks_) {
+			Chunk* c = chunks_;
+			chunks_ = c->next;
+			byte* end = (byte*)c->memory + c->size;
+			for (byte* p = (byte*)round_up<uintptr_t>((uintptr_t)c->memory, SLAB_SIZE); p + SLAB_SIZE <= end; p += SLAB_SIZE) {
+				slab_map_set(p, nullptr);
+			}
+			base_.free_large(c->memory, c->size);
+			::free(c);
+		}
+	}
+
+	bool SlabAllocator::owns(const void* ptr) const {
+		return ptr != nullptr && slab_map_get(ptr) == this;
+	}
+
+	size_t SlabAllocator::allocation_size(const void* ptr) const {
+		ASSERT(owns(ptr));
+		return Slab::of(ptr)->object_size;
+	}
+
+	size_t SlabAllocator::num_slabs() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return num_slabs_;
+	}
+
+	size_t SlabAllocator::usage() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		ptrdiff_t sum = exited_usage_;
+		for (ThreadCache* c = caches_; c; c = c->next) {
+			sum += c->usage.load(std::memory_order_relaxed);
+		}
+		return sum;
+	}
+
+	SlabAllocator::ThreadCache* SlabAllocator::find_thread_cache() const {
+		if (t_last_thread_cache.allocator_id == id_) {
+			return (ThreadCache*)t_last_thread_cache.cache;
+		}
+		ThreadCache* cache = (ThreadCache*)pthread_getspecific(cache_key_);
+		if (cache) {
+			t_last_thread_cache = {id_, cache};
+		}
+		return cache;
+	}
+
+	SlabAllocator::ThreadCache& SlabAllocator::thread_cache() {
+		ThreadCache* cache = find_thread_cache();
+		if (cache == nullptr) {
+			// Bypass operator new, which may well be us.
+			void* mem = ::malloc(sizeof(ThreadCache));
+			if (mem == nullptr) {
+				throw OutOfMemoryError();
+			}
+			cache = new(mem) ThreadCache(this);
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				link_front(caches_, cache);
+			}
+			pthread_setspecific(cache_key_, cache);
+			t_last_thread_cache = {id_, cache};
+		}
+		return *cache;
+	}
+
+	void SlabAllocator::destroy_thread_cache(void* p) {
+		ThreadCache* cache = static_cast<ThreadCache*>(p);
+		cache->allocator->retire_thread_cache(cache);
+	}
+
+	void SlabAllocator::retire_thread_cache(ThreadCache* cache) {
+		if (t_last_thread_cache.cache == cache) {
+			t_last_thread_cache = {0, nullptr};
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (size_t cls = 0; cls < NUM_SIZE_CLASSES; ++cls) {
+			for (Slab** list: {&cache->available[cls], &cache->full[cls]}) {
+				while (*list) {
+					Slab* s = *list;
+					unlink(*list, s);
+					s->collect_remote_frees();
+					if (s->num_used == 0) {
+						s->reset();
+						link_front(free_slabs_, s);
+					} else {
+						// Objects in it are still live. Leave it for the next thread that needs this size class.
+						s->is_full = false;
+						s->owner.store(nullptr, std::memory_order_release);
+						link_front(abandoned_slabs_[cls], s);
+					}
+				}
+			}
+		}
+		exited_usage_ += cache->usage.load(std::memory_order_relaxed);
+		unlink(caches_, cache);
+		cache->~ThreadCache();
+		::free(cache);
+	}
+
+	void* SlabAllocator::allocate(size_t nbytes, size_t alignment) {
+		if (nbytes == 0) return nullptr;
+		ThreadCache& cache = thread_cache();
+		if (!is_small(nbytes, alignment)) {
+			size_t offset = base_header_offset(alignment);
+			byte* ptr = (byte*)base_.allocate(nbytes + offset, base_alignment(alignment)) + offset;
+			base_header(ptr)->size = nbytes;
+			base_header(ptr)->offset = offset;
+			cache.add_usage(nbytes);
+			return ptr;
+		}
+		return allocate_small(cache, size_class_for(nbytes));
+	}
+
+	void* SlabAllocator::allocate_small(ThreadCache& cache, size_t cls) {
+		Slab* s = cache.available[cls];
+		if (s == nullptr || !s->has_space()) {
+			s = refill(cache, cls);
+		}
+		void* ptr;
+		if (s->free_list) {
+			ptr = s->free_list;
+			s->free_list = *(void**)ptr;
+		} else {
+			ptr = s->bump;
+			s->bump += s->object_size;
+		}
+		++s->num_used;
+		cache.add_usage(s->object_size);
+		detail::poison_memory((byte*)ptr, (byte*)ptr + s->object_size, detail::UNINITIALIZED_MEMORY_PATTERN);
+		return ptr;
+	}
+
+	SlabAllocator::Slab* SlabAllocator::refill(ThreadCache& cache, size_t cls) {
+		Slab*& available = cache.available[cls];
+		while (available) {
+			Slab* s = available;
+			s->collect_remote_frees();
+			if (s->has_space()) {
+				return s;
+			}
+			unlink(available, s);
+			s->is_full = true;
+			link_front(cache.full[cls], s);
+			++cache.num_full[cls];
+		}
+
+		// Full slabs only regain space through remote frees. Sweeping them on every miss would be
+		// quadratic, so only sweep once per num_full/8 misses.
+		if (++cache.misses_since_sweep[cls] * 8 >= cache.num_full[cls]) {
+			cache.misses_since_sweep[cls] = 0;
+			Slab* s = cache.full[cls];
+			while (s) {
+				Slab* next = s->next;
+				if (s->remote_free.load(std::memory_order_relaxed) != nullptr) {
+					s->collect_remote_frees();
+					unlink(cache.full[cls], s);
+					--cache.num_full[cls];
+					s->is_full = false;
+					link_front(available, s);
+				}
+				s = next;
+			}
+			if (available) {
+				return available;
+			}
+		}
+
+		Slab* s = take_slab(cache, cls);
+		link_front(available, s);
+		return s;
+	}
+
+	SlabAllocator::Slab* SlabAllocator::take_slab(ThreadCache& cache, size_t cls) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		while (abandoned_slabs_[cls]) {
+			Slab* s = abandoned_slabs_[cls];
+			unlink(abandoned_slabs_[cls], s);
+			s->owner.store(&cache, std::memory_order_relaxed);
+			s->collect_remote_frees();
+			if (s->has_space()) {
+				return s;
+			}
+			s->is_full = true;
+			link_front(cache.full[cls], s);
+			++cache.num_full[cls];
+		}
+		if (free_slabs_ == nullptr) {
+			carve_chunk();
+		}
+		Slab* s = free_slabs_;
+		unlink(free_slabs_, s);
+		s->format(cls);
+		s->owner.store(&cache, std::memory_order_relaxed);
+		return s;
+	}
+
+	void SlabAllocator::release_slab(ThreadCache& cache, Slab* s) {
+		unlink(cache.available[s->size_class], s);
+		std::lock_guard<std::mutex> lock(mutex_);
+		s->reset();
+		link_front(free_slabs_, s);
+	}
+
+	void SlabAllocator::carve_chunk() {
+		static_assert(sizeof(Slab) <= SLAB_HEADER_SIZE, "Slab header doesn't fit.");
+		size_t actual_size;
+		byte* memory = (byte*)base_.allocate_large(SLAB_SIZE * (SLABS_PER_CHUNK + 1), SLAB_SIZE, actual_size);
+		Chunk* chunk = (Chunk*)::malloc(sizeof(Chunk));
+		if (chunk == nullptr) {
+			base_.free_large(memory, actual_size);
+			throw OutOfMemoryError();
+		}
+		chunk->memory = memory;
+		chunk->size = actual_size;
+		chunk->next = chunks_;
+		chunks_ = chunk;
+
+		byte* slab = (byte*)round_up<uintptr_t>((uintptr_t)memory, SLAB_SIZE);
+		for (; slab + SLAB_SIZE <= memory + actual_size; slab += SLAB_SIZE) {
+			Slab* s = new(slab) Slab;
+			s->reset();
+			slab_map_set(s, this);
+			link_front(free_slabs_, s);
+			++num_slabs_;
+		}
+	}
+
+	void SlabAllocator::free(void* ptr, size_t nbytes) {
+		if (ptr == nullptr) return;
+		if (!owns(ptr)) {
+			BaseHeader header = *base_header(ptr);
+			thread_cache().add_usage(-(ptrdiff_t)header.size);
+			base_.free((byte*)ptr - header.offset, header.size + header.offset);
+			return;
+		}
+		free_small(Slab::of(ptr), ptr);
+	}
+
+	void SlabAllocator::free_small(Slab* s, void* ptr) {
+		ThreadCache& cache = thread_cache();
+		detail::poison_memory((byte*)ptr, (byte*)ptr + s->object_size, detail::FREED_MEMORY_PATTERN);
+		cache.add_usage(-(ptrdiff_t)s->object_size);
+
+		if (s->owner.load(std::memory_order_relaxed) == &cache) {
+			*(void**)ptr = s->free_list;
+			s->free_list = ptr;
+			--s->num_used;
+			if (s->is_full) {
+				unlink(cache.full[s->size_class], s);
+				--cache.num_full[s->size_class];
+				s->is_full = false;
+				link_front(cache.available[s->size_class], s);
+			} else if (s->num_used == 0 && s != cache.available[s->size_class]) {
+				release_slab(cache, s);
+			}
+		} else {
+			void* head = s->remote_free.load(std::memory_order_relaxed);
+			do {
+				*(void**)ptr = head;
+			} while (!s->remote_free.compare_exchange_weak(head, ptr, std::memory_order_release, std::memory_order_relaxed));
+		}
+	}
+
+	void* SlabAllocator::reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment) {
+		if (ptr == nullptr) {
+			return allocate(new_size, alignment);
+		}
+		if (!owns(ptr)) {
+			BaseHeader header = *base_header(ptr);
+			if (header.offset != base_header_offset(alignment)) {
+				// The pointer would end up at a different offset, so the base allocator can't move it for us.
+				void* new_ptr = allocate(new_size, alignment);
+				::memcpy(new_ptr, ptr, header.size < new_size ? header.size : new_size);
+				free(ptr, header.size);
+				return new_ptr;
+			}
+			byte* new_ptr = (byte*)base_.reallocate((byte*)ptr - header.offset, header.size + header.offset, new_size + header.offset, base_alignment(alignment)) + header.offset;
+			base_header(new_ptr)->size = new_size;
+			thread_cache().add_usage((ptrdiff_t)new_size - (ptrdiff_t)header.size);
+			return new_ptr;
+		}
+		size_t current_size = allocation_size(ptr);
+		if (new_size <= current_size && alignment <= SMALL_ALIGNMENT) {
+			return ptr;
+		}
+		void* new_ptr = allocate(new_size, alignment);
+		size_t n = old_size < current_size ? old_size : current_size;
+		::memcpy(new_ptr, ptr, n < new_size ? n : new_size);
+		free_small(Slab::of(ptr), ptr);
+		return new_ptr;
+	}
+
+	void* SlabAllocator::allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) {
+		return base_.allocate_large(nbytes, alignment, out_actually_allocated);
+	}
+
+	void SlabAllocator::free_large(void* ptr, size_t actual_size) {
+		base_.free_large(ptr, actual_size);
+	}
+	
+	void* SlabAllocator::reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated) {
+		return base_.reallocate_large(ptr, old_actual_size, nbytes, alignment, out_actually_allocated);
+	}
+}
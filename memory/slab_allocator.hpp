@@ -0,0 +1,86 @@
+//
+//  slab_allocator.hpp
+//  grace
+//
+
+#ifndef grace_slab_allocator_hpp
+#define grace_slab_allocator_hpp
+
+#include "memory/allocator.hpp"
+#include <mutex>
+#include <pthread.h>
+
+namespace grace {
+	/*
+	 SlabAllocator serves small objects from 64 KiB slabs, each holding objects of one size class.
+	 Slabs are carved from the base allocator with allocate_large, 16 at a time.
+
+	 Every thread allocates from, and frees into, the slabs it owns without taking any locks.
+	 Objects freed by other threads are pushed onto a lock-free list in their slab, which the
+	 owning thread takes back in one batch the next time it runs out of space. Slabs owned by
+	 a thread that exits are handed to the next thread that needs a slab of that size class.
+
+	 Requests above MAX_SMALL_SIZE, or with alignment above SMALL_ALIGNMENT, go straight to
+	 the base allocator, with a small header recording their size. free() finds out which is
+	 which from the pointer and takes sizes from the slab or the header, so nbytes may be
+	 inaccurate (as with destroy() on polymorphic objects).
+	*/
+	class SlabAllocator : public IAllocator {
+	public:
+		static const size_t SLAB_SIZE = 0x10000; // 64 KiB
+		static const size_t SLABS_PER_CHUNK = 16;
+		static const size_t MAX_SMALL_SIZE = 2048;
+		static const size_t SMALL_ALIGNMENT = 16;
+		static const size_t NUM_SIZE_CLASSES = 24; // 16..128 in steps of 16, then four per power of two.
+
+		explicit SlabAllocator(IAllocator& base);
+		~SlabAllocator();
+
+		void* allocate(size_t nbytes, size_t alignment) final;
+		void* reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment) final;
+		void free(void* ptr, size_t nbytes) final;
+		void* allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
+		void free_large(void* ptr, size_t actual_size) final;
+		void* reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
+
+		size_t usage() const final;
+		size_t capacity() const final { return base_.capacity(); }
+
+		bool owns(const void* ptr) const;
+		size_t allocation_size(const void* ptr) const; // Size class of an object owned by this allocator.
+		size_t num_slabs() const; // Slabs carved so far, including empty ones.
+
+		static bool is_small(size_t nbytes, size_t alignment) { return nbytes <= MAX_SMALL_SIZE && alignment <= SMALL_ALIGNMENT; }
+		static size_t size_class_for(size_t nbytes);
+		static size_t size_of_class(size_t size_class);
+	private:
+		struct Slab;
+		struct ThreadCache;
+		struct Chunk;
+
+		IAllocator& base_;
+		size_t id_;
+		pthread_key_t cache_key_;
+		mutable std::mutex mutex_;
+		Chunk* chunks_ = nullptr;
+		Slab* free_slabs_ = nullptr;
+		Slab* abandoned_slabs_[NUM_SIZE_CLASSES];
+		ThreadCache* caches_ = nullptr;
+		size_t num_slabs_ = 0;
+		ptrdiff_t exited_usage_ = 0;
+
+		ThreadCache* find_thread_cache() const;
+		ThreadCache& thread_cache();
+		static void destroy_thread_cache(void* cache);
+		void retire_thread_cache(ThreadCache* cache);
+
+		void* allocate_small(ThreadCache& cache, size_t size_class);
+		void free_small(Slab* slab, void* ptr);
+		Slab* refill(ThreadCache& cache, size_t size_class);
+		Slab* take_slab(ThreadCache& cache, size_t size_class);
+		void release_slab(ThreadCache& cache, Slab* slab);
+		void carve_chunk();
+	};
+}
+
+#endif
@@ -0,0 +1,181 @@
+//
+//  stats_allocator.cpp
+//  grace
+//
+
+#include "memory/stats_allocator.hpp"
+#include "io/formatted_stream.hpp"
+#include "io/formatters.hpp"
+
+namespace grace {
+	namespace {
+		std::atomic<uint32> g_next_stats_stripe(0);
+		THREAD_LOCAL uint32 t_stats_stripe = 0; // 0 means not assigned yet, otherwise stripe+1.
+
+		template <typename T>
+		inline void bump(std::atomic<T>& counter, T n) {
+			// Every stripe mostly has one writer, so this is rarely contended.
+			counter.fetch_add(n, std::memory_order_relaxed);
+		}
+	}
+
+	size_t AllocatorStats::size_bucket_for(size_t nbytes) {
+		size_t bucket = 0;
+		while (nbytes > 1 && bucket < NUM_SIZE_BUCKETS - 1) {
+			nbytes >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+
+	void AllocatorStats::write_report(FormattedStream& out) const {
+		out << "allocations: " << num_allocations << ", frees: " << num_frees << ", reallocations: " << num_reallocations << '\n';
+		out << "allocated: " << format_data_size(bytes_allocated) << ", freed: " << format_data_size(bytes_freed) << '\n';
+		out << "in flight: " << format_data_size(bytes_in_flight) << ", peak: " << format_data_size(peak_bytes_in_flight) << '\n';
+		out << "copied by reallocate: " << format_data_size(realloc_copy_bytes) << '\n';
+		out << "allocation sizes:\n";
+		for (size_t i = 0; i < NUM_SIZE_BUCKETS; ++i) {
+			if (size_histogram[i] == 0) continue;
+			out << "  " << format_data_size(size_t(1) << i);
+			if (i == NUM_SIZE_BUCKETS - 1) {
+				out << " and up";
+			}
+			out << ": " << size_histogram[i] << '\n';
+		}
+	}
+
+	StatsAllocator::StatsAllocator(IAllocator& base) : base_(base) {
+		for (auto& s: stripes_) {
+			std::atomic_init<uint64>(&s.num_allocations, 0);
+			std::atomic_init<uint64>(&s.num_frees, 0);
+			std::atomic_init<uint64>(&s.num_reallocations, 0);
+			std::atomic_init<uint64>(&s.bytes_allocated, 0);
+			std::atomic_init<uint64>(&s.bytes_freed, 0);
+			std::atomic_init<uint64>(&s.realloc_copy_bytes, 0);
+			std::atomic_init<int64>(&s.unpublished_bytes, 0);
+			for (auto& h: s.size_histogram) {
+				std::atomic_init<uint64>(&h, 0);
+			}
+		}
+		std::atomic_init<int64>(&in_flight_, 0);
+		std::atomic_init<int64>(&peak_, 0);
+	}
+
+	StatsAllocator::Stripe& StatsAllocator::stripe() {
+		uint32 n = t_stats_stripe;
+		if (n == 0) {
+			n = g_next_stats_stripe.fetch_add(1) % NUM_STRIPES + 1;
+			t_stats_stripe = n;
+		}
+		return stripes_[n - 1];
+	}
+
+	void StatsAllocator::count_allocation(Stripe& s, size_t nbytes) {
+		bump<uint64>(s.num_allocations, 1);
+		bump<uint64>(s.bytes_allocated, nbytes);
+		bump<uint64>(s.size_histogram[AllocatorStats::size_bucket_for(nbytes)], 1);
+		publish(s, (int64)nbytes);
+	}
+
+	void StatsAllocator::count_free(Stripe& s, size_t nbytes) {
+		bump<uint64>(s.num_frees, 1);
+		bump<uint64>(s.bytes_freed, nbytes);
+		publish(s, -(int64)nbytes);
+	}
+
+	void StatsAllocator::publish(Stripe& s, int64 delta) {
+		int64 pending = s.unpublished_bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+		if (pending < (int64)PEAK_GRANULARITY && pending > -(int64)PEAK_GRANULARITY) {
+			return;
+		}
+		pending = s.unpublished_bytes.exchange(0, std::memory_order_relaxed);
+		int64 now = in_flight_.fetch_add(pending, std::memory_order_relaxed) + pending;
+		int64 peak = peak_.load(std::memory_order_relaxed);
+		while (now > peak && !peak_.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+	}
+
+	void* StatsAllocator::allocate(size_t nbytes, size_t alignment) {
+		void* ptr = base_.allocate(nbytes, alignment);
+		count_allocation(stripe(), nbytes);
+		return ptr;
+	}
+
+	void* StatsAllocator::reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment) {
+		void* result = base_.reallocate(ptr, old_size, new_size, alignment);
+		Stripe& s = stripe();
+		if (ptr == nullptr) {
+			count_allocation(s, new_size);
+			return result;
+		}
+		bump<uint64>(s.num_reallocations, 1);
+		bump<uint64>(s.size_histogram[AllocatorStats::size_bucket_for(new_size)], 1);
+		if (result != ptr) {
+			bump<uint64>(s.realloc_copy_bytes, old_size < new_size ? old_size : new_size);
+		}
+		if (new_size > old_size) {
+			bump<uint64>(s.bytes_allocated, new_size - old_size);
+		} else {
+			bump<uint64>(s.bytes_freed, old_size - new_size);
+		}
+		publish(s, (int64)new_size - (int64)old_size);
+		return result;
+	}
+
+	void StatsAllocator::free(void* ptr, size_t nbytes) {
+		if (ptr == nullptr) return;
+		base_.free(ptr, nbytes);
+		count_free(stripe(), nbytes);
+	}
+
+	void* StatsAllocator::allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) {
+		void* ptr = base_.allocate_large(nbytes, alignment, out_actually_allocated);
+		count_allocation(stripe(), out_actually_allocated);
+		return ptr;
+	}
+
+	void StatsAllocator::free_large(void* ptr, size_t actual_size) {
+		if (ptr == nullptr) return;
+		base_.free_large(ptr, actual_size);
+		count_free(stripe(), actual_size);
+	}
+
+	void* StatsAllocator::reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated) {
+		void* result = base_.reallocate_large(ptr, old_actual_size, nbytes, alignment, out_actually_allocated);
+		Stripe& s = stripe();
+		if (ptr == nullptr) {
+			count_allocation(s, out_actually_allocated);
+			return result;
+		}
+		bump<uint64>(s.num_reallocations, 1);
+		bump<uint64>(s.size_histogram[AllocatorStats::size_bucket_for(out_actually_allocated)], 1);
+		if (out_actually_allocated > old_actual_size) {
+			bump<uint64>(s.bytes_allocated, out_actually_allocated - old_actual_size);
+		} else {
+			bump<uint64>(s.bytes_freed, old_actual_size - out_actually_allocated);
+		}
+		publish(s, (int64)out_actually_allocated - (int64)old_actual_size);
+		return result;
+	}
+
+	AllocatorStats StatsAllocator::stats() const {
+		AllocatorStats result;
+		int64 unpublished = 0;
+		for (auto& s: stripes_) {
+			result.num_allocations += s.num_allocations.load(std::memory_order_relaxed);
+			result.num_frees += s.num_frees.load(std::memory_order_relaxed);
+			result.num_reallocations += s.num_reallocations.load(std::memory_order_relaxed);
+			result.bytes_allocated += s.bytes_allocated.load(std::memory_order_relaxed);
+			result.bytes_freed += s.bytes_freed.load(std::memory_order_relaxed);
+			result.realloc_copy_bytes += s.realloc_copy_bytes.load(std::memory_order_relaxed);
+			unpublished += s.unpublished_bytes.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < AllocatorStats::NUM_SIZE_BUCKETS; ++i) {
+				result.size_histogram[i] += s.size_histogram[i].load(std::memory_order_relaxed);
+			}
+		}
+		int64 in_flight = in_flight_.load(std::memory_order_relaxed) + unpublished;
+		int64 peak = peak_.load(std::memory_order_relaxed);
+		result.bytes_in_flight = in_flight > 0 ? (uint64)in_flight : 0;
+		result.peak_bytes_in_flight = (uint64)(peak > in_flight ? peak : in_flight);
+		return result;
+	}
+}
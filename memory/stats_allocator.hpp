@@ -0,0 +1,83 @@
+//
+//  stats_allocator.hpp
+//  grace
+//
+
+#ifndef grace_stats_allocator_hpp
+#define grace_stats_allocator_hpp
+
+#include "memory/allocator.hpp"
+
+namespace grace {
+	class FormattedStream;
+
+	struct AllocatorStats {
+		static const size_t NUM_SIZE_BUCKETS = 32; // Bucket n counts sizes in [2^n, 2^(n+1)), the last one everything above.
+
+		uint64 num_allocations = 0;
+		uint64 num_frees = 0;
+		uint64 num_reallocations = 0;
+		uint64 bytes_allocated = 0;     // Total over the lifetime of the allocator.
+		uint64 bytes_freed = 0;
+		uint64 bytes_in_flight = 0;
+		uint64 peak_bytes_in_flight = 0;
+		uint64 realloc_copy_bytes = 0;  // Bytes moved by reallocations that couldn't resize in place.
+		uint64 size_histogram[NUM_SIZE_BUCKETS] = {0};
+
+		static size_t size_bucket_for(size_t nbytes);
+		void write_report(FormattedStream& out) const;
+	};
+
+	/*
+	 StatsAllocator counts what passes through it on the way to another allocator, so that
+	 any subsystem can be measured by handing it a StatsAllocator instead of its usual one.
+
+	 Threads count into their own stripe of counters, and stats() adds the stripes up.
+	 Bytes in flight are published to a shared peak whenever a stripe has drifted by more
+	 than PEAK_GRANULARITY, so peak_bytes_in_flight may be off by that much per stripe.
+	*/
+	class StatsAllocator : public IAllocator {
+	public:
+		static const size_t NUM_STRIPES = 16;
+		static const size_t PEAK_GRANULARITY = 0x10000; // 64 KiB
+
+		explicit StatsAllocator(IAllocator& base);
+
+		void* allocate(size_t nbytes, size_t alignment) final;
+		void* reallocate(void* ptr, size_t old_size, size_t new_size, size_t alignment) final;
+		void free(void* ptr, size_t nbytes) final;
+		void* allocate_large(size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
+		void free_large(void* ptr, size_t actual_size) final;
+		void* reallocate_large(void* ptr, size_t old_actual_size, size_t nbytes, size_t alignment, size_t& out_actually_allocated) final;
+
+		size_t usage() const final { return base_.usage(); }
+		size_t capacity() const final { return base_.capacity(); }
+
+		IAllocator& base() const { return base_; }
+		AllocatorStats stats() const;
+		void write_report(FormattedStream& out) const { stats().write_report(out); }
+	private:
+		struct ALIGNED(64) Stripe {
+			std::atomic<uint64> num_allocations;
+			std::atomic<uint64> num_frees;
+			std::atomic<uint64> num_reallocations;
+			std::atomic<uint64> bytes_allocated;
+			std::atomic<uint64> bytes_freed;
+			std::atomic<uint64> realloc_copy_bytes;
+			std::atomic<int64> unpublished_bytes; // Change in bytes in flight not yet added to in_flight_.
+			std::atomic<uint64> size_histogram[AllocatorStats::NUM_SIZE_BUCKETS];
+		};
+
+		IAllocator& base_;
+		Stripe stripes_[NUM_STRIPES];
+		std::atomic<int64> in_flight_;
+		std::atomic<int64> peak_;
+
+		Stripe& stripe();
+		void count_allocation(Stripe& s, size_t nbytes);
+		void count_free(Stripe& s, size_t nbytes);
+		void publish(Stripe& s, int64 delta);
+	};
+}
+
+#endif
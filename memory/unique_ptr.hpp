@@ -10,6 +10,7 @@
 #define grace_unique_ptr_hpp
 
 #include "base/basic.hpp"
+#include "base/type_traits.hpp"
 #include "memory/allocator.hpp"
 
 namespace grace {
@@ -40,11 +41,13 @@ namespace grace {
 		template <typename U>
 		typename std::enable_if<!std::is_same<T, U>::value && std::is_assignable<T*, U*>::value, UniquePtr<T>>::type&
 		operator=(UniquePtr<U>&& other) {
-			reset(*other.alloc_, other.release());
+			IAllocator* alloc = other.alloc_; // release() clears it, and argument order is unspecified
+			reset(alloc, other.release());
 			return *this;
 		}
 		UniquePtr<T>& operator=(UniquePtr<T>&& other) {
-			reset(*other.alloc_, other.release());
+			IAllocator* alloc = other.alloc_; // release() clears it, and argument order is unspecified
+			reset(alloc, other.release());
 			return *this;
 		}
 		bool operator==(T* b) const { return get() == b; }
@@ -93,6 +96,10 @@ namespace grace {
 		}
 	};
 	
+	template <typename T> struct IsTriviallyRelocatable<UniquePtr<T>> {
+		static const bool Value = true;
+	};
+	
 	template <typename T, typename... Args>
 	UniquePtr<T> make_unique(IAllocator& alloc, Args&&... args) {
 		return UniquePtr<T>(&alloc, new(alloc) T(std::forward<Args>(args)...));
@@ -222,7 +222,7 @@ void CompositeType::serialize_raw(const byte* place, DocumentNode& node, IUniver
 		}
 	}
 	
-	StringRef ExposedSlot::name() const {
+	Symbol ExposedSlot::name() const {
 		return slot_->name();
 	}
 	
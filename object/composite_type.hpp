@@ -5,6 +5,7 @@
 #include "type/structured_type.hpp"
 #include "serialization/document.hpp"
 #include "base/array.hpp"
+#include "base/small_array.hpp"
 #include "object/object_type_base.hpp"
 #include "type/attribute.hpp"
 #include <new>
@@ -14,7 +15,7 @@ namespace grace {
 struct ExposedAttribute : public IAttribute {
 	// IAttribute interface
 	const IType* type() const final { return attribute_->type(); }
-	StringRef name() const final { return attribute_->name(); }
+	Symbol name() const final { return attribute_->name(); }
 	StringRef description() const final { return attribute_->description(); }
 	Any get_any(const Object* object) const final;
 	Any get_any(Object* object) const final;
@@ -37,7 +38,7 @@ private:
 	
 	struct ExposedSlot : public ISlot {
 		// ISlot interface
-		StringRef name() const final;
+		Symbol name() const final;
 		StringRef description() const final;
 		Array<const IType*> signature(IAllocator& alloc) const final;
 		bool invoke(ObjectPtr<> receiver, ArrayRef<Any> args) const final;
@@ -104,7 +105,7 @@ public:
 private:
 	const ObjectTypeBase* base_type_;
 	String name_;
-	Array<const StructuredType*> aspects_; // TODO: Consider ownership
+	SmallArray<const StructuredType*, 4> aspects_; // TODO: Consider ownership
 	bool frozen_;
 	size_t size_;
 	Array<ExposedAttribute*> exposed_attributes_;
@@ -8,7 +8,8 @@
 
 #include "object/editor_universe.hpp"
 #include "type/structured_type.hpp"
-#include "base/set.hpp"
+#include "base/symbol.hpp"
+#include "base/hash_map.hpp"
 #include "base/parse.hpp"
 #include "io/formatters.hpp"
 #include "type/reference_type.hpp"
@@ -21,14 +22,14 @@
 
 namespace grace {
 	struct EditorUniverse::Impl {
-		Map<StringRef, ObjectPtr<>> object_map_;
-		Map<ObjectPtr<>, StringRef> reverse_object_map_;
-		Set<String> object_name_pool_;
+		// Object IDs are interned, so the StringRefs handed out by get_id() never move.
+		HashMap<Symbol, ObjectPtr<>> object_map_;
+		HashMap<ObjectPtr<>, Symbol> reverse_object_map_;
 		ObjectPtr<> root_;
 		
 		Array<ObjectPtrRootBase*> external_object_roots_;
 		
-		Impl(IAllocator& alloc) : object_map_(alloc), reverse_object_map_(alloc), object_name_pool_(alloc), external_object_roots_(alloc) {}
+		Impl(IAllocator& alloc) : object_map_(alloc), reverse_object_map_(alloc), external_object_roots_(alloc) {}
 		void unregister_object(ObjectPtr<> obj);
 		void unregister_object_name(StringRef object_id);
 		void remove_object_references_from_object(ObjectPtr<> obj);
@@ -84,7 +85,7 @@ namespace grace {
 	StringRef EditorUniverse::get_id(ObjectPtr<const Object> object) const {
 		auto it = impl_->reverse_object_map_.find(object);
 		if (it != impl_->reverse_object_map_.end()) {
-			return it->second;
+			return it->second.str();
 		}
 		return "<UNNAMED OBJECT>";
 	}
@@ -112,7 +113,6 @@ namespace grace {
 		}
 		impl_->object_map_.clear();
 		impl_->reverse_object_map_.clear();
-		impl_->object_name_pool_.clear();
 	}
 	
 	bool EditorUniverse::rename_object(ObjectPtr<> obj, StringRef new_id) {
@@ -125,7 +125,7 @@ namespace grace {
 		
 		bool actually_got_the_requested_name = true;
 		
-		StringRef pooled_new_object_id;
+		Symbol pooled_new_object_id;
 		if (found != impl_->object_map_.end() || new_id.size() < 2) {
 			// Calculate a new name.
 			actually_got_the_requested_name = false;
@@ -155,11 +155,9 @@ namespace grace {
 				++seq;
 			} while (impl_->object_map_.find(new_name) != impl_->object_map_.end());
 			
-			auto inserted = impl_->object_name_pool_.insert(String(new_name, allocator()));
-			pooled_new_object_id = StringRef(*inserted);
+			pooled_new_object_id = Symbol(new_name);
 		} else {
-			auto inserted = impl_->object_name_pool_.insert(String(new_id, allocator()));
-			pooled_new_object_id = StringRef(*inserted);
+			pooled_new_object_id = Symbol(new_id);
 		}
 		
 		impl_->unregister_object(obj);
@@ -240,10 +238,8 @@ namespace grace {
 		auto rit = reverse_object_map_.find(obj);
 		if (rit != reverse_object_map_.end()) {
 			auto it = object_map_.find(rit->second);
-			auto nit = object_name_pool_.find(rit->second);
 			reverse_object_map_.erase(rit);
 			object_map_.erase(it);
-			object_name_pool_.erase(nit);
 		}
 	}
 	
@@ -251,10 +247,8 @@ namespace grace {
 		auto it = object_map_.find(object_name);
 		if (it != object_map_.end()) {
 			auto rit = reverse_object_map_.find(it->second);
-			auto nit = object_name_pool_.find(object_name);
 			reverse_object_map_.erase(rit);
 			object_map_.erase(it);
-			object_name_pool_.erase(nit);
 		}
 	}
 	
@@ -48,6 +48,10 @@ struct ObjectType : TypeFor<T, ObjectTypeBase> {
 	void serialize(const T& object, DocumentNode&, IUniverse&) const;
 	
 	const ISlot* find_slot_by_name(StringRef name) const {
+		Maybe<Symbol> sym = Symbol::find(name);
+		return sym ? find_slot_by_name(*sym) : nullptr;
+	}
+	const ISlot* find_slot_by_name(Symbol name) const {
 		for (auto& it: slots_) {
 			if (it->name() == name) return it;
 		}
@@ -4,6 +4,8 @@
 
 #include "type/type.hpp"
 #include "object/object.hpp"
+#include "base/hash.hpp"
+#include "base/type_traits.hpp"
 
 namespace grace {
 
@@ -56,12 +58,21 @@ private:
 	T* ptr_;
 };
 
+template <typename T> struct IsTriviallyRelocatable<ObjectPtr<T>> {
+	static const bool Value = true;
+};
+
 template <typename OutputStream, typename T>
 OutputStream& operator<<(OutputStream& os, const ObjectPtr<T>& ptr) {
 	os << '(' << ptr.type()->name() << "*)" << (void*)ptr.get();
 	return os;
 }
 
+template <typename T>
+uint64 hash_of(const ObjectPtr<T>& ptr) {
+	return hash_of(static_cast<const Object*>(ptr.get()));
+}
+
 }
 
 #endif /* end of include guard: OBJECTPTR_HPP_WICLN6JL */
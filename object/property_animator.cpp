@@ -70,7 +70,7 @@ namespace grace {
 	}
 	
 	void PropertyAnimator::set_property(String name) {
-		property_name_ = move(name);
+		property_name_ = Symbol(name);
 		reset();
 	}
 	
@@ -13,6 +13,7 @@
 #include "object/objectptr.hpp"
 #include "base/any.hpp"
 #include "base/auto_link_queue.hpp"
+#include "base/symbol.hpp"
 #include "memory/unique_ptr.hpp"
 
 namespace grace {
@@ -63,7 +64,7 @@ namespace grace {
 		AutoListLink<PropertyAnimator> link;
 		
 		ObjectPtr<> object_;
-		String property_name_;
+		Symbol property_name_;
 		Any from_; // may be nothing, in which case the initial value is used.
 		Any to_;
 		int64 duration_; // in microsecs
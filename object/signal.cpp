@@ -3,11 +3,12 @@
 #include "object/object_type.hpp"
 #include "base/log.hpp"
 #include "base/string.hpp"
+#include "base/small_array.hpp"
 
 namespace grace {
 
 String SignalTypeBase::build_signal_name(ArrayRef<const IType*> signature) {
-	Array<StringRef> names;
+	SmallArray<StringRef, 8> names;
 	names.resize(signature.size());
 	std::transform(signature.begin(), signature.end(), names.begin(), std::bind(&IType::name, std::placeholders::_1));
 	return encapsulate_join(names.ref(), ", ", "Signal<", ">");
@@ -15,170 +15,210 @@
 #include "object/slot.hpp"
 #include "object/object.hpp"
 #include "object/object_type.hpp"
-#include "memory/unique_ptr.hpp"
 #include "base/function.hpp"
+#include "base/small_array.hpp"
+#include "base/array.hpp"
 #include <type_traits>
 
 namespace grace {
-    struct SignalInvokerBase {
-        virtual ObjectPtr<> receiver() const = 0;
-        virtual const ISlot* slot() const = 0;
-    };
-
-    template <typename... Args>
-    struct SignalInvoker : ListLinkBase<SignalInvoker<Args...>>, SignalInvokerBase {
-        virtual void invoke(Args... args) const = 0;
-    };
+	/*
+		One connection of a Signal. Free functions, small lambdas and member functions bound to an object
+		all fit in the inline storage of the Function, so a connection needs no allocation of its own.
+	*/
+	template <typename... Args>
+	struct SignalInvoker {
+		Function<void(Args...)> function;
+		ObjectPtr<> receiver_;
+		const ISlot* slot_ = nullptr;
+		uint32 id = 0; // 0 once disconnected
+		
+		ObjectPtr<> receiver() const { return receiver_; }
+		const ISlot* slot() const { return slot_; }
+		void invoke(Args... args) const { function(std::forward<Args>(args)...); }
+	};
 	
 	struct SignalConnectionID {
 	private:
-		void* signal;
-		SignalInvokerBase* invoker;
+		void* signal = nullptr;
+		uint32 id = 0;
 		template <typename... Args> friend class Signal;
 	};
 
-    template <typename... Args>
-    class Signal {
-    public:
-		Signal(IAllocator& alloc = default_allocator()) : allocator_(alloc) {}
-		~Signal();
+	/*
+		Signal keeps its connections in one array, with room for two inline, so emitting to a few
+		listeners walks a cache line or two instead of a linked list of heap nodes.
+		
+		Handlers may connect and disconnect while the signal is being emitted. Disconnected entries are
+		skipped and removed once the outermost emission returns. Connections made during an emission
+		are held aside until then, so they first fire on the next emission.
+	*/
+	template <typename... Args>
+	class Signal {
+	public:
+		using Invoker = SignalInvoker<Args...>;
+		static const uint32 InlineConnections = 2;
+		
+		Signal(IAllocator& alloc = default_allocator()) : allocator_(alloc), invokers_(alloc), pending_(alloc) {}
 	
-        // Should catch raw functions and lambdas:
+		// Should catch raw functions and lambdas:
 		template <typename T>
 		SignalConnectionID connect(T value);
-        template <typename R>
-        SignalConnectionID connect(Function<R(Args...)> function);
+		SignalConnectionID connect(Function<void(Args...)> function) { return add(move(function)); }
+		template <typename R>
+		SignalConnectionID connect(Function<R(Args...)> function);
 
-        // Should catch raw member functions:
-        template <typename T, typename R>
+		// Should catch raw member functions:
+		template <typename T, typename R>
 		SignalConnectionID connect(T* receiver, R(T::*member)(Args...));
 		
 		template <typename T, typename R>
 		SignalConnectionID connect(const T* receiver, R(T::*member)(Args...) const);
 
-        // Should catch slots with ObjectPtr:
-        template <typename T, typename R>
-        SignalConnectionID connect(ObjectPtr<T> ptr, R(T::*member)(Args...));
+		// Should catch slots with ObjectPtr:
+		template <typename T, typename R>
+		SignalConnectionID connect(ObjectPtr<T> ptr, R(T::*member)(Args...));
 
-        template <typename T, typename R>
-        SignalConnectionID connect(ObjectPtr<T> ptr, R(T::*member)(Args...) const);
+		template <typename T, typename R>
+		SignalConnectionID connect(ObjectPtr<T> ptr, R(T::*member)(Args...) const);
 
-        // Should catch named slots:
-        Maybe<SignalConnectionID> connect(ObjectPtr<> ptr, StringRef slot_name);
+		// Should catch named slots:
+		Maybe<SignalConnectionID> connect(ObjectPtr<> ptr, StringRef slot_name);
 		
 		void disconnect(SignalConnectionID& connid);
 
-        void invoke(const Args&...) const;
-        void operator()(const Args&... args) const { invoke(args...); }
+		void invoke(const Args&...) const;
+		void operator()(const Args&... args) const { invoke(args...); }
 		
-		using iterator = typename BareLinkList<SignalInvoker<Args...>>::iterator;
-		using const_iterator = typename BareLinkList<SignalInvoker<Args...>>::const_iterator;
+		using iterator = typename SmallArray<Invoker, InlineConnections>::iterator;
+		using const_iterator = typename SmallArray<Invoker, InlineConnections>::const_iterator;
 		iterator begin() { return invokers_.begin(); }
 		iterator end() { return invokers_.end(); }
 		const_iterator begin() const { return invokers_.begin(); }
 		const_iterator end() const { return invokers_.end(); }
-    private:
+		size_t num_connections() const { return invokers_.size(); }
+		const Invoker* connection_at(size_t idx) const { return &invokers_[idx]; }
+	private:
 		IAllocator& allocator_;
-		BareLinkList<SignalInvoker<Args...>> invokers_;
+		// Mutable because the emission that ends last tidies up after disconnects made during it.
+		mutable SmallArray<Invoker, InlineConnections> invokers_;
+		mutable Array<Invoker> pending_; // connected during an emission
+		mutable uint32 emitting_ = 0;
+		mutable bool has_disconnected_ = false;
+		uint32 next_id_ = 1;
 		
-		SignalConnectionID link_and_make_id(SignalInvoker<Args...>* invoker) {
-			invokers_.link_tail(invoker);
-			SignalConnectionID connid;
-			connid.signal = this;
-			connid.invoker = invoker;
-			return connid;
-		}
-    };
-
-    template <typename R, typename... Args>
-    struct FunctionInvoker : public SignalInvoker<Args...> {
-        Function<R(Args...)> function;
-        FunctionInvoker(Function<R(Args...)> function) : function(std::move(function)) {}
-        ObjectPtr<> receiver() const { return nullptr; }
-        const ISlot* slot() const { return nullptr; }
-        void invoke(Args... args) const { function(std::forward<Args>(args)...); }
-    };
-
-    template <typename T, typename R, typename... Args>
-    struct MemberFunctionInvoker : public SignalInvoker<Args...> {
-		typedef typename std::remove_const<T>::type RawT;
-        ObjectPtr<RawT> receiver_;
-        typedef typename GetMemberFunctionPointerType<T, R, Args...>::Type FunctionPointerType;
-        FunctionPointerType function_;
-
-        MemberFunctionInvoker(ObjectPtr<RawT> receiver, FunctionPointerType member) : receiver_(receiver), function_(member) {}
-        ObjectPtr<> receiver() const { return receiver_; }
-        const ISlot* slot() const {
-			const ObjectTypeBase* type = get_type<RawT>();
-			return type->find_slot_for_method<T,R,Args...>(function_);
-		}
-        void invoke(Args... args) const { (receiver_.get()->*function_)(std::forward<Args>(args)...); }
-    };
-
-    template <typename... Args>
-    struct SlotInvoker : SignalInvoker<Args...> {
-        const Slot<Args...>* slot_;
-        ObjectPtr<> object_;
-        SlotInvoker(ObjectPtr<> receiver, const Slot<Args...>* slot) : object_(receiver), slot_(slot) {}
-		const ISlot* slot() const { return dynamic_cast<const ISlot*>(slot_); }
-		ObjectPtr<> receiver() const { return object_; }
-		void invoke(Args... args) const { slot_->invoke_polymorphic(object_, std::forward<Args>(args)...); }
-    };
-
+		struct EmissionScope {
+			const Signal<Args...>& signal;
+			EmissionScope(const Signal<Args...>& signal) : signal(signal) { ++signal.emitting_; }
+			~EmissionScope() { if (--signal.emitting_ == 0) signal.end_emission(); }
+		};
+		
+		template <typename T>
+		SignalConnectionID add(T function_object, ObjectPtr<> receiver = nullptr, const ISlot* slot = nullptr);
+		void end_emission() const;
+	};
+	
 	template <typename... Args>
-	Signal<Args...>::~Signal() {
-		while (!invokers_.empty()) {
-			destroy(invokers_.head(), allocator_);
+	template <typename T>
+	SignalConnectionID Signal<Args...>::add(T function_object, ObjectPtr<> receiver, const ISlot* slot) {
+		Invoker invoker;
+		invoker.function = Function<void(Args...)>(move(function_object), allocator_);
+		invoker.receiver_ = receiver;
+		invoker.slot_ = slot;
+		invoker.id = next_id_++;
+		SignalConnectionID connid;
+		connid.signal = this;
+		connid.id = invoker.id;
+		if (emitting_) {
+			pending_.push_back(move(invoker));
+		} else {
+			invokers_.push_back(move(invoker));
 		}
+		return connid;
 	}
 	
 	template <typename... Args>
 	template <typename T>
 	SignalConnectionID Signal<Args...>::connect(T function_object) {
-		using R = typename std::result_of<T(Args...)>::type;
-		return connect(Function<R(Args...)>(move(function_object)));
-	};
+		// Wrapping also discards the result, for functions that return something.
+		return add([=](Args... args) { function_object(std::forward<Args>(args)...); });
+	}
 
-    template <typename... Args>
-    template <typename R>
-    SignalConnectionID Signal<Args...>::connect(Function<R(Args...)> function) {
-		auto f = Function<R(Args...)>(move(function), allocator_);
-        return link_and_make_id((new(allocator_, alignof(FunctionInvoker<R, Args...>)) FunctionInvoker<R, Args...>(move(f))));
-    }
+	template <typename... Args>
+	template <typename R>
+	SignalConnectionID Signal<Args...>::connect(Function<R(Args...)> function) {
+		return add([=](Args... args) { function(std::forward<Args>(args)...); });
+	}
 
-    template <typename... Args>
-    template <typename T, typename R>
-    SignalConnectionID Signal<Args...>::connect(T* receiver, R(T::*member)(Args...)) {
-        // Convert member function call to free function call:
-		return connect(bind_method(receiver, member));
-    }
+	template <typename... Args>
+	template <typename T, typename R>
+	SignalConnectionID Signal<Args...>::connect(T* receiver, R(T::*member)(Args...)) {
+		return add([=](Args... args) { (receiver->*member)(std::forward<Args>(args)...); });
+	}
 	
 	template <typename... Args>
-    template <typename T, typename R>
-    SignalConnectionID Signal<Args...>::connect(const T* receiver, R(T::*member)(Args...) const) {
-        // Convert member function call to free function call:
-		return connect(bind_method(receiver, member));
-    }
+	template <typename T, typename R>
+	SignalConnectionID Signal<Args...>::connect(const T* receiver, R(T::*member)(Args...) const) {
+		return add([=](Args... args) { (receiver->*member)(std::forward<Args>(args)...); });
+	}
 
-    template <typename... Args>
-    template <typename T, typename R>
-    SignalConnectionID Signal<Args...>::connect(ObjectPtr<T> receiver, R(T::*member)(Args...)) {
-        return link_and_make_id(new(allocator_) MemberFunctionInvoker<T,R,Args...>(receiver, member));
-    }
+	template <typename... Args>
+	template <typename T, typename R>
+	SignalConnectionID Signal<Args...>::connect(ObjectPtr<T> receiver, R(T::*member)(Args...)) {
+		const ISlot* slot = get_type<T>()->template find_slot_for_method<T,R,Args...>(member);
+		T* object = receiver.get();
+		return add([=](Args... args) { (object->*member)(std::forward<Args>(args)...); }, receiver, slot);
+	}
 
-    template <typename... Args>
-    template <typename T, typename R>
-    SignalConnectionID Signal<Args...>::connect(ObjectPtr<T> receiver, R(T::*member)(Args...) const) {
-        return link_and_make_id(new(allocator_) MemberFunctionInvoker<const T, R, Args...>(receiver, member));
-    }
+	template <typename... Args>
+	template <typename T, typename R>
+	SignalConnectionID Signal<Args...>::connect(ObjectPtr<T> receiver, R(T::*member)(Args...) const) {
+		const ISlot* slot = get_type<T>()->template find_slot_for_method<const T,R,Args...>(member);
+		const T* object = receiver.get();
+		return add([=](Args... args) { (object->*member)(std::forward<Args>(args)...); }, receiver, slot);
+	}
 	
 	template <typename... Args>
 	void Signal<Args...>::disconnect(SignalConnectionID& connid) {
 		ASSERT(connid.signal == this);
-		auto invoker = dynamic_cast<SignalInvoker<Args...>*>(connid.invoker);
-		destroy(invoker, allocator_);
+		for (size_t i = 0; i < invokers_.size(); ++i) {
+			if (invokers_[i].id == connid.id) {
+				if (emitting_) {
+					// The handler may be running right now, so only mark it.
+					invokers_[i].id = 0;
+					has_disconnected_ = true;
+				} else {
+					invokers_.erase(invokers_.begin() + i);
+				}
+				break;
+			}
+		}
+		for (size_t i = 0; i < pending_.size(); ++i) {
+			if (pending_[i].id == connid.id) {
+				pending_.erase(i);
+				break;
+			}
+		}
 		connid.signal = nullptr;
-		connid.invoker = nullptr;
+		connid.id = 0;
+	}
+	
+	template <typename... Args>
+	void Signal<Args...>::end_emission() const {
+		if (has_disconnected_) {
+			size_t w = 0;
+			for (size_t i = 0; i < invokers_.size(); ++i) {
+				if (invokers_[i].id != 0) {
+					if (w != i) invokers_[w] = move(invokers_[i]);
+					++w;
+				}
+			}
+			while (invokers_.size() > w) invokers_.pop_back();
+			has_disconnected_ = false;
+		}
+		if (pending_.size()) {
+			invokers_.insert_move(pending_.begin(), pending_.end());
+			pending_.clear();
+		}
 	}
 	
 	void nonexistent_slot_warning(ObjectPtr<> receiver, StringRef slot_name);
@@ -196,18 +236,19 @@ namespace grace {
             slot_type_mismatch_warning(receiver, slot_name, slot_base->signature_description(), get_signature_description<Args...>(default_allocator()));
 			return Nothing;
         }
-		return link_and_make_id(new(allocator_) SlotInvoker<Args...>(receiver, slot));
+		return add([=](Args... args) { slot->invoke_polymorphic(receiver, std::forward<Args>(args)...); }, receiver, dynamic_cast<const ISlot*>(slot));
     }
 	
 	template <typename... Args>
 	void Signal<Args...>::invoke(const Args&... args) const {
-		for (auto it = invokers_.begin(); it != invokers_.end();) {
-			// Signal handlers may remove themselves from the list,
-			// so save an iterator to the next element before invoking.
-			auto next = it;
-			++next;
-			it->invoke(args...);
-			it = next;
+		EmissionScope scope(*this);
+		// Nothing is added to or removed from invokers_ until the emission ends, so indices stay valid.
+		const Invoker* invokers = invokers_.data();
+		size_t n = invokers_.size();
+		for (size_t i = 0; i < n; ++i) {
+			if (invokers[i].id != 0) {
+				invokers[i].function(args...);
+			}
 		}
 	}
 }
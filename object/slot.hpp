@@ -10,6 +10,7 @@
 #define grace_slot_hpp
 
 #include "base/basic.hpp"
+#include "base/symbol.hpp"
 #include "type/type.hpp"
 #include "object/object.hpp"
 #include "object/objectptr.hpp"
@@ -24,7 +25,7 @@ namespace grace {
 	void warn_signal_receiver_argument_type_mismatch(ArrayRef<const IType*> signature);
 	
 	struct ISlot {
-		virtual StringRef name() const = 0;
+		virtual Symbol name() const = 0;
 		virtual StringRef description() const = 0;
 		virtual Array<const IType*> signature(IAllocator& alloc = default_allocator()) const = 0;
 		virtual bool invoke(ObjectPtr<> receiver, ArrayRef<Any> args) const = 0;
@@ -41,18 +42,18 @@ namespace grace {
 	
 	template <typename T>
 	struct SlotForType : ISlot {
-		SlotForType(IAllocator& alloc, StringRef name, StringRef description) : name_(std::move(name), alloc), description_(std::move(description), alloc) {}
+		SlotForType(IAllocator& alloc, StringRef name, StringRef description) : name_(name), description_(std::move(description), alloc) {}
 		
 		T* get_object_polymorphic(ObjectPtr<> receiver) const {
 			return dynamic_cast<T*>(receiver.get());
 		}
 		
-		StringRef name() const final { return name_; }
+		Symbol name() const final { return name_; }
 		StringRef description() const final { return description_; }
 		
-		IAllocator& allocator() const { return name_.allocator(); }
+		IAllocator& allocator() const { return description_.allocator(); }
 	protected:
-		String name_;
+		Symbol name_;
 		String description_;
 	};
 	
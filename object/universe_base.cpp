@@ -14,6 +14,8 @@
 #include "io/formatters.hpp"
 #include "object/composite_type.hpp"
 
+#include <algorithm>
+
 namespace grace {
 	void DeferredAttributeDeserialization::perform(IUniverse& universe) const {
 		attribute->deserialize_attribute(object.get(), *node, universe);
@@ -60,12 +62,22 @@ namespace grace {
 	bool BasicUniverse::serialize_scene(DocumentNode &root_node, grace::String &out_error) {
 		root_node["format"] << 1;
 		auto& objects = root_node["objects"];
-		for (auto ptr: object_map_.values()) {
-			grace::serialize(*ptr, objects.array_push(), *this);
+		for (Symbol id: sorted_ids()) {
+			grace::serialize(*object_map_[id], objects.array_push(), *this);
 		}
 		return true; // XXX: Report errors
 	}
 	
+	Array<Symbol> BasicUniverse::sorted_ids() const {
+		Array<Symbol> ids;
+		ids.reserve(object_map_.size());
+		for (auto pair: object_map_) {
+			ids.push_back(pair.first);
+		}
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+	
 	void UniverseBase::defer_attribute_deserialization(ObjectPtr<> obj, const IAttribute *attr, const DocumentNode *serialized) {
 		deferred_.push_back(DeferredAttributeDeserialization{obj, attr, serialized});
 	}
@@ -83,12 +95,27 @@ namespace grace {
 		return root_;
 	}
 	
+	ObjectPool& BasicUniverse::pool_for_type(const StructuredType* type) {
+		auto it = pools_.find(type);
+		if (it != pools_.end()) {
+			return *it->second;
+		}
+		ObjectPool* pool = new(allocator()) ObjectPool(allocator(), type->size(), type->alignment());
+		pools_[type] = pool;
+		return *pool;
+	}
+	
 	ObjectPtr<> BasicUniverse::create_object(const StructuredType* type, StringRef id) {
-		size_t sz = type->size();
-		byte* memory = (byte*)allocator().allocate(sz, type->alignment());
-		type->construct(memory, *this);
+		ObjectPool& pool = pool_for_type(type);
+		byte* memory = (byte*)pool.allocate();
+		try {
+			type->construct(memory, *this);
+		}
+		catch (...) {
+			pool.free(memory);
+			throw;
+		}
 		Object* object = reinterpret_cast<Object*>(memory);
-		memory_map_.push_back(object);
 		rename_object(ObjectPtr<>(object), id);
 		if (type->wants_game_update()) {
 			register_object_for_update(ObjectPtr<>(object));
@@ -106,9 +133,9 @@ namespace grace {
 		}
 		
 		// check if new name already exists
-		auto it = object_map_.find(String(new_id));
+		auto it = object_map_.find(new_id);
 		bool renamed_exact = true;
-		String new_name;
+		Symbol new_name;
 		if ((it != object_map_.end()) || (new_id.size() < 2)) {
 			// it does, so create a unique name from the requested name
 			int n = 1;
@@ -126,20 +153,23 @@ namespace grace {
 			}
 			
 			// increment n and try the name until we find one that's available
+			// Candidates are only interned once one is free.
+			String candidate;
 			do {
 				StringStream create_new_name;
 				create_new_name << base_name << format("%02d", n);
-				new_name = std::move(create_new_name.str());
+				candidate = std::move(create_new_name.str());
 				++n;
-			} while (object_map_.find(new_name) != object_map_.end());
+			} while (object_map_.find(candidate) != object_map_.end());
+			new_name = Symbol(candidate);
 			
 			renamed_exact = false;
 		} else {
-			new_name = std::move(new_id);
+			new_name = Symbol(new_id);
 		}
 		
 		object_map_[new_name] = object;
-		reverse_object_map_[object] = std::move(new_name);
+		reverse_object_map_[object] = new_name;
 		return renamed_exact;
 	}
 	
@@ -152,23 +182,29 @@ namespace grace {
 	}
 	
 	void BasicUniverse::run_initializers() {
-		for (auto pair: object_map_) {
-			pair.second->initialize();
+		for (Symbol id: sorted_ids()) {
+			// An initializer may have renamed or removed objects further down the list.
+			auto it = object_map_.find(id);
+			if (it != object_map_.end()) {
+				it->second->initialize();
+			}
 		}
 	}
 	
 	void BasicUniverse::clear() {
 		UniverseBase::clear();
-		for (auto object: memory_map_) {
-			const StructuredType* type = object->object_type();
-			type->destruct(reinterpret_cast<byte*>(object), *this);
-			allocator().free(object, type->size());
+		for (auto pair: pools_) {
+			const StructuredType* type = pair.first;
+			pair.second->each([&](void* memory) {
+				type->destruct(reinterpret_cast<byte*>(memory), *this);
+			});
+			// Types may be deleted once their objects are gone, so the pools go too.
+			destroy(pair.second, allocator());
 		}
 		// TODO: Test for references?
 		object_map_.clear();
 		reverse_object_map_.clear();
-		memory_map_.clear();
-		
+		pools_.clear();
 	}
 	
 	void UniverseBase::clear() {
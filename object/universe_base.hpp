@@ -14,6 +14,9 @@
 #include "object/aspect_cast.hpp"
 #include "base/priority_queue.hpp"
 #include "base/set.hpp"
+#include "base/hash_map.hpp"
+#include "base/symbol.hpp"
+#include "memory/object_pool.hpp"
 
 namespace grace {
 	class CompositeType;
@@ -140,15 +143,39 @@ namespace grace {
 		void run_initializers() final;
 		void clear() final;
 		
-		BasicUniverse(IAllocator& alloc = default_allocator()) : UniverseBase(alloc), object_map_(alloc), reverse_object_map_(alloc), memory_map_(alloc) {}
+		// Objects of one type are stored together, so these visit them in memory order.
+		template <typename Function>
+		void each_object(Function function) const;
+		template <typename Function>
+		void each_object_of_type(const StructuredType* type, Function function) const;
+		
+		BasicUniverse(IAllocator& alloc = default_allocator()) : UniverseBase(alloc), object_map_(alloc), reverse_object_map_(alloc), pools_(alloc) {}
 		~BasicUniverse() { clear(); }
 	private:
-		Map<String, ObjectPtr<>> object_map_;
-		Map<ObjectPtr<const Object>, String> reverse_object_map_;
-		Array<Object*> memory_map_;
+		HashMap<Symbol, ObjectPtr<>> object_map_;
+		HashMap<ObjectPtr<const Object>, Symbol> reverse_object_map_;
+		HashMap<const StructuredType*, ObjectPool*> pools_;
 		ObjectPtr<> root_;
+		
+		ObjectPool& pool_for_type(const StructuredType* type);
+		Array<Symbol> sorted_ids() const; // object_map_ is unordered, so this keeps saved scenes stable
 	};
 	
+	template <typename Function>
+	void BasicUniverse::each_object(Function function) const {
+		for (auto pair: pools_) {
+			pair.second->each([&](void* memory) { function(reinterpret_cast<Object*>(memory)); });
+		}
+	}
+	
+	template <typename Function>
+	void BasicUniverse::each_object_of_type(const StructuredType* type, Function function) const {
+		auto it = pools_.find(type);
+		if (it != pools_.end()) {
+			it->second->each([&](void* memory) { function(reinterpret_cast<Object*>(memory)); });
+		}
+	}
+	
 	typedef BasicUniverse TestUniverse;
 
 }
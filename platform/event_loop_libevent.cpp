@@ -7,6 +7,7 @@
 #include "base/string.hpp"
 #include "base/string_ref.hpp"
 #include "base/array.hpp"
+#include "base/small_array.hpp"
 #include "base/process.hpp"
 
 #include <errno.h>
@@ -68,6 +69,45 @@ namespace grace {
 			((LibEventTimer*)timer)->invoke();
 		}
 
+		struct LibEventDescriptorWait : LibEventHandle {
+			event* ev;
+			DescriptorEvent wanted;
+			Function<void(DescriptorEvent)> callback;
+			virtual ~LibEventDescriptorWait() {
+				cancel();
+				event_free(ev); // the descriptor belongs to the caller
+			}
+
+			void invoke(short what) {
+				callback((what & EV_TIMEOUT) ? DescriptorEvent::Timeout : wanted);
+			}
+
+			bool is_repeating() const final {
+				return false;
+			}
+
+			bool is_active() const final {
+				return event_pending(ev, EV_TIMEOUT|EV_READ|EV_WRITE, nullptr) != 0;
+			}
+
+			void activate() final {
+				if (timeout == SystemTimeDelta::forever()) {
+					event_add(ev, nullptr);
+				} else {
+					struct timeval tv = system_time_delta_to_timeval(timeout);
+					event_add(ev, &tv);
+				}
+			}
+
+			void cancel() final {
+				event_del(ev);
+			}
+		};
+
+		void descriptor_wait_callback(int fd, short what, void* wait) {
+			((LibEventDescriptorWait*)wait)->invoke(what);
+		}
+
 		struct LibEventFileDescriptor : LibEventHandle {
 			event* ev;
 			virtual ~LibEventFileDescriptor() {
@@ -139,8 +179,7 @@ namespace grace {
 
 			void activate() final {
 				if (!process) {
-					ScratchAllocator scratch;
-					Array<StringRef> args(scratch);
+					SmallArray<StringRef, 8> args;
 					args.reserve(arguments.size());
 					for (auto& s: arguments) {
 						args.push_back(s);
@@ -241,6 +280,18 @@ namespace grace {
 		return std::move(p);
 	}
 
+	UniquePtr<IEventHandle> EventLoop_libevent::when_ready(FileDescriptor fd, DescriptorEvent event, Function<void(DescriptorEvent)> callback, SystemTimeDelta timeout, IAllocator& alloc) {
+		ASSERT(event != DescriptorEvent::Timeout);
+		auto p = make_unique<LibEventDescriptorWait>(alloc);
+		short what = event == DescriptorEvent::Readable ? EV_READ : EV_WRITE;
+		p->ev = event_new(base_, fd, what, descriptor_wait_callback, p.get());
+		p->wanted = event;
+		p->timeout = timeout;
+		p->callback = std::move(callback);
+		p->activate();
+		return std::move(p);
+	}
+
 	UniquePtr<IEventHandle> EventLoop_libevent::connect(StringRef host, uint16 port, Function<void(NetworkConnectionEvent, INetworkStream&)> callback, SystemTimeDelta timeout) {
 		ASSERT(false); // NIY
 	}
@@ -16,6 +16,9 @@ namespace grace {
 		UniquePtr<IEventHandle> schedule(Function<void()>, SystemTimeDelta delay, IAllocator& = default_allocator()) final;
 		UniquePtr<IEventHandle> call_repeatedly(Function<void()>, SystemTimeDelta interval, IAllocator& = default_allocator()) final;
 
+		// Descriptor API
+		UniquePtr<IEventHandle> when_ready(FileDescriptor fd, DescriptorEvent event, Function<void(DescriptorEvent)> callback, SystemTimeDelta timeout, IAllocator& = default_allocator()) final;
+
 		// Capabilities
 		UniquePtr<IEventHandle> connect(StringRef host, uint16 port, Function<void(NetworkConnectionEvent, INetworkStream&)> callback, SystemTimeDelta timeout) final;
 		UniquePtr<IEventHandle> listen(uint16 port, Function<void(ServerEvent, Server&)> callback) final;
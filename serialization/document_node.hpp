@@ -235,12 +235,15 @@ struct BuildTypeInfo<DocumentNode*> {
 		bool result = false;
 		value_.when<MapType>([&](const MapType& dict) {
 			result = true;
-			//dictionary.reserve(dict.size());
+			// dict is sorted already, so the elements can be appended and then merged in one pass.
+			Dictionary<T> read(dictionary.allocator());
+			read.reserve(dict.size());
 			for (auto pair: dict) {
 				T element;
 				result = ((*pair.second) >> element) && result;
-				dictionary[pair.first] = move(element);
+				read.set(pair.first, move(element));
 			}
+			dictionary.merge(move(read));
 		});
 		return result;
 	}
@@ -10,6 +10,7 @@
 #include "io/util.hpp"
 #include "base/parse.hpp"
 #include "base/pair.hpp"
+#include "base/small_array.hpp"
 #include "base/raise.hpp"
 
 #include <yaml.h>
@@ -28,15 +29,21 @@ namespace grace {
 				Sequence,
 			};
 			
-			ArrayList<Pair<DocumentNode*, String>> stack; // node and non-empty string if node is a mapping waiting for a value
+			struct Frame {
+				DocumentNode* node;
+				String key; // non-empty if node is a mapping waiting for a value
+				SmallArray<Pair<String, DocumentNode*>, 8> entries; // mapping entries, inserted together at the end of the mapping
+			};
+			
+			ArrayList<Frame> stack;
 			Array<DocumentNode*> roots;
 			Map<String, DocumentNode*> anchors;
 			YAMLParserState(Document& document) : document(document) {}
 			
 			DocumentNode* root() const { return roots.size() ? roots[0] : nullptr; }
-			DocumentNode* top() const { return stack.back().first; }
-			StringRef top_key() const { return stack.back().second; }
-			String& top_key() { return stack.back().second; }
+			DocumentNode* top() const { return stack.back().node; }
+			StringRef top_key() const { return stack.back().key; }
+			String& top_key() { return stack.back().key; }
 			
 			StateType state() const {
 				if (stack.size() == 0) return TopLevel;
@@ -53,7 +60,9 @@ namespace grace {
 			
 			void push(DocumentNode* node) {
 				if (node->is_array() || node->is_map()) {
-					stack.push_back(Pair<DocumentNode*,String>{node, String("")});
+					Frame frame;
+					frame.node = node;
+					stack.push_back(move(frame));
 				} else {
 					raise<YAMLParserError>("Invalid node type for parser stack.");
 				}
@@ -80,13 +89,9 @@ namespace grace {
 						break;
 					}
 					case MappingExpectingValue: {
-						// Insert value in top mapping.
-						if (!top()->is_map()) {
-							top()->internal_value() = DocumentNode::MapType(top()->allocator());
-						}
-						top()->when<DocumentNode::MapType>([&](DocumentNode::MapType& map) {
-							map[top_key()] = node;
-						});
+						// Keep the entry until the mapping ends, since inserting keys one by one in
+						// document order is quadratic for large mappings.
+						stack.back().entries.push_back(Pair<String, DocumentNode*>{move(top_key()), node});
 						top_key() = "";
 						break;
 					}
@@ -128,6 +133,10 @@ namespace grace {
 				if (state() != MappingExpectingKey) {
 					raise<YAMLParserError>("Got end of mapping event, but wasn't parsing a map.");
 				}
+				auto& entries = stack.back().entries;
+				top()->when<DocumentNode::MapType>([&](DocumentNode::MapType& map) {
+					map.insert_unsorted_bulk(entries.begin(), entries.end());
+				});
 				DocumentNode* map = pop();
 				add_value_to_top(map);
 			}
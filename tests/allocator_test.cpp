@@ -0,0 +1,229 @@
+//
+//  allocator_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "memory/allocator.hpp"
+#include "base/exceptions.hpp"
+
+#include <thread>
+
+using namespace grace;
+
+SUITE(Allocator) {
+	it("should give each thread its own scratch arena", []() {
+		LinearAllocator* main_arena = &scratch_linear_allocator();
+		LinearAllocator* thread_arena = nullptr;
+		bool thread_arena_is_stable = false;
+		std::thread t([&]() {
+			thread_arena = &scratch_linear_allocator();
+			thread_arena_is_stable = thread_arena == &scratch_linear_allocator();
+		});
+		t.join();
+		TEST(thread_arena != nullptr).should == true;
+		TEST(thread_arena != main_arena).should == true;
+		TEST(thread_arena_is_stable).should == true;
+		TEST(main_arena == &scratch_linear_allocator()).should == true;
+	});
+
+	it("should use scratch memory from several threads at once", []() {
+		static const int NUM_THREADS = 4;
+		bool good[NUM_THREADS] = {false};
+		std::thread threads[NUM_THREADS];
+		for (int i = 0; i < NUM_THREADS; ++i) {
+			threads[i] = std::thread([&good, i]() {
+				ScratchAllocator scratch;
+				Array<int> numbers(scratch);
+				for (int n = 0; n < 10000; ++n) {
+					numbers.push_back(n * i);
+				}
+				bool ok = true;
+				for (int n = 0; n < 10000; ++n) {
+					ok = ok && numbers[n] == n * i;
+				}
+				good[i] = ok;
+			});
+		}
+		for (auto& t: threads) {
+			t.join();
+		}
+		for (int i = 0; i < NUM_THREADS; ++i) {
+			TEST(good[i]).should == true;
+		}
+	});
+
+	it("should honor the configured scratch arena size for new threads", []() {
+		size_t old_size = scratch_arena_size();
+		set_scratch_arena_size(0x100000); // 1 MiB
+		size_t capacity = 0;
+		std::thread t([&]() {
+			capacity = scratch_linear_allocator().capacity();
+		});
+		t.join();
+		set_scratch_arena_size(old_size);
+		TEST(capacity).should == 0x100000;
+	});
+
+	it("should rewind nested scratch allocators", []() {
+		LinearAllocator& arena = scratch_linear_allocator();
+		byte* before = arena.current();
+		{
+			ScratchAllocator outer;
+			outer.allocate(100, 1);
+			{
+				ScratchAllocator inner;
+				inner.allocate(100, 1);
+			}
+			outer.allocate(100, 1);
+		}
+		TEST(arena.current() == before).should == true;
+	});
+
+	it("should throw when a fixed arena runs out", []() {
+		LinearAllocator arena(4096);
+		arena.allocate(4000, 1);
+		bool threw = false;
+		try {
+			arena.allocate(200, 1);
+		}
+		catch (const OutOfMemoryError&) {
+			threw = true;
+		}
+		TEST(threw).should == true;
+		TEST(arena.usage()).should == 4000;
+	});
+
+	it("should map new segments when a growable arena runs out", []() {
+		LinearAllocatorOptions options;
+		options.growable = true;
+		LinearAllocator arena(4096, options);
+		byte* a = (byte*)arena.allocate(4000, 1);
+		byte* b = (byte*)arena.allocate(200, 1);
+		byte* c = (byte*)arena.allocate(10000, 16);
+		TEST(a != nullptr && b != nullptr && c != nullptr).should == true;
+		TEST((intptr_t)c & 15).should == 0;
+		TEST(arena.num_segments()).should == 3;
+		TEST(arena.usage()).should == 14200;
+		TEST(arena.capacity() >= 14200).should == true;
+	});
+
+	it("should release segments when reset across them", []() {
+		LinearAllocatorOptions options;
+		options.growable = true;
+		LinearAllocator arena(4096, options);
+		arena.allocate(1000, 1);
+		byte* mark = arena.current();
+		for (int i = 0; i < 10; ++i) {
+			arena.allocate(3000, 1);
+		}
+		TEST(arena.num_segments() > 1).should == true;
+		arena.reset(mark);
+		TEST(arena.num_segments()).should == 1;
+		TEST(arena.usage()).should == 1000;
+		TEST(arena.capacity()).should == 4096;
+		arena.reset(arena.begin());
+		TEST(arena.usage()).should == 0;
+	});
+
+	it("should reuse retained segments", []() {
+		LinearAllocatorOptions options;
+		options.growable = true;
+		options.retain_segments = true;
+		LinearAllocator arena(4096, options);
+		for (int i = 0; i < 4; ++i) {
+			arena.allocate(3000, 1);
+		}
+		size_t segments = arena.num_segments();
+		arena.reset(arena.begin());
+		TEST(arena.num_retained_segments()).should == segments - 1;
+		for (int i = 0; i < 4; ++i) {
+			arena.allocate(3000, 1);
+		}
+		TEST(arena.num_segments()).should == segments;
+		TEST(arena.num_retained_segments()).should == 0;
+	});
+
+	it("should rewind a scratch allocator that spilled into new segments", []() {
+		LinearAllocatorOptions options;
+		options.growable = true;
+		LinearAllocator arena(4096, options);
+		arena.allocate(100, 1);
+		byte* before = arena.current();
+		{
+			ScratchAllocator scratch(arena);
+			Array<int> numbers(scratch);
+			for (int n = 0; n < 10000; ++n) {
+				numbers.push_back(n);
+			}
+			TEST(numbers[9999]).should == 9999;
+			TEST(scratch.usage() > 0).should == true;
+		}
+		TEST(arena.current() == before).should == true;
+		TEST(arena.num_segments()).should == 1;
+		TEST(arena.usage()).should == 100;
+	});
+
+	it("should grow the most recent allocation in place", []() {
+		LinearAllocator arena(4096);
+		void* a = arena.allocate(100, 8);
+		void* b = arena.reallocate(a, 100, 1000, 8);
+		TEST(a == b).should == true;
+		TEST(arena.usage()).should == 1000;
+		void* c = arena.reallocate(b, 1000, 10, 8);
+		TEST(a == c).should == true;
+		TEST(arena.usage()).should == 10;
+		arena.allocate(10, 1);
+		void* d = arena.reallocate(c, 10, 20, 8);
+		TEST(d != c).should == true;
+	});
+
+	it("should use flat scratch memory while growing an array", []() {
+		LinearAllocatorOptions options;
+		options.growable = true;
+		LinearAllocator arena(0x100000, options);
+		static const size_t N = 0x40000; // Without in-place growth, this needs ~32 GiB.
+		{
+			ScratchAllocator scratch(arena);
+			Array<byte> bytes(scratch);
+			for (size_t i = 0; i < N; ++i) {
+				bytes.push_back((byte)i);
+			}
+			TEST(bytes[N-1]).should == (byte)(N-1);
+			TEST(scratch.usage() < 2 * N).should == true;
+			TEST(arena.num_segments()).should == 1;
+		}
+		TEST(arena.usage()).should == 0;
+	});
+
+	it("should map huge page segments on 2 MiB boundaries", []() {
+		LinearAllocatorOptions options;
+		options.huge_pages = true;
+		LinearAllocator arena(2 * HUGE_PAGE_SIZE, options);
+		HugePageStats stats = arena.huge_page_stats();
+#if defined(__linux__)
+		TEST(stats.reserved + stats.transparent).should == 3; // Rounded up to make room for the segment header.
+		TEST((uintptr_t)arena.begin() % HUGE_PAGE_SIZE < 4096).should == true; // Only the segment header comes first.
+#endif
+		void* p = arena.allocate(2 * HUGE_PAGE_SIZE, 16);
+		TEST(p != nullptr).should == true;
+	});
+
+	it("should round large huge page allocations to whole huge pages", []() {
+		SystemAllocator alloc;
+		alloc.set_use_huge_pages(true);
+		size_t actual;
+		void* p = alloc.allocate_large(HUGE_PAGE_SIZE + 1, 16, actual);
+		TEST(actual % HUGE_PAGE_SIZE).should == 0;
+		TEST((uintptr_t)p % HUGE_PAGE_SIZE).should == 0;
+		HugePageStats stats = alloc.huge_page_stats();
+#if defined(__linux__)
+		TEST(stats.reserved + stats.transparent).should == 2;
+#endif
+		alloc.free_large(p, actual);
+		void* small = alloc.allocate_large(100, 16, actual);
+		TEST(actual).should == 4096;
+		alloc.free_large(small, actual);
+	});
+}
+
@@ -0,0 +1,99 @@
+//
+//  arena_snapshot_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "memory/arena_snapshot.hpp"
+#include "io/string_stream.hpp"
+#include "io/file_stream.hpp"
+#include "base/stack_array.hpp"
+
+#include <unistd.h>
+
+using namespace grace;
+
+namespace {
+	struct Node {
+		int32 value;
+		Node* next;              // Registered for relocation.
+		RelativePtr<Node> prev;  // Needs none.
+	};
+
+	String snapshot_path() {
+		StringStream ss;
+		ss << "/tmp/grace_arena_snapshot_test_" << (int64)::getpid() << ".img";
+		return ss.string();
+	}
+
+	void write_list(StringRef path, int n) {
+		LinearAllocator arena(0x10000);
+		ArenaSnapshotWriter writer(arena);
+		Node* head = nullptr;
+		for (int i = n; i > 0; --i) {
+			Node* node = new(arena.allocate(sizeof(Node), alignof(Node))) Node;
+			node->value = i;
+			node->next = head;
+			if (head) head->prev = node;
+			head = node;
+			writer.add_relocation(&node->next);
+		}
+		writer.set_root(head);
+		writer.write(path);
+	}
+
+	void remove_file(StringRef path) {
+		COPY_STRING_REF_TO_CSTR_BUFFER(path_cstr, path);
+		::unlink(path_cstr.data());
+	}
+
+	bool check_list(Node* head, int n) {
+		int expected = 1;
+		Node* last = nullptr;
+		for (Node* node = head; node; node = node->next) {
+			if (node->value != expected++) return false;
+			if (node->prev.get() != last) return false;
+			last = node;
+		}
+		return expected == n + 1;
+	}
+}
+
+SUITE(ArenaSnapshot) {
+	it("should map a snapshot back with its pointers intact", []() {
+		String path = snapshot_path();
+		write_list(path, 100);
+		ArenaSnapshot snapshot = ArenaSnapshot::map(path);
+		TEST(check_list(snapshot.root<Node>(), 100)).should == true;
+		remove_file(path);
+	});
+
+	it("should rebase pointers when the original address is taken", []() {
+		String path = snapshot_path();
+		write_list(path, 100);
+		ArenaSnapshot first = ArenaSnapshot::map(path);
+		ArenaSnapshot second = ArenaSnapshot::map(path);
+		TEST(first.begin() != second.begin()).should == true;
+		TEST(second.was_relocated()).should == true;
+		TEST(check_list(first.root<Node>(), 100)).should == true;
+		TEST(check_list(second.root<Node>(), 100)).should == true;
+		remove_file(path);
+	});
+
+	it("should refuse files that aren't snapshots", []() {
+		String path = snapshot_path();
+		{
+			FileStream f = FileStream::open(path, FileMode::WriteCreate);
+			f.write((const byte*)"hello", 5);
+		}
+		bool raised = false;
+		try {
+			ArenaSnapshot::map(path);
+		}
+		catch (const SnapshotError&) {
+			raised = true;
+		}
+		TEST(raised).should == true;
+		remove_file(path);
+	});
+}
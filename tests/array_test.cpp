@@ -11,13 +11,35 @@
 
 #include "tests/test.hpp"
 #include "memory/stl_allocator.hpp"
+#include "memory/stats_allocator.hpp"
 #include <vector>
+#include <stdexcept>
 
 using namespace grace;
 
 static size_t num_constructed = 0;
 static bool move_constructed = false;
 
+// Counts live instances, and refuses to copy a negative number.
+struct ThrowingElement {
+	static int num_alive;
+	int n;
+	explicit ThrowingElement(int n = 0) : n(n) { ++num_alive; }
+	ThrowingElement(const ThrowingElement& other) : n(other.n) {
+		if (n < 0) throw std::runtime_error("negative element");
+		++num_alive;
+	}
+	ThrowingElement& operator=(const ThrowingElement& other) { n = other.n; return *this; }
+	~ThrowingElement() { --num_alive; }
+};
+int ThrowingElement::num_alive = 0;
+
+namespace grace {
+	template <> struct IsTriviallyRelocatable<ThrowingElement> {
+		static const bool Value = true;
+	};
+}
+
 SUITE(Array) {
 	it("should not throw an exception when push_back is called", [](){
 		Array<int> a;
@@ -133,6 +155,51 @@ SUITE(Array) {
 		});
 	});
 	
+	it("should relocate Strings when growing, inserting and erasing", []() {
+		StatsAllocator stats(default_allocator());
+		Array<String> a(stats);
+		for (int i = 0; i < 100; ++i) {
+			a.push_back(i % 2 ? "a string too long to be stored inline" : "short");
+		}
+		TEST(stats.stats().num_reallocations).should > 0;
+		String middle[] = {"middle", "another string too long to be stored inline"};
+		a.insert(middle, middle + 2, a.begin() + 50);
+		TEST(a.size()).should == 102;
+		TEST(a[49]).should == "a string too long to be stored inline";
+		TEST(a[50]).should == "middle";
+		TEST(a[52]).should == "short";
+		a.erase(50);
+		a.erase(a.begin());
+		TEST(a[0]).should == "a string too long to be stored inline";
+		TEST(a[49]).should == "another string too long to be stored inline";
+		TEST(a.back()).should == "a string too long to be stored inline";
+	});
+	
+	it("should be left as it was when constructing an inserted element throws", []() {
+		{
+			Array<ThrowingElement> a;
+			for (int i = 1; i <= 4; ++i) {
+				a.emplace_back(i);
+			}
+			ThrowingElement source[] = {ThrowingElement(10), ThrowingElement(-1), ThrowingElement(12)};
+			bool threw = false;
+			try {
+				a.insert(source, source + 3, a.begin() + 2);
+			}
+			catch (const std::runtime_error&) {
+				threw = true;
+			}
+			TEST(threw).should == true;
+			TEST(a.size()).should == 4;
+			TEST(a[0].n).should == 1;
+			TEST(a[1].n).should == 2;
+			TEST(a[2].n).should == 3;
+			TEST(a[3].n).should == 4;
+			TEST(ThrowingElement::num_alive).should == 7;
+		}
+		TEST(ThrowingElement::num_alive).should == 0;
+	});
+	
 	it("should be faster than std::vector", []() {
 		auto build_array = []() {
 			Array<int> a;
@@ -0,0 +1,71 @@
+//
+//  big_array_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/big_array.hpp"
+#include "base/string.hpp"
+#include "io/memory_stream.hpp"
+#include "io/util.hpp"
+#include "memory/stats_allocator.hpp"
+
+using namespace grace;
+
+namespace {
+	const size_t THRESHOLD = BigArray<byte>::LARGE_ALLOCATION_THRESHOLD;
+}
+
+SUITE(BigArray) {
+	it("should have 64-bit sizes", []() {
+		BigArray<byte> a;
+		TEST(sizeof(a.size())).should == sizeof(uint64);
+		TEST(sizeof(a.capacity())).should == sizeof(uint64);
+	});
+	
+	it("should keep its contents when growing past the large allocation threshold", []() {
+		StatsAllocator stats(default_allocator());
+		BigArray<uint32> a(stats);
+		size_t n = 3 * THRESHOLD / sizeof(uint32);
+		for (size_t i = 0; i < n; ++i) {
+			a.push_back((uint32)i);
+		}
+		TEST(a.size()).should == n;
+		bool all_equal = true;
+		for (size_t i = 0; i < n; ++i) {
+			all_equal = all_equal && a[i] == i;
+		}
+		TEST(all_equal).should == true;
+		TEST(stats.stats().num_reallocations).should > 0;
+		a.clear();
+		TEST(stats.stats().bytes_in_flight).should == 0;
+	});
+	
+	it("should move elements that aren't trivially copyable into large allocations", []() {
+		BigArray<String> a;
+		size_t n = 2 * THRESHOLD / sizeof(String);
+		for (size_t i = 0; i < n; ++i) {
+			a.emplace_back(i % 2 ? "a string too long to be stored inline" : "short");
+		}
+		TEST(a.size()).should == n;
+		TEST(a[0]).should == "short";
+		TEST(a[n-1]).should == "a string too long to be stored inline";
+	});
+	
+	it("should work with read_all", []() {
+		BigArray<byte> input;
+		input.resize(2 * THRESHOLD + 17, 'x');
+		MemoryStream stream(input.data(), input.data() + input.size());
+		auto output = read_all<BigArray<byte>>(stream);
+		TEST(output.size()).should == input.size();
+		TEST(output.back()).should == 'x';
+	});
+	
+	benchmark("appending 64 MiB in 1 KiB pieces", []() {
+		byte chunk[1024] = {0};
+		BigArray<byte> a;
+		for (size_t i = 0; i < 64 * 1024; ++i) {
+			a.insert(chunk, chunk + sizeof(chunk));
+		}
+	});
+}
@@ -0,0 +1,138 @@
+//
+//  concurrent_queue_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/concurrent_queue.hpp"
+#include "base/function.hpp"
+#include "memory/unique_ptr.hpp"
+
+#include <atomic>
+#include <thread>
+
+using namespace grace;
+
+SUITE(ConcurrentQueue) {
+	it("should push and pop in order until full", []() {
+		SPSCQueue<int> q(3);
+		TEST(q.capacity()).should == 4;
+		for (int i = 0; i < 4; ++i) {
+			TEST(q.try_push(i)).should == true;
+		}
+		TEST(q.try_push(4)).should == false;
+		int x = -1;
+		for (int i = 0; i < 4; ++i) {
+			TEST(q.try_pop(x)).should == true;
+			TEST(x).should == i;
+		}
+		TEST(q.try_pop(x)).should == false;
+	});
+	
+	it("should hold move-only payloads", []() {
+		MPMCQueue<UniquePtr<int>> q(4);
+		TEST(q.try_push(make_unique<int>(default_allocator(), 123))).should == true;
+		TEST(q.try_push(make_unique<int>(default_allocator(), 456))).should == true;
+		UniquePtr<int> p;
+		TEST(q.try_pop(p)).should == true;
+		TEST(*p).should == 123;
+		// The remaining element is destroyed with the queue.
+		
+		SPSCQueue<Function<int()>> functions(2);
+		functions.try_push([]() { return 7; });
+		Function<int()> f;
+		TEST(functions.try_pop(f)).should == true;
+		TEST(f()).should == 7;
+	});
+	
+	it("should hand elements from one thread to another", []() {
+		static const int N = 100000;
+		SPSCQueue<int> q(64);
+		std::thread producer([&]() {
+			for (int i = 0; i < N; ++i) {
+				while (!q.try_push(i)) std::this_thread::yield();
+			}
+		});
+		bool in_order = true;
+		int x;
+		for (int i = 0; i < N; ++i) {
+			while (!q.try_pop(x)) std::this_thread::yield();
+			in_order = in_order && x == i;
+		}
+		producer.join();
+		TEST(in_order).should == true;
+	});
+	
+	it("should deliver every element once with many producers and consumers", []() {
+		static const int NUM_THREADS = 4;
+		static const int PER_THREAD = 20000;
+		MPMCQueue<int> q(128);
+		std::atomic<int64> sum(0);
+		std::atomic<int> received(0);
+		std::thread producers[NUM_THREADS];
+		std::thread consumers[NUM_THREADS];
+		for (int t = 0; t < NUM_THREADS; ++t) {
+			producers[t] = std::thread([&q, t]() {
+				for (int i = 1; i <= PER_THREAD; ++i) {
+					while (!q.try_push(t * PER_THREAD + i)) std::this_thread::yield();
+				}
+			});
+			consumers[t] = std::thread([&]() {
+				int x;
+				while (received.load() < NUM_THREADS * PER_THREAD) {
+					if (q.try_pop(x)) {
+						sum += x;
+						++received;
+					} else {
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+		for (auto& t: producers) t.join();
+		for (auto& t: consumers) t.join();
+		int64 n = NUM_THREADS * PER_THREAD;
+		TEST(received.load()).should == n;
+		TEST(sum.load()).should == n * (n + 1) / 2;
+	});
+	
+	it("should let thieves steal each element of a work-stealing deque once", []() {
+		static const int NUM_THIEVES = 3;
+		static const int N = 100000;
+		WorkStealingDeque<int> deque(4); // small, to make it grow while thieves are reading
+		std::atomic<int64> sum(0);
+		std::atomic<int> taken(0);
+		std::thread thieves[NUM_THIEVES];
+		for (auto& thief: thieves) {
+			thief = std::thread([&]() {
+				int x;
+				while (taken.load() < N) {
+					if (deque.steal(x)) {
+						sum += x;
+						++taken;
+					} else {
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+		// The owner takes some back itself, from the other end.
+		int x;
+		for (int i = 1; i <= N; ++i) {
+			deque.push(i);
+			if (i % 3 == 0 && deque.pop(x)) {
+				sum += x;
+				++taken;
+			}
+		}
+		while (taken.load() < N) {
+			if (deque.pop(x)) {
+				sum += x;
+				++taken;
+			}
+		}
+		for (auto& thief: thieves) thief.join();
+		TEST(taken.load()).should == N;
+		TEST(sum.load()).should == (int64)N * (N + 1) / 2;
+	});
+}
@@ -0,0 +1,57 @@
+//
+//  editor_universe_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "object/editor_universe.hpp"
+#include "object/reflect.hpp"
+#include "io/string_stream.hpp"
+
+using namespace grace;
+
+struct EditorThing : Object {
+	REFLECT;
+	int32 number = 0;
+};
+
+BEGIN_TYPE_INFO(EditorThing)
+	property(&EditorThing::number, "number", "Number.");
+END_TYPE_INFO()
+
+SUITE(EditorUniverse) {
+	it("should keep short object IDs valid as more objects are added", []() {
+		EditorUniverse universe;
+		const size_t N = 100;
+		Array<ObjectPtr<EditorThing>> objects;
+		Array<StringRef> ids;
+		for (size_t i = 0; i < N; ++i) {
+			StringStream ss;
+			ss << "t" << i;
+			String id = ss.string();
+			objects.push_back(universe.create<EditorThing>(id));
+			ids.push_back(universe.get_id(objects.back()));
+		}
+		for (size_t i = 0; i < N; ++i) {
+			StringStream ss;
+			ss << "t" << i;
+			String id = ss.string();
+			TEST(ids[i]).should == id;
+			TEST(universe.get_id(objects[i])).should == id;
+			TEST(universe.get_object(id) == objects[i]).should == true;
+		}
+	});
+	
+	it("should look up renamed objects by their new ID only", []() {
+		EditorUniverse universe;
+		ObjectPtr<EditorThing> a = universe.create<EditorThing>("aa");
+		ObjectPtr<EditorThing> b = universe.create<EditorThing>("bb");
+		TEST(universe.rename_object(a, "cc")).should == true;
+		TEST(universe.get_id(a)).should == "cc";
+		TEST(universe.get_object("cc") == a).should == true;
+		TEST(universe.get_object("aa") == nullptr).should == true;
+		TEST(universe.rename_object(b, "cc")).should == false;
+		TEST(universe.get_id(b)).should != "cc";
+		TEST(universe.get_object(universe.get_id(b)) == b).should == true;
+	});
+}
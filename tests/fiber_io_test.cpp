@@ -0,0 +1,95 @@
+//
+//  fiber_io_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/fiber.hpp"
+#include "event/event_loop.hpp"
+#include "io/fiber_io.hpp"
+#include "io/pipe_stream.hpp"
+
+#include <unistd.h>
+
+using namespace grace;
+
+namespace {
+	struct Pipe {
+		InputPipeStream in;
+		OutputPipeStream out;
+		Pipe() {
+			int fds[2];
+			::pipe(fds);
+			in = InputPipeStream(fds[0]);
+			out = OutputPipeStream(fds[1]);
+			in.set_nonblocking(true);
+			out.set_nonblocking(true);
+		}
+	};
+}
+
+SUITE(FiberIO) {
+	it("should park a reading fiber until the event loop sees data", []() {
+		auto loop = create_event_loop();
+		FiberManager manager;
+		manager.set_event_loop(loop.get());
+		Pipe pipe;
+		String received;
+		manager.launch([&]() {
+			byte buffer[16];
+			auto r = read_in_fiber(pipe.in, buffer, sizeof(buffer));
+			TEST(r.is_a<size_t>()).should == true;
+			received = String((const char*)buffer, r.get<size_t>());
+		});
+		manager.update(GameTime());
+		TEST(received).should == "";
+		
+		int updates = 0;
+		auto writer = loop->schedule([&]() {
+			write_in_fiber(pipe.out, (const byte*)"hello", 5); // doesn't wait, with room in the pipe
+		}, SystemTime::milliseconds(5));
+		auto updater = loop->call_repeatedly([&]() {
+			manager.update(GameTime());
+			if (++updates == 1000 || received != "") loop->quit();
+		}, SystemTime::milliseconds(1));
+		loop->run();
+		TEST(received).should == "hello";
+	});
+	
+	it("should time out waiting for a descriptor", []() {
+		auto loop = create_event_loop();
+		FiberManager manager;
+		manager.set_event_loop(loop.get());
+		Pipe pipe;
+		bool done = false;
+		Either<size_t, IOEvent> result = (size_t)0;
+		manager.launch([&]() {
+			byte buffer[16];
+			result = read_in_fiber(pipe.in, buffer, sizeof(buffer), SystemTime::milliseconds(10));
+			done = true;
+		});
+		manager.update(GameTime());
+		auto updater = loop->call_repeatedly([&]() {
+			manager.update(GameTime());
+			if (done) loop->quit();
+		}, SystemTime::milliseconds(1));
+		loop->run();
+		TEST(result.is_a<IOEvent>()).should == true;
+		TEST(result.get<IOEvent>() == IOEvent::Timeout).should == true;
+	});
+	
+	it("should poll descriptors when the manager has no event loop", []() {
+		FiberManager manager;
+		Pipe pipe;
+		bool readable = false;
+		manager.launch([&]() {
+			readable = Fiber::await_readable(pipe.in.descriptor());
+		});
+		manager.update(GameTime());
+		manager.update(GameTime());
+		TEST(readable).should == false;
+		pipe.out.write((const byte*)"x", 1);
+		manager.update(GameTime());
+		TEST(readable).should == true;
+	});
+}
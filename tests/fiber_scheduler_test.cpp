@@ -0,0 +1,125 @@
+//
+//  fiber_scheduler_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/fiber_scheduler.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace grace;
+
+SUITE(FiberScheduler) {
+	it("should run every fiber of a parallel launch once", []() {
+		FiberScheduler scheduler(4);
+		TEST(scheduler.num_workers()).should == 4;
+		std::atomic<int64> sum(0);
+		std::atomic<int> runs(0);
+		scheduler.parallel_launch(1000, [&](size_t i) {
+			sum += (int64)i;
+			++runs;
+		});
+		scheduler.update(GameTime());
+		TEST(runs.load()).should == 1000;
+		TEST(sum.load()).should == 999 * 1000 / 2;
+		scheduler.update(GameTime());
+		TEST(runs.load()).should == 1000;
+	});
+	
+	it("should resume yielding and sleeping fibers like FiberManager", []() {
+		FiberScheduler scheduler(3);
+		std::atomic<int> yields(0);
+		std::atomic<int> woken(0);
+		std::atomic<int> children(0);
+		for (int i = 0; i < 8; ++i) {
+			scheduler.launch([&]() {
+				Fiber::yield();
+				++yields;
+				Fiber::sleep(GameTime::seconds(1.f));
+				++woken;
+				Fiber::current()->owner()->launch([&]() { ++children; });
+			});
+		}
+		scheduler.update(GameTime());
+		TEST(yields.load()).should == 0;
+		scheduler.update(GameTime());
+		TEST(yields.load()).should == 8;
+		TEST(woken.load()).should == 0;
+		scheduler.update(GameTime() + GameTime::seconds(1.f));
+		TEST(woken.load()).should == 8;
+		TEST(children.load()).should == 8; // fibers launched from fibers run in the same update
+	});
+	
+	it("should spread work over its worker threads", []() {
+		FiberScheduler scheduler(4);
+		std::mutex mutex;
+		std::set<std::thread::id> threads;
+		scheduler.parallel_launch(64, [&](size_t) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			std::lock_guard<std::mutex> lock(mutex);
+			threads.insert(std::this_thread::get_id());
+		});
+		scheduler.update(GameTime());
+		TEST(threads.size() > 1).should == true;
+	});
+	
+	it("should rethrow unhandled exceptions after the other fibers are done", []() {
+		struct TestException {};
+		FiberScheduler scheduler(2);
+		std::atomic<int> runs(0);
+		scheduler.parallel_launch(100, [&](size_t i) {
+			++runs;
+			if (i == 50) throw TestException();
+		});
+		should_throw_exception<TestException>([&]() {
+			scheduler.update(GameTime());
+		});
+		TEST(runs.load()).should == 100;
+	});
+	
+	it("should unwind sleeping fibers when the scheduler goes away", []() {
+		std::atomic<int> destroyed(0);
+		struct CountOnDestroy {
+			std::atomic<int>& n;
+			CountOnDestroy(std::atomic<int>& n) : n(n) {}
+			~CountOnDestroy() { ++n; }
+		};
+		{
+			FiberScheduler scheduler(2);
+			scheduler.parallel_launch(10, [&](size_t) {
+				CountOnDestroy scoped(destroyed);
+				while (true) Fiber::yield();
+			});
+			scheduler.update(GameTime());
+			scheduler.update(GameTime());
+			TEST(destroyed.load()).should == 0;
+		}
+		TEST(destroyed.load()).should == 10;
+	});
+	
+	benchmark("run 10000 small fibers on one worker", []() {
+		FiberScheduler scheduler(1);
+		std::atomic<int64> sum(0);
+		scheduler.parallel_launch(10000, [&](size_t i) {
+			int64 x = 0;
+			for (size_t j = 0; j < 1000; ++j) x += (int64)(i ^ j);
+			sum += x;
+		});
+		scheduler.update(GameTime());
+	});
+	
+	benchmark("run 10000 small fibers on all cores", []() {
+		FiberScheduler scheduler;
+		std::atomic<int64> sum(0);
+		scheduler.parallel_launch(10000, [&](size_t i) {
+			int64 x = 0;
+			for (size_t j = 0; j < 1000; ++j) x += (int64)(i ^ j);
+			sum += x;
+		});
+		scheduler.update(GameTime());
+	});
+}
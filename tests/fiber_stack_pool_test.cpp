@@ -0,0 +1,72 @@
+//
+//  fiber_stack_pool_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/fiber.hpp"
+#include "base/fiber_stack_pool.hpp"
+#include "base/stack_array.hpp"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace grace;
+
+SUITE(FiberStackPool) {
+	it("should reuse released stacks", []() {
+		FiberStackPool pool(0x10000);
+		FiberStack a = pool.acquire();
+		TEST(pool.num_in_use()).should == 1;
+		pool.release(a);
+		TEST(pool.num_cached()).should == 1;
+		FiberStack b = pool.acquire();
+		TEST(b.bottom).should == a.bottom;
+		TEST(pool.num_cached()).should == 0;
+		pool.release(b);
+	});
+	
+	it("should measure how deep a stack has been used", []() {
+		FiberStackPool pool(0x10000);
+		FiberStack stack = pool.acquire();
+		TEST(FiberStackPool::high_water_mark(stack)).should == 0;
+		memset(stack.top() - 10000, 0xff, 10000);
+		TEST(FiberStackPool::high_water_mark(stack)).should == 10000;
+		TEST(pool.release(stack)).should == 10000;
+		TEST(pool.peak_high_water_mark()).should == 10000;
+		stack = pool.acquire();
+		TEST(FiberStackPool::high_water_mark(stack)).should == 0;
+		pool.release(stack);
+	});
+	
+	it("should report the stack use of a fiber", []() {
+		FiberManager manager;
+		size_t used = 0;
+		manager.launch([&]() {
+			DEFINE_STACK_ARRAY(uint64, numbers, 1024);
+			for (size_t i = 0; i < 1024; ++i) {
+				numbers[i] = i + 1;
+			}
+			used = Fiber::current()->stack_high_water_mark();
+		});
+		manager.update(GameTime());
+		TEST(used >= 8192).should == true;
+		TEST(used < Fiber::STACK_SIZE).should == true;
+	});
+	
+	it("should fault when a stack overflows", []() {
+		FiberStackPool pool(0x10000);
+		FiberStack stack = pool.acquire();
+		pid_t pid = fork();
+		if (pid == 0) {
+			stack.bottom[-1] = 1; // into the guard page
+			_exit(0);
+		}
+		int status = 0;
+		waitpid(pid, &status, 0);
+		TEST(WIFSIGNALED(status)).should == true;
+		TEST(WTERMSIG(status)).should == SIGSEGV;
+		pool.release(stack);
+	});
+}
@@ -80,6 +80,39 @@ SUITE(Fiber) {
 		TEST(fiber1_timeout).should == true;
 	});
 	
+	it("should wake fibers due at the same time in the order they went to sleep", []() {
+		FiberManager manager;
+		Array<int> order;
+		for (int i = 0; i < 4; ++i) {
+			manager.launch([&, i]() {
+				Fiber::sleep(GameTime::seconds(i < 2 ? 2.f : 1.f));
+				order.push_back(i);
+			});
+		}
+		manager.update(GameTime());
+		manager.update(GameTime() + GameTime::seconds(3.f));
+		TEST(order.size()).should == 4;
+		TEST(order[0]).should == 2;
+		TEST(order[1]).should == 3;
+		TEST(order[2]).should == 0;
+		TEST(order[3]).should == 1;
+	});
+	
+	it("should resume a fiber at most once per update", []() {
+		FiberManager manager;
+		int num_resumes = 0;
+		manager.launch([&]() {
+			while (true) {
+				++num_resumes;
+				Fiber::sleep(GameTime::seconds(0.f));
+			}
+		});
+		manager.update(GameTime());
+		TEST(num_resumes).should == 1;
+		manager.update(GameTime());
+		TEST(num_resumes).should == 2;
+	});
+	
 	it("should call destructors when terminating a fiber", []() {
 		FiberManager manager;
 		bool destructor_called = false;
@@ -180,6 +213,52 @@ SUITE(Fiber) {
 		}
 		TEST(good).should == true;
 	});
+	
+	it("should unwind sleeping fibers when the manager goes away", []() {
+		bool destructor_called = false;
+		struct SetTrueOnDestroy {
+			bool& b;
+			SetTrueOnDestroy(bool& b) : b(b) {}
+			~SetTrueOnDestroy() { b = true; }
+		};
+		{
+			FiberManager manager;
+			manager.launch([&]() {
+				SetTrueOnDestroy scoped(destructor_called);
+				while (true) Fiber::yield();
+			});
+			manager.update(GameTime());
+			manager.update(GameTime());
+			TEST(destructor_called).should == false;
+		}
+		TEST(destructor_called).should == true;
+	});
+	
+	benchmark("yield and resume a fiber 10000 times", []() {
+		FiberManager manager;
+		int n = 0;
+		manager.launch([&]() {
+			while (true) {
+				++n;
+				Fiber::yield();
+			}
+		});
+		for (int i = 0; i < 10000; ++i) {
+			manager.update(GameTime());
+		}
+	});
+	benchmark("update 1000 times with 10000 sleeping fibers", []() {
+		FiberManager manager;
+		for (int i = 0; i < 10000; ++i) {
+			manager.launch([]() {
+				Fiber::sleep(GameTime::seconds(1000.f));
+			});
+		}
+		manager.update(GameTime());
+		for (int i = 0; i < 1000; ++i) {
+			manager.update(GameTime() + GameTime::milliseconds(i));
+		}
+	});
 }
 
 #endif
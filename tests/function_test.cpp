@@ -9,6 +9,7 @@
 #include "tests/test.hpp"
 #include "base/function.hpp"
 #include "base/function_error.hpp"
+#include "memory/stats_allocator.hpp"
 
 using namespace grace;
 
@@ -95,6 +96,32 @@ SUITE(Function) {
 		TEST(number).should == 123;
 	});
 	
+	it("should store small function objects inline", []() {
+		StatsAllocator stats(default_allocator());
+		int a = 0, b = 0;
+		Function<void(int)> f([&](int n) { a = n; b = n; }, stats);
+		Function<void(int)> g(f, stats);
+		Function<void(int)> h(move(f), stats);
+		g(1);
+		h(2);
+		TEST(a).should == 2;
+		TEST(b).should == 2;
+		TEST((bool)f).should == false;
+		TEST(stats.stats().num_allocations).should == 0;
+	});
+	
+	it("should allocate large function objects with the given allocator", []() {
+		StatsAllocator stats(default_allocator());
+		StatsAllocator other(default_allocator());
+		int64 numbers[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+		Function<int64(size_t)> f([=](size_t i) { return numbers[i]; }, stats);
+		TEST(stats.stats().num_allocations).should == 1;
+		Function<int64(size_t)> g(move(f), other);
+		TEST(other.stats().num_allocations).should == 1;
+		TEST(stats.stats().num_frees).should == 1;
+		TEST(g(7)).should == 8;
+	});
+	
 	it("should throw exception on empty call", []() {
 		Function<void()> f;
 		should_throw_exception<EmptyFunctionCallError>([&]() {
@@ -0,0 +1,83 @@
+//
+//  hash_map_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/hash_map.hpp"
+
+using namespace grace;
+
+SUITE(HashMap) {
+	it("should map integers with set and subscript operator", []() {
+		HashMap<int, int> m;
+		m.set(1, 2);
+		m[3] = 4;
+		m.set(1, 4);
+		TEST(m.size()).should == 2;
+		TEST(m[1]).should == 4;
+		TEST(m[3]).should == 4;
+		TEST(m.count(2)).should == 0;
+	});
+	
+	it("should look up String keys with StringRefs and literals", []() {
+		HashMap<String, int> m;
+		m["foo"] = 123;
+		StringRef s = "Hello World!";
+		m[s] = 10;
+		TEST(m[s]).should == 10;
+		TEST(m.find(StringRef("foo")) != m.end()).should == true;
+		TEST(m.find("bar") == m.end()).should == true;
+		const HashMap<String, int>& cm = m;
+		TEST(cm.find("foo")->second).should == 123;
+		TEST(cm.count("bar")).should == 0;
+	});
+	
+	it("should keep entries dense while erasing during iteration", []() {
+		HashMap<int, int> m;
+		for (int i = 0; i < 100; ++i) {
+			m[i] = i * 10;
+		}
+		for (auto it = m.begin(); it != m.end();) {
+			if (it->first % 3 == 0) {
+				it = m.erase(it);
+			} else {
+				++it;
+			}
+		}
+		TEST(m.size()).should == 66;
+		TEST(m.keys().size()).should == 66;
+		for (int i = 0; i < 100; ++i) {
+			auto it = m.find(i);
+			if (i % 3 == 0) {
+				TEST(it == m.end()).should == true;
+			} else {
+				TEST(it->second).should == i * 10;
+			}
+		}
+	});
+	
+	it("should survive many inserts and erases", []() {
+		HashMap<uint32, uint32> m;
+		for (uint32 round = 0; round < 4; ++round) {
+			for (uint32 i = 0; i < 10000; ++i) {
+				m[i] = i + round;
+			}
+			for (uint32 i = 0; i < 10000; i += 2) {
+				m.erase(i);
+			}
+		}
+		TEST(m.size()).should == 5000;
+		TEST(m.bucket_count() <= 16384).should == true; // Tombstones were reclaimed, not grown past.
+		bool all_found = true;
+		for (uint32 i = 1; i < 10000; i += 2) {
+			all_found = all_found && m[i] == i + 3;
+		}
+		TEST(all_found).should == true;
+		
+		HashMap<uint32, uint32> copy = m;
+		TEST(copy == m).should == true;
+		copy.erase(1);
+		TEST(copy == m).should == false;
+	});
+}
@@ -0,0 +1,74 @@
+//
+//  indexed_priority_queue_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+
+#include "base/indexed_priority_queue.hpp"
+#include "base/priority_queue.hpp"
+
+using namespace grace;
+
+SUITE(IndexedPriorityQueue) {
+	it("should pop elements in order", []() {
+		IndexedPriorityQueue<int> q;
+		for (int i: {1, 10, 2, 9, 3, 8, 4, 7, 5, 6}) {
+			q.insert(i);
+		}
+		Array<int> popped;
+		while (q.size()) {
+			popped.push_back(q.pop());
+		}
+		TEST(popped).should == Array<int>({10, 9, 8, 7, 6, 5, 4, 3, 2, 1});
+	});
+	
+	it("should reprioritize and erase elements by handle", []() {
+		IndexedPriorityQueue<int, Greater> q;
+		Array<IndexedPriorityQueue<int, Greater>::Handle> handles;
+		for (int i = 0; i < 100; ++i) {
+			handles.push_back(q.insert(i * 10));
+		}
+		q.update(handles[50], -1);
+		TEST(q.top()).should == -1;
+		TEST(q.top_handle() == handles[50]).should == true;
+		q.update(handles[50], 5000);
+		TEST(q.top()).should == 0;
+		TEST(q.erase(handles[0])).should == 0;
+		TEST(q.erase(handles[1])).should == 10;
+		TEST(q.contains(handles[1])).should == false;
+		TEST(q[handles[99]]).should == 990;
+		TEST(q.size()).should == 98;
+		int previous = q.pop();
+		while (q.size()) {
+			int next = q.pop();
+			TEST(previous <= next).should == true;
+			previous = next;
+		}
+		TEST(previous).should == 5000;
+	});
+	
+	benchmark("reschedule 10000 of 10000 elements in PriorityQueue", []() {
+		PriorityQueue<int> q;
+		for (int i = 0; i < 10000; ++i) {
+			q.insert((i * 7919) % 10007);
+		}
+		for (int i = 0; i < 10000; ++i) {
+			auto it = q.find((i * 7919) % 10007);
+			q.erase(it);
+			q.insert(20000 + i);
+		}
+	});
+	
+	benchmark("reschedule 10000 of 10000 elements in IndexedPriorityQueue", []() {
+		IndexedPriorityQueue<int> q;
+		Array<IndexedPriorityQueue<int>::Handle> handles;
+		handles.reserve(10000);
+		for (int i = 0; i < 10000; ++i) {
+			handles.push_back(q.insert((i * 7919) % 10007));
+		}
+		for (int i = 0; i < 10000; ++i) {
+			q.update(handles[i], 20000 + i);
+		}
+	});
+}
@@ -8,9 +8,35 @@
 
 #include "tests/test.hpp"
 #include "base/map.hpp"
+#include "base/set.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
+#include <stdexcept>
 
 using namespace grace;
 
+namespace {
+	struct ThrowingKey {
+		int n = 0;
+		ThrowingKey() {}
+		explicit ThrowingKey(int n) : n(n) {
+			if (n < 0) throw std::runtime_error("negative key");
+		}
+		ThrowingKey& operator=(int other) { return *this = ThrowingKey(other); }
+		bool operator<(const ThrowingKey& other) const { return n < other.n; }
+		bool operator<(int other) const { return n < other; }
+		bool operator==(int other) const { return n == other; }
+		bool operator!=(int other) const { return n != other; }
+	};
+	bool operator<(int a, const ThrowingKey& b) { return a < b.n; }
+}
+
+namespace grace {
+	template <> struct IsTriviallyRelocatable<ThrowingKey> {
+		static const bool Value = true;
+	};
+}
+
 SUITE(Map) {
 	it("should map integers with set", []() {
 		Map<int, int> m;
@@ -66,4 +92,108 @@ SUITE(Map) {
 		m.erase(2);
 		TEST(m.find(2) == m.end()).should == true;
 	});
+	
+	it("should insert and erase Strings in the middle", []() {
+		Map<String, String> m;
+		for (int i = 0; i < 20; i += 2) {
+			char key = 'a' + i;
+			m[String(&key, 1)] = "a string too long to be stored inline";
+		}
+		m["b"] = "short";
+		m["d"] = "another string too long to be stored inline";
+		TEST(m.size()).should == 12;
+		m.erase("a");
+		m.erase("c");
+		TEST(m.size()).should == 10;
+		TEST(m.begin()->first).should == "b";
+		TEST(m["b"]).should == "short";
+		TEST(m["d"]).should == "another string too long to be stored inline";
+		TEST(m["s"]).should == "a string too long to be stored inline";
+	});
+	
+	it("should be left as it was when constructing an inserted key throws", []() {
+		Map<ThrowingKey, String> m;
+		m.set(1, "a string too long to be stored inline");
+		m.set(3, "c");
+		m.set(5, "e");
+		bool threw = false;
+		try {
+			m.set(-2, "never");
+		}
+		catch (const std::runtime_error&) {
+			threw = true;
+		}
+		TEST(threw).should == true;
+		TEST(m.size()).should == 3;
+		TEST(m.find(1)->second).should == "a string too long to be stored inline";
+		TEST(m.find(3)->second).should == "c";
+		TEST(m.find(5)->second).should == "e";
+		m.set(2, "b");
+		TEST(m.size()).should == 4;
+		TEST(m.find(2)->second).should == "b";
+	});
+	
+	it("should bulk insert unsorted entries, with later entries winning", []() {
+		Map<int, String> m;
+		m[4] = "old four";
+		m[7] = "seven";
+		Pair<int, String> entries[] = {{5, "five"}, {1, "one"}, {4, "four"}, {5, "another five"}, {9, "nine"}};
+		m.insert_unsorted_bulk(entries, entries + 5);
+		static const int correct[] = {1, 4, 5, 7, 9};
+		TEST(m.keys()).should == ArrayRef<const int>(correct);
+		TEST(m[4]).should == "four";
+		TEST(m[5]).should == "another five";
+		TEST(m[7]).should == "seven";
+		TEST(entries[2].second).should == "four"; // the input is left alone
+	});
+	
+	it("should merge and build from sorted maps", []() {
+		Map<int, int> a = {{1, 10}, {3, 30}, {5, 50}};
+		Map<int, int> b = {{2, 200}, {3, 300}, {6, 600}};
+		a.merge(b);
+		static const int correct[] = {1, 2, 3, 5, 6};
+		TEST(a.keys()).should == ArrayRef<const int>(correct);
+		TEST(a[3]).should == 300;
+		TEST(b.size()).should == 3;
+		Map<int, int> c;
+		c.build_from_sorted(a.begin(), a.end());
+		TEST(c.keys()).should == a.keys();
+		TEST(c[3]).should == 300;
+		c.merge(move(b));
+		TEST(b.size()).should == 0;
+		TEST(c.size()).should == 5;
+	});
+	
+	it("should bulk insert into Sets and Dictionaries", []() {
+		Set<int> s = {3, 8};
+		int elements[] = {5, 3, 1, 5, 9};
+		s.insert_unsorted_bulk(elements, elements + 5);
+		static const int correct[] = {1, 3, 5, 8, 9};
+		TEST(s == ArrayRef<int>(correct)).should == true;
+		
+		Dictionary<int> d;
+		d["b"] = 1;
+		Pair<String, int> entries[] = {{"c", 3}, {"a", 2}, {"b", 4}};
+		d.insert_unsorted_bulk(entries, entries + 3);
+		TEST(d.size()).should == 3;
+		TEST(d.begin()->first).should == "a";
+		TEST(d["b"]).should == 4;
+	});
+	
+	benchmark("insert 10000 unsorted keys one at a time", []() {
+		Map<int, int> m;
+		for (int i = 0; i < 10000; ++i) {
+			m[(i * 7919) % 10007] = i;
+		}
+	});
+	
+	benchmark("insert 10000 unsorted keys in bulk", []() {
+		Array<Pair<int, int>> entries;
+		entries.reserve(10000);
+		for (int i = 0; i < 10000; ++i) {
+			entries.push_back(Pair<int, int>{(i * 7919) % 10007, i});
+		}
+		Map<int, int> m;
+		m.insert_unsorted_bulk(entries.begin(), entries.end());
+	});
 }
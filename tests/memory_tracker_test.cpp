@@ -0,0 +1,92 @@
+//
+//  memory_tracker_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "memory/memory_tracker.hpp"
+#include "io/string_stream.hpp"
+
+#include <thread>
+
+using namespace grace;
+
+namespace {
+	// The tracker never touches tracked memory, so any distinct addresses will do.
+	void* fake_address(size_t n) {
+		return (void*)(uintptr_t)(0x100000 + n * 16);
+	}
+}
+
+SUITE(MemoryTracker) {
+	it("should grow instead of running out of room", []() {
+		MemoryTracker tracker;
+		tracker.start();
+		static const size_t N = 100000;
+		for (size_t i = 0; i < N; ++i) {
+			tracker.track_allocation(fake_address(i), 32);
+		}
+		TEST(tracker.num_live_allocations()).should == N;
+		for (size_t i = 0; i < N; i += 2) {
+			tracker.track_free(fake_address(i));
+		}
+		TEST(tracker.num_live_allocations()).should == N / 2;
+		TEST(tracker.get_allocation(fake_address(1)).is_set()).should == true;
+		TEST(tracker.get_allocation(fake_address(2)).is_set()).should == false;
+		Array<MemoryLeak> leaks;
+		tracker.stop();
+		tracker.get_results(leaks);
+		TEST(leaks.size()).should == N / 2;
+	});
+
+	it("should sample about one allocation per interval", []() {
+		MemoryTracker tracker;
+		tracker.start_sampling(4096);
+		TEST(tracker.is_sampling()).should == true;
+		static const size_t N = 200000; // 64 bytes each, so ~3125 samples.
+		for (size_t i = 0; i < N; ++i) {
+			tracker.track_allocation(fake_address(i), 64);
+		}
+		size_t samples = tracker.num_live_allocations();
+		TEST(samples > 2800 && samples < 3450).should == true;
+		for (size_t i = 0; i < N; ++i) {
+			tracker.track_free(fake_address(i));
+		}
+		TEST(tracker.num_live_allocations()).should == 0;
+	});
+
+	it("should record from several threads at once", []() {
+		MemoryTracker tracker;
+		tracker.start();
+		static const int NUM_THREADS = 4;
+		static const size_t N = 20000;
+		std::thread threads[NUM_THREADS];
+		for (int t = 0; t < NUM_THREADS; ++t) {
+			threads[t] = std::thread([&tracker, t]() {
+				for (size_t i = 0; i < N; ++i) {
+					tracker.track_allocation(fake_address(t * N + i), 16);
+				}
+				for (size_t i = 0; i < N; i += 2) {
+					tracker.track_free(fake_address(t * N + i));
+				}
+			});
+		}
+		for (auto& t: threads) {
+			t.join();
+		}
+		TEST(tracker.num_live_allocations()).should == NUM_THREADS * N / 2;
+	});
+
+	it("should write a pprof heap profile", []() {
+		MemoryTracker tracker;
+		tracker.start_sampling(1024);
+		for (size_t i = 0; i < 1000; ++i) {
+			tracker.track_allocation(fake_address(i), 512);
+		}
+		StringStream out;
+		tracker.write_heap_profile(out);
+		String profile = out.string();
+		TEST(find(profile, "heap profile: ")).should == 0;
+		TEST(find(profile, "] @ heap_v2/1024\n") != String::NPos).should == true;
+	});
+}
@@ -0,0 +1,85 @@
+//
+//  object_pool_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "memory/object_pool.hpp"
+#include "object/reflect.hpp"
+#include "object/universe_base.hpp"
+
+using namespace grace;
+
+struct PooledThing : Object {
+	REFLECT;
+	int32 number = 0;
+};
+
+BEGIN_TYPE_INFO(PooledThing)
+	property(&PooledThing::number, "number", "Number.");
+END_TYPE_INFO()
+
+SUITE(ObjectPool) {
+	it("should hand out adjacent slots", []() {
+		ObjectPool pool(default_allocator(), 40, 8);
+		TEST(pool.slot_size()).should == 40;
+		byte* a = (byte*)pool.allocate();
+		byte* b = (byte*)pool.allocate();
+		TEST(b - a).should == 40;
+		TEST(pool.size()).should == 2;
+		TEST(pool.num_chunks()).should == 1;
+	});
+
+	it("should reuse freed slots before adding chunks", []() {
+		ObjectPool pool(default_allocator(), 256, 16);
+		void* slots[ObjectPool::MAX_SLOTS_PER_CHUNK];
+		size_t n = pool.slots_per_chunk();
+		for (size_t i = 0; i < n; ++i) {
+			slots[i] = pool.allocate();
+		}
+		pool.free(slots[3]);
+		TEST(pool.allocate() == slots[3]).should == true;
+		TEST(pool.num_chunks()).should == 1;
+		pool.allocate();
+		TEST(pool.num_chunks()).should == 2;
+	});
+
+	it("should visit only allocated slots", []() {
+		ObjectPool pool(default_allocator(), sizeof(int), alignof(int));
+		int* numbers[200];
+		for (int i = 0; i < 200; ++i) {
+			numbers[i] = (int*)pool.allocate();
+			*numbers[i] = i;
+		}
+		for (int i = 0; i < 200; i += 2) {
+			pool.free(numbers[i]);
+		}
+		int count = 0;
+		bool odd = true;
+		pool.each([&](void* p) {
+			++count;
+			odd = odd && (*(int*)p % 2) == 1;
+		});
+		TEST(count).should == 100;
+		TEST(odd).should == true;
+	});
+
+	it("should keep universe objects of one type together", []() {
+		TestUniverse universe;
+		for (int i = 0; i < 100; ++i) {
+			universe.create<PooledThing>("thing")->number = i;
+		}
+		int count = 0;
+		bool in_order = true;
+		universe.each_object_of_type(get_type<PooledThing>(), [&](Object* object) {
+			in_order = in_order && static_cast<PooledThing*>(object)->number == count;
+			++count;
+		});
+		TEST(count).should == 100;
+		TEST(in_order).should == true;
+		universe.clear();
+		count = 0;
+		universe.each_object([&](Object*) { ++count; });
+		TEST(count).should == 0;
+	});
+}
@@ -15,6 +15,7 @@
 #include "object/object.hpp"
 #include "object/reflect.hpp"
 #include "object/universe.hpp"
+#include "memory/stats_allocator.hpp"
 
 using namespace grace;
 
@@ -235,6 +236,40 @@ SUITE(Signal) {
 		TEST(fired2).should == 2;
 		TEST(fired3).should == 3;
 	});
+	
+	it("should connect functions and small lambdas without allocating", []() {
+		StatsAllocator stats(default_allocator());
+		Signal<int> signal(stats);
+		int sum = 0;
+		signal.connect([&](int n) { sum += n; });
+		struct Foo {
+			int received = 0;
+			void member_function(int n) { received = n; }
+		};
+		Foo foo;
+		signal.connect(&foo, &Foo::member_function);
+		signal(5);
+		TEST(sum).should == 5;
+		TEST(foo.received).should == 5;
+		TEST(stats.stats().num_allocations).should == 0;
+	});
+	
+	it("should fire connections made during emission from the next emission on", []() {
+		Signal<> signal;
+		int fired_inner = 0;
+		bool connected = false;
+		signal.connect([&]() {
+			if (!connected) {
+				connected = true;
+				signal.connect([&]() { ++fired_inner; });
+			}
+		});
+		signal();
+		TEST(fired_inner).should == 0;
+		signal();
+		TEST(fired_inner).should == 1;
+		TEST(signal.num_connections()).should == 2;
+	});
 }
 
 #endif
@@ -0,0 +1,160 @@
+//
+//  slab_allocator_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "memory/slab_allocator.hpp"
+
+#include <thread>
+
+using namespace grace;
+
+SUITE(SlabAllocator) {
+	it("should round sizes up to their size class", []() {
+		TEST(SlabAllocator::size_of_class(SlabAllocator::size_class_for(1))).should == 16;
+		TEST(SlabAllocator::size_of_class(SlabAllocator::size_class_for(16))).should == 16;
+		TEST(SlabAllocator::size_of_class(SlabAllocator::size_class_for(17))).should == 32;
+		TEST(SlabAllocator::size_of_class(SlabAllocator::size_class_for(129))).should == 160;
+		TEST(SlabAllocator::size_of_class(SlabAllocator::size_class_for(1000))).should == 1024;
+		TEST(SlabAllocator::size_of_class(SlabAllocator::size_class_for(2048))).should == 2048;
+		TEST(SlabAllocator::size_class_for(SlabAllocator::MAX_SMALL_SIZE)).should == SlabAllocator::NUM_SIZE_CLASSES - 1;
+	});
+
+	it("should reuse freed objects", []() {
+		SlabAllocator alloc(default_allocator());
+		void* a = alloc.allocate(24, 8);
+		TEST(alloc.owns(a)).should == true;
+		TEST(alloc.allocation_size(a)).should == 32;
+		TEST(alloc.usage()).should == 32;
+		alloc.free(a, 24);
+		void* b = alloc.allocate(30, 8);
+		TEST(a == b).should == true;
+		alloc.free(b, 30);
+		TEST(alloc.usage()).should == 0;
+	});
+
+	it("should pass large and overaligned requests to the base allocator", []() {
+		SlabAllocator alloc(default_allocator());
+		void* large = alloc.allocate(SlabAllocator::MAX_SMALL_SIZE + 1, 8);
+		void* aligned = alloc.allocate(64, 64);
+		TEST(alloc.owns(large)).should == false;
+		TEST(alloc.owns(aligned)).should == false;
+		TEST((intptr_t)aligned & 63).should == 0;
+		alloc.free(large, SlabAllocator::MAX_SMALL_SIZE + 1);
+		alloc.free(aligned, 64);
+	});
+
+	it("should account base allocations by their real size", []() {
+		SlabAllocator alloc(default_allocator());
+		void* large = alloc.allocate(4000, 8);
+		void* aligned = alloc.allocate(64, 64);
+		TEST(alloc.usage()).should == 4064;
+		large = alloc.reallocate(large, 4000, 8000, 8);
+		aligned = alloc.reallocate(aligned, 64, 128, 128);
+		TEST((intptr_t)aligned & 127).should == 0;
+		TEST(alloc.usage()).should == 8128;
+		// Sizes that are off, as from destroy() on a base class, don't skew the usage.
+		alloc.free(large, 100);
+		alloc.free(aligned, 1);
+		TEST(alloc.usage()).should == 0;
+	});
+
+	it("should keep contents when reallocating into another size class", []() {
+		SlabAllocator alloc(default_allocator());
+		Array<int> numbers(alloc);
+		for (int i = 0; i < 1000; ++i) {
+			numbers.push_back(i);
+		}
+		bool ok = true;
+		for (int i = 0; i < 1000; ++i) {
+			ok = ok && numbers[i] == i;
+		}
+		TEST(ok).should == true;
+	});
+
+	it("should take back objects freed by other threads", []() {
+		SlabAllocator alloc(default_allocator());
+		static const size_t N = 10000;
+		void** objects = (void**)default_allocator().allocate(sizeof(void*) * N, alignof(void*));
+		for (size_t i = 0; i < N; ++i) {
+			objects[i] = alloc.allocate(48, 16);
+		}
+		size_t slabs_before = alloc.num_slabs();
+		std::thread t([&]() {
+			for (size_t i = 0; i < N; ++i) {
+				alloc.free(objects[i], 48);
+			}
+		});
+		t.join();
+		TEST(alloc.usage()).should == 0;
+		for (size_t i = 0; i < N; ++i) {
+			objects[i] = alloc.allocate(48, 16);
+		}
+		TEST(alloc.num_slabs()).should == slabs_before;
+		for (size_t i = 0; i < N; ++i) {
+			alloc.free(objects[i], 48);
+		}
+		default_allocator().free(objects, sizeof(void*) * N);
+	});
+
+	it("should hand slabs of exited threads to other threads", []() {
+		SlabAllocator alloc(default_allocator());
+		void* survivor = nullptr;
+		std::thread t([&]() {
+			survivor = alloc.allocate(100, 16);
+			for (int i = 0; i < 100; ++i) {
+				alloc.free(alloc.allocate(100, 16), 100);
+			}
+		});
+		t.join();
+		size_t slabs = alloc.num_slabs();
+		void* p = alloc.allocate(100, 16);
+		TEST(alloc.num_slabs()).should == slabs;
+		alloc.free(survivor, 100);
+		alloc.free(p, 100);
+		TEST(alloc.usage()).should == 0;
+	});
+
+	it("should allocate from many threads at once", []() {
+		SlabAllocator alloc(default_allocator());
+		static const int NUM_THREADS = 4;
+		bool good[NUM_THREADS] = {false};
+		std::thread threads[NUM_THREADS];
+		for (int i = 0; i < NUM_THREADS; ++i) {
+			threads[i] = std::thread([&alloc, &good, i]() {
+				bool ok = true;
+				for (int round = 0; round < 100; ++round) {
+					Array<int> numbers(alloc);
+					for (int n = 0; n < 200; ++n) {
+						numbers.push_back(n * i);
+					}
+					for (int n = 0; n < 200; ++n) {
+						ok = ok && numbers[n] == n * i;
+					}
+				}
+				good[i] = ok;
+			});
+		}
+		for (auto& t: threads) {
+			t.join();
+		}
+		for (int i = 0; i < NUM_THREADS; ++i) {
+			TEST(good[i]).should == true;
+		}
+		TEST(alloc.usage()).should == 0;
+	});
+
+	benchmark("allocating and freeing 10000 small objects", []() {
+		static SlabAllocator alloc(default_allocator());
+		void* objects[100];
+		for (int round = 0; round < 100; ++round) {
+			for (int i = 0; i < 100; ++i) {
+				objects[i] = alloc.allocate(16 + i * 4, 8);
+			}
+			for (int i = 0; i < 100; ++i) {
+				alloc.free(objects[i], 16 + i * 4);
+			}
+		}
+	});
+}
@@ -0,0 +1,61 @@
+//
+//  small_array_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/small_array.hpp"
+#include "base/string.hpp"
+#include "memory/stats_allocator.hpp"
+
+using namespace grace;
+
+SUITE(SmallArray) {
+	it("should store up to N elements without allocating", []() {
+		StatsAllocator stats(default_allocator());
+		SmallArray<int, 4> a(stats);
+		for (int i = 0; i < 4; ++i) a.push_back(i);
+		TEST(a.is_inline()).should == true;
+		TEST(a.size()).should == 4;
+		TEST(a[3]).should == 3;
+		TEST(stats.stats().num_allocations).should == 0;
+	});
+	
+	it("should move elements to the allocator past N", []() {
+		StatsAllocator stats(default_allocator());
+		SmallArray<String, 2> a(stats);
+		a.push_back("a");
+		a.push_back("b");
+		a.push_back("a string too long to be stored inline");
+		TEST(a.is_inline()).should == false;
+		TEST(stats.stats().num_allocations).should > 0;
+		TEST(a[0]).should == "a";
+		TEST(a[1]).should == "b";
+		TEST(a[2]).should == "a string too long to be stored inline";
+		a.clear();
+		TEST(a.is_inline()).should == true;
+		TEST(stats.stats().num_allocations).should == stats.stats().num_frees;
+	});
+	
+	it("should move both inline and allocated contents", []() {
+		SmallArray<int, 2> small = {1, 2};
+		SmallArray<int, 2> large = {1, 2, 3};
+		const int* large_data = large.data();
+		SmallArray<int, 2> a(move(small));
+		SmallArray<int, 2> b(move(large));
+		TEST(a.size()).should == 2;
+		TEST(a[1]).should == 2;
+		TEST(b.data()).should == large_data;
+		TEST(small.size()).should == 0;
+		TEST(large.size()).should == 0;
+		TEST(large.is_inline()).should == true;
+	});
+	
+	it("should convert to ArrayRef", []() {
+		SmallArray<int, 8> a = {1, 2, 3};
+		int expected[] = {1, 2, 3};
+		ArrayRef<int> ref = a;
+		TEST(ref.size()).should == 3;
+		TEST(a == ArrayRef<const int>(expected)).should == true;
+	});
+}
@@ -0,0 +1,84 @@
+//
+//  stats_allocator_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "memory/stats_allocator.hpp"
+#include "io/string_stream.hpp"
+
+#include <thread>
+
+using namespace grace;
+
+SUITE(StatsAllocator) {
+	it("should put sizes in log2 buckets", []() {
+		TEST(AllocatorStats::size_bucket_for(0)).should == 0;
+		TEST(AllocatorStats::size_bucket_for(1)).should == 0;
+		TEST(AllocatorStats::size_bucket_for(2)).should == 1;
+		TEST(AllocatorStats::size_bucket_for(1023)).should == 9;
+		TEST(AllocatorStats::size_bucket_for(1024)).should == 10;
+		TEST(AllocatorStats::size_bucket_for(SIZE_MAX)).should == AllocatorStats::NUM_SIZE_BUCKETS - 1;
+	});
+
+	it("should count allocations, frees and bytes in flight", []() {
+		StatsAllocator alloc(default_allocator());
+		void* a = alloc.allocate(100, 8);
+		void* b = alloc.allocate(1000, 8);
+		alloc.free(a, 100);
+		AllocatorStats stats = alloc.stats();
+		TEST(stats.num_allocations).should == 2;
+		TEST(stats.num_frees).should == 1;
+		TEST(stats.bytes_allocated).should == 1100;
+		TEST(stats.bytes_in_flight).should == 1000;
+		TEST(stats.peak_bytes_in_flight).should == 1000;
+		TEST(stats.size_histogram[6]).should == 1;
+		TEST(stats.size_histogram[9]).should == 1;
+		alloc.free(b, 1000);
+		TEST(alloc.stats().bytes_in_flight).should == 0;
+	});
+
+	it("should count bytes copied by reallocate", []() {
+		LinearAllocator arena(4096);
+		StatsAllocator alloc(arena);
+		void* a = alloc.allocate(100, 8);
+		a = alloc.reallocate(a, 100, 200, 8); // Grows in place.
+		alloc.allocate(10, 8);
+		alloc.reallocate(a, 200, 300, 8); // Has to move.
+		AllocatorStats stats = alloc.stats();
+		TEST(stats.num_reallocations).should == 2;
+		TEST(stats.realloc_copy_bytes).should == 200;
+		TEST(stats.bytes_in_flight).should == 310;
+	});
+
+	it("should merge counters from several threads", []() {
+		StatsAllocator alloc(default_allocator());
+		static const int NUM_THREADS = 4;
+		static const int N = 10000;
+		std::thread threads[NUM_THREADS];
+		for (auto& t: threads) {
+			t = std::thread([&alloc]() {
+				for (int i = 0; i < N; ++i) {
+					alloc.free(alloc.allocate(64, 8), 64);
+				}
+			});
+		}
+		for (auto& t: threads) {
+			t.join();
+		}
+		AllocatorStats stats = alloc.stats();
+		TEST(stats.num_allocations).should == NUM_THREADS * N;
+		TEST(stats.num_frees).should == NUM_THREADS * N;
+		TEST(stats.bytes_in_flight).should == 0;
+	});
+
+	it("should write a report", []() {
+		StatsAllocator alloc(default_allocator());
+		alloc.free(alloc.allocate(64, 8), 64);
+		StringStream out;
+		alloc.write_report(out);
+		String report = out.string();
+		TEST(find(report, "allocations: 1, frees: 1")).should == 0;
+		TEST(find(report, "  64B: 1") != String::NPos).should == true;
+	});
+}
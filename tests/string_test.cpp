@@ -9,9 +9,33 @@
 #include "tests/test.hpp"
 #include "base/string.hpp"
 #include "base/map.hpp"
+#include "memory/stats_allocator.hpp"
+#include "io/memory_stream.hpp"
+#include "io/string_stream.hpp"
+#include "serialization/yaml.hpp"
 
 using namespace grace;
 
+namespace {
+	// 25000 maps with three entries each, so 100000 nodes.
+	String make_large_yaml_document() {
+		StringStream ss;
+		for (int i = 0; i < 25000; ++i) {
+			ss << "obj" << i << ":\n  name: n" << i << "\n  kind: box\n  size: " << (i % 10) << '\n';
+		}
+		return ss.string();
+	}
+	
+	uint64 allocations_reading_yaml(const String& text) {
+		StatsAllocator stats(default_allocator());
+		Document doc(stats);
+		MemoryStream ms((const byte*)text.data(), (const byte*)text.data() + text.size());
+		String error;
+		YAML().read(doc, ms, error);
+		return stats.stats().num_allocations;
+	}
+}
+
 SUITE(String) {
 #if defined(__has_feature) && __has_feature(cxx_user_literals)
 	it("should create immutable StringRefs with _C suffix", []() {
@@ -80,6 +104,28 @@ SUITE(String) {
 		should_be_greater_than(b, a);
 	});
 	
+	it("should store short strings inline", []() {
+		StatsAllocator stats(default_allocator());
+		String a("object_id_01", stats);
+		String b = std::move(a);
+		String c("a string too long to be stored inline", stats);
+		TEST(stats.stats().num_allocations).should == 1;
+		TEST(b).should == "object_id_01";
+		TEST(a).should == "";
+		b = c;
+		TEST(b).should == c;
+		c = "short";
+		TEST(c).should == "short";
+		TEST(b).should == "a string too long to be stored inline";
+	});
+	
+	it("should allocate less for documents of short strings", []() {
+		String text = make_large_yaml_document();
+		uint64 n = allocations_reading_yaml(text);
+		// 200002 allocations before short strings were stored inline, 50002 after.
+		TEST(n).should < 100000;
+	});
+	
 	it("should work as a map key", []() {
 		Map<String, int> map;
 		map["foo"] = 1;
@@ -87,4 +133,9 @@ SUITE(String) {
 		TEST(map["foo"]).should == 1;
 		TEST(map["bar"]).should == 2;
 	});
-}
\ No newline at end of file
+	
+	benchmark("reading a 100k-node YAML document", []() {
+		static String text = make_large_yaml_document();
+		allocations_reading_yaml(text);
+	});
+}
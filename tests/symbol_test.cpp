@@ -0,0 +1,74 @@
+//
+//  symbol_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "base/symbol.hpp"
+#include "base/hash_map.hpp"
+#include "base/dictionary.hpp"
+
+#include <thread>
+
+using namespace grace;
+
+SUITE(Symbol) {
+	it("should intern equal strings to the same entry", []() {
+		String a = "symbol_test_name";
+		Symbol x(a);
+		Symbol y(StringRef("symbol_test_name"));
+		TEST(x == y).should == true;
+		TEST(x.data() == y.data()).should == true;
+		TEST(x.data() != a.data()).should == true;
+		TEST(x).should == "symbol_test_name";
+		TEST(Symbol("").data() == Symbol().data()).should == true;
+	});
+	
+	it("should find only interned strings", []() {
+		TEST(Symbol::find("symbol_test_never_interned").is_set()).should == false;
+		Symbol s("symbol_test_interned");
+		TEST(Symbol::find("symbol_test_interned").is_set()).should == true;
+	});
+	
+	it("should look up String and StringRef keys", []() {
+		HashMap<Symbol, int> m;
+		m[Symbol("foo")] = 1;
+		m[StringRef("bar")] = 2;
+		TEST(m.find(String("foo"))->second).should == 1;
+		TEST(m.find(Symbol("bar"))->second).should == 2;
+		
+		HashMap<String, int> n;
+		n["foo"] = 3;
+		TEST(n.find(Symbol("foo"))->second).should == 3;
+		
+		Map<Symbol, int> o = {{Symbol("b"), 2}, {Symbol("a"), 1}};
+		TEST(o.keys()[0]).should == "a";
+		TEST(o.find(StringRef("b"))->second).should == 2;
+	});
+	
+	it("should share dictionary keys", []() {
+		Dictionary<int> a, b;
+		a["shared_key"] = 1;
+		b["shared_key"] = 2;
+		TEST(a.keys()[0].data() == b.keys()[0].data()).should == true;
+		TEST(a[Symbol("shared_key")]).should == 1;
+	});
+	
+	it("should intern from many threads at once", []() {
+		static const int NUM_THREADS = 4;
+		Symbol results[NUM_THREADS];
+		std::thread threads[NUM_THREADS];
+		for (int i = 0; i < NUM_THREADS; ++i) {
+			threads[i] = std::thread([&results, i]() {
+				for (int j = 0; j < 1000; ++j) {
+					Symbol s(StringRef(j % 2 ? "symbol_test_odd" : "symbol_test_even"));
+					if (j == 999) results[i] = s;
+				}
+			});
+		}
+		for (auto& t: threads) t.join();
+		for (int i = 0; i < NUM_THREADS; ++i) {
+			TEST(results[i] == results[0]).should == true;
+		}
+	});
+}
@@ -0,0 +1,44 @@
+//
+//  universe_test.cpp
+//  grace
+//
+
+#include "tests/test.hpp"
+#include "object/universe_base.hpp"
+#include "object/reflect.hpp"
+#include "serialization/document.hpp"
+
+using namespace grace;
+
+struct SceneThing : Object {
+	REFLECT;
+	int32 number = 0;
+};
+
+BEGIN_TYPE_INFO(SceneThing)
+	property(&SceneThing::number, "number", "Number.");
+END_TYPE_INFO()
+
+SUITE(Universe) {
+	it("should save objects sorted by ID, however they were created and renamed", []() {
+		TestUniverse universe;
+		universe.create<SceneThing>("delta");
+		universe.create<SceneThing>("bravo");
+		ObjectPtr<SceneThing> charlie = universe.create<SceneThing>("charlie");
+		universe.create<SceneThing>("alpha");
+		universe.rename_object(charlie, "echo");
+		universe.create<SceneThing>("charlie");
+		
+		Document doc;
+		String error;
+		TEST(universe.serialize_scene(doc, error)).should == true;
+		const DocumentNode& objects = doc["objects"];
+		TEST(objects.array_size()).should == 5;
+		const char* expected[] = {"alpha", "bravo", "charlie", "delta", "echo"};
+		for (size_t i = 0; i < 5; ++i) {
+			StringRef id;
+			TEST(objects[i]["id"] >> id).should == true;
+			TEST(id).should == expected[i];
+		}
+	});
+}
@@ -7,11 +7,12 @@
 #include "serialization/document_node.hpp"
 #include "base/any.hpp"
 #include "base/raise.hpp"
+#include "base/symbol.hpp"
 
 namespace grace {
 	struct IAttribute {
 		virtual const IType* type() const = 0;
-		virtual StringRef name() const = 0;
+		virtual Symbol name() const = 0;
 		virtual StringRef description() const = 0;
 		virtual Any get_any(Object* object) const = 0;
 		virtual Any get_any(const Object* object) const = 0;
@@ -35,12 +36,12 @@ namespace grace {
 
 	template <typename ObjectType, typename MemberType, typename GetterType = MemberType>
 	struct AttributeForObjectOfType : AttributeOfType<MemberType> {
-		StringRef name_;
+		Symbol name_;
 		StringRef description_;
 	
 		AttributeForObjectOfType(IAllocator& alloc, StringRef name, StringRef description) : name_(name), description_(description) {}
 		
-		StringRef name() const { return name_; }
+		Symbol name() const { return name_; }
 		StringRef description() const { return description_; }
 	
 		virtual GetterType get(const ObjectType&) const = 0;
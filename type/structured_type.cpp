@@ -13,6 +13,11 @@
 
 namespace grace {
 	const ISlot* StructuredType::find_slot_by_name(StringRef name) const {
+		Maybe<Symbol> sym = Symbol::find(name);
+		return sym ? find_slot_by_name(*sym) : nullptr;
+	}
+	
+	const ISlot* StructuredType::find_slot_by_name(Symbol name) const {
 		const StructuredType* t = this;
 		while (t != nullptr) {
 			for (auto s: t->slots()) {
@@ -24,6 +29,11 @@ namespace grace {
 	}
 	
 	const IAttribute* StructuredType::find_attribute_by_name(StringRef name) const {
+		Maybe<Symbol> sym = Symbol::find(name);
+		return sym ? find_attribute_by_name(*sym) : nullptr;
+	}
+	
+	const IAttribute* StructuredType::find_attribute_by_name(Symbol name) const {
 		const StructuredType* t = this;
 		while (t != nullptr) {
 			for (auto a: t->attributes()) {
@@ -10,6 +10,7 @@
 #define grace_structured_type_hpp
 
 #include "type/type.hpp"
+#include "base/symbol.hpp"
 
 namespace grace {
 	struct ISlot;
@@ -24,8 +25,12 @@ namespace grace {
 		virtual const ReferenceType* reference_type() const;
 		virtual bool wants_game_update() const = 0;
 		
+		// Names are Symbols, so these compare pointers. A name that was never interned
+		// can't belong to any slot or attribute.
 		const ISlot* find_slot_by_name(StringRef name) const;
+		const ISlot* find_slot_by_name(Symbol name) const;
 		const IAttribute* find_attribute_by_name(StringRef name) const;
+		const IAttribute* find_attribute_by_name(Symbol name) const;
 	};
 }
 
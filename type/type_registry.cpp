@@ -1,15 +1,16 @@
 #include "type/type_registry.hpp"
 #include "object/object_type.hpp"
 #include "base/basic.hpp"
-#include "base/map.hpp"
+#include "base/hash_map.hpp"
+#include "base/symbol.hpp"
 //#include "render/vertex_type.hpp"
 
 namespace grace {
 
 struct TypeRegistry::Impl {
-	Map<String, const ObjectTypeBase*> type_map;
-	Map<String, const VertexType*> vertex_type_map;
-	Map<String, const EnumType*> enum_type_map;
+	HashMap<Symbol, const ObjectTypeBase*> type_map;
+	HashMap<Symbol, const VertexType*> vertex_type_map;
+	HashMap<Symbol, const EnumType*> enum_type_map;
 };
 
 TypeRegistry::Impl* TypeRegistry::impl() {